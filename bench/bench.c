@@ -0,0 +1,235 @@
+/* agb_edit microbenchmarks for the hot paths: the code.bin footer parser,
+ * the video LUT generator and renderer, ROM hashing for DAT checks, and the
+ * save library scan.
+ * Built and run with "make bench". Reports time per operation, heap
+ * allocations per operation (counted by wrapping malloc & co. at link time)
+ * and how many bytes of output each operation writes. Fixtures come from
+ * fixture.c, same as agb_mkfixture.
+ */
+
+#include "../src/gbacia.h"
+#include "../src/videolut.h"
+#include "../src/console_ui.h"
+#include "../src/platform.h"
+#include "../src/crc32.h"
+#include "../src/romhash.h"
+#include "../src/savetype.h"
+#include "../src/romedit.h"
+#include "fixture.h"
+
+#define BENCH_MIN_TIME 200000	//keep doubling the iterations until a run takes at least this many microseconds
+#define BENCH_MAX_DESC 64
+#define BENCH_HASH_SIZE (4 << 20)	//a typical ROM
+#define BENCH_SCAN_SIZE (32 << 20)	//the biggest ROM there is
+
+//allocation counting -- the bench target links with --wrap for each of these
+static u64 nAllocs, allocBytes;
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void *p, size_t size);
+void* __wrap_malloc(size_t size) { ++nAllocs; allocBytes += size; return __real_malloc(size); }
+void* __wrap_calloc(size_t n, size_t size) { ++nAllocs; allocBytes += n*size; return __real_calloc(n, size); }
+void* __wrap_realloc(void *p, size_t size) { ++nAllocs; allocBytes += size; return __real_realloc(p, size); }
+
+struct bench {
+	char name[64];
+	void (*run)(void *ctx, FILE *out);
+	void *ctx;
+};
+
+//time one benchmark and print a line for it
+static void runBench(const struct bench *b, FILE *null) {
+	u64 iters, i, start, elapsed, allocs, bytes;
+	long written;
+	FILE *tmp;
+
+	//bytes written by one op -- measured separately since the null device can't tell us
+	tmp = tmpfile();
+	if(tmp) {
+		b->run(b->ctx, tmp);
+		written = ftell(tmp);
+		fclose(tmp);
+	} else {
+		written = -1;
+	}
+
+	for(iters=1; ; iters*=2) {
+		nAllocs = allocBytes = 0;
+		start = timeMicros();
+		for(i=0; i<iters; i++)
+			b->run(b->ctx, null);
+		fflush(null);
+		elapsed = timeMicros() - start;
+		allocs = nAllocs;
+		bytes = allocBytes;
+		if(elapsed >= BENCH_MIN_TIME)
+			break;
+	}
+	printf("%-42s %10llu %12.1f %10.2f %12.1f %10ld\n", b->name, iters, elapsed * 1000.0 / iters,
+			(double)allocs / iters, (double)bytes / iters, written);
+}
+
+//processCodeBin on a synthetic code.bin: a ROM, one config, then extra ROM sections up to nDesc descriptors
+struct parseCtx {
+	u8 *code;
+	u32 codeSize;
+	struct job job;
+};
+
+static void makeCodeBin(struct parseCtx *ctx, int nDesc) {
+	struct fixtureParams params;
+	fixtureDefaults(&params);
+	params.nDesc = nDesc;
+	if(fixtureCodeBin(&params, &ctx->code, &ctx->codeSize)) {
+		ctx->code = NULL;
+		ctx->codeSize = 0;
+	}
+	memset(&ctx->job, 0, sizeof(ctx->job));
+	ctx->job.fname = "bench.cia";
+	ctx->job.settings.onlyInfo = 1;
+}
+
+static void runParse(void *p, FILE *out) {
+	struct parseCtx *ctx = p;
+	struct config cfg;
+	u32 cfgOffset;
+	ctx->job.log = out;
+	processCodeBin(ctx->code, ctx->codeSize, NULL, &ctx->job, &cfg, &cfgOffset);
+}
+
+//makeVideoLUT with one set of parameters
+struct lutParams {
+	double brightness, contrast, gammaIn, gammaOut;
+	int colorTemp;
+};
+
+static void runMakeLUT(void *p, FILE *out) {
+	const struct lutParams *params = p;
+	u8 lut[3*256];
+	lutResetParams(1);
+	lutSetBrightness(params->brightness);
+	lutSetContrast(params->contrast);
+	lutSetGammaIn(params->gammaIn);
+	lutSetGammaOut(params->gammaOut);
+	lutSetColorTemp(params->colorTemp);
+	makeVideoLUT(lut);
+}
+
+static void runPrintLUT(void *p, FILE *out) {
+	printVideoLUT(out, p, 0x80);
+}
+
+//ROM hashing: CRC-32 alone, and all four hashes on their lanes
+static void runCrc32(void *p, FILE *out) {
+	fprintf(out, "%08x", crc32Update(0, p, BENCH_HASH_SIZE));
+}
+
+static void runRomHash(void *p, FILE *out) {
+	struct romHasher hasher;
+	struct romHashes hashes;
+	romHashStart(&hasher, p, BENCH_HASH_SIZE);
+	romHashFinish(&hasher, &hashes);
+	fprintf(out, "%08x", hashes.crc32);
+}
+
+//save library scan over the biggest ROM, with the ID right at the end so it has to look at all of it
+static void runSaveScan(void *p, FILE *out) {
+	struct saveScan scan;
+	saveScanRom(p, BENCH_SCAN_SIZE, &scan);
+	fprintf(out, "%x", scan.kinds);
+}
+
+//trim scan over the biggest ROM with 1 MB of data and the rest padding, the usual shape
+static void runTrimScan(void *p, FILE *out) {
+	struct romTrim trim;
+	romTrimScan(p, BENCH_SCAN_SIZE, &trim);
+	fprintf(out, "%x", trim.trimmedSize);
+}
+
+int main(int argc, char **argv) {
+	static struct parseCtx parse[8];
+	static const struct lutParams lutGrid[] = {
+		{0.0, 1.0, 2.2, 2.2, 6500},	//identity
+		{0.0, 1.0, 2.2, 1.54, 6500},	//NSUI-style darken filter
+		{-0.2, 1.3, 2.2, 1.54, 6500},
+		{0.1, 0.8, 1.8, 2.4, 4500},
+		{0.0, 1.0, 2.2, 2.2, 1000},	//extreme color temperatures
+		{0.0, 1.0, 2.2, 2.2, 25000},
+	};
+	static u8 lut[3*256];
+	struct bench benches[sizeof(parse)/sizeof(parse[0]) + sizeof(lutGrid)/sizeof(lutGrid[0]) + 5];
+	u8 *rom, *bigRom, *padRom;
+	int nBenches = 0, nDesc, i;
+	FILE *null;
+
+	null = fopen(NULL_DEVICE, "w");
+	if(!null) {
+		printf("Can't open %s\n", NULL_DEVICE);
+		return 1;
+	}
+
+	//footers from the minimum of 2 descriptors up to BENCH_MAX_DESC
+	for(i=0, nDesc=2; nDesc<=BENCH_MAX_DESC && i<sizeof(parse)/sizeof(parse[0]); i++, nDesc*=2) {
+		makeCodeBin(&parse[i], nDesc);
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "processCodeBin/%d desc", nDesc);
+		benches[nBenches].run = runParse;
+		benches[nBenches++].ctx = &parse[i];
+	}
+	for(i=0; i<sizeof(lutGrid)/sizeof(lutGrid[0]); i++) {
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "makeVideoLUT/b%+.1f c%.1f g%.2f:%.2f %dK",
+				lutGrid[i].brightness, lutGrid[i].contrast, lutGrid[i].gammaIn, lutGrid[i].gammaOut, lutGrid[i].colorTemp);
+		benches[nBenches].run = runMakeLUT;
+		benches[nBenches++].ctx = (void*)&lutGrid[i];
+	}
+	lutResetParams(1);
+	makeVideoLUT(lut);
+	snprintf(benches[nBenches].name, sizeof(benches[0].name), "printVideoLUT");
+	benches[nBenches].run = runPrintLUT;
+	benches[nBenches++].ctx = lut;
+	rom = malloc(BENCH_HASH_SIZE);
+	if(rom) {
+		for(i=0; i<BENCH_HASH_SIZE; i++)
+			rom[i] = i * 7 + (i >> 9);
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "crc32/4 MB");
+		benches[nBenches].run = runCrc32;
+		benches[nBenches++].ctx = rom;
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "romHash/4 MB, 4 lanes");
+		benches[nBenches].run = runRomHash;
+		benches[nBenches++].ctx = rom;
+	}
+	bigRom = malloc(BENCH_SCAN_SIZE);
+	if(bigRom) {
+		for(i=0; i<BENCH_SCAN_SIZE; i++)
+			bigRom[i] = i * 7 + (i >> 9);
+		memcpy(bigRom + BENCH_SCAN_SIZE - 0x20, "FLASH1M_V103", 12);
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "saveScanRom/32 MB");
+		benches[nBenches].run = runSaveScan;
+		benches[nBenches++].ctx = bigRom;
+	}
+	padRom = malloc(BENCH_SCAN_SIZE);
+	if(padRom) {
+		for(i=0; i<BENCH_SCAN_SIZE; i++)
+			padRom[i] = i < (1 << 20) ? i * 7 + (i >> 9) : 0xff;
+		snprintf(benches[nBenches].name, sizeof(benches[0].name), "romTrimScan/32 MB, 31 MB padding");
+		benches[nBenches].run = runTrimScan;
+		benches[nBenches++].ctx = padRom;
+	}
+
+	printf("%-42s %10s %12s %10s %12s %10s\n", "benchmark", "iters", "ns/op", "allocs/op", "alloc B/op", "out B/op");
+	for(i=0; i<nBenches; i++) {
+		//only run the ones whose names start with an argument, if any were given
+		int run = argc < 2;
+		for(int j=1; j<argc && !run; j++)
+			run = 0 == strncmp(benches[i].name, argv[j], strlen(argv[j]));
+		if(run)
+			runBench(&benches[i], null);
+	}
+
+	fclose(null);
+	for(i=0; i<sizeof(parse)/sizeof(parse[0]); i++)
+		free(parse[i].code);
+	free(rom);
+	free(bigRom);
+	free(padRom);
+	return 0;
+}
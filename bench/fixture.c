@@ -0,0 +1,270 @@
+/* agb_edit synthetic GBA VC fixture builder */
+
+#include "fixture.h"
+#include "../src/exefs.h"
+#include "../src/ncch.h"
+#include "../src/cia.h"
+#include "../src/lz.h"
+#include "../src/sha256.h"
+
+#define FIXTURE_RANDOM_SIZE 0x1000	//only the start of the ROM is random, the rest is 0xff like an unused cart
+#define FIXTURE_EXHEADER_SIZE 0x800	//exheader plus access descriptor
+#define FIXTURE_ROMFS_SIZE 0x1000
+#define FIXTURE_TMD_SIG 0x10004	//RSA-2048 SHA-256
+#define FIXTURE_SIG_SIZE (4 + 0x100 + 0x3c)
+#define FIXTURE_CERT_SIZE 0xa00
+#define FIXTURE_TIK_BODY_SIZE 0x210
+
+static u32 alignUp(u32 value, u32 alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static u32 xorshift(u32 *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void putLE32(u8 *p, u32 v) { p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24; }
+static void putBE16(u8 *p, u16 v) { p[0] = v>>8; p[1] = v; }
+static void putBE32(u8 *p, u32 v) { p[0] = v>>24; p[1] = v>>16; p[2] = v>>8; p[3] = v; }
+static void putBE64(u8 *p, u64 v) { putBE32(p, v>>32); putBE32(p+4, v); }
+
+//the ID string the save library leaves in the ROM, which is how save types get detected
+static const char* saveLibraryId(u32 saveType) {
+	switch(saveType) {
+		case EEPROM_8K_SMALLROM: case EEPROM_8K_256MROM: case EEPROM_64K_SMALLROM: case EEPROM_64K_256MROM:
+			return "EEPROM_V124";
+		case FLASH_512K_ATMEL_RTC: case FLASH_512K_ATMEL: case FLASH_512K_SST_RTC: case FLASH_512K_SST:
+		case FLASH_512K_PANASONIC_RTC: case FLASH_512K_PANASONIC:
+			return "FLASH512_V131";
+		case FLASM_1M_MACRONIX_RTC: case FLASM_1M_MACRONIX: case FLASM_1M_SANYO_RTC: case FLASM_1M_SANYO:
+			return "FLASH1M_V103";
+		case SRAM_256K:
+			return "SRAM_V113";
+		default:
+			return NULL;
+	}
+}
+
+void fixtureDefaults(struct fixtureParams *params) {
+	memset(params, 0, sizeof(struct fixtureParams));
+	params->romSize = 0x40000;
+	params->nDesc = 2;
+	params->saveType = SRAM_256K;
+	params->lcdGhosting = 0x80;
+	for(int i=0; i<sizeof(params->videoLUT); i++)
+		params->videoLUT[i] = i/3;
+	params->seed = 1;
+}
+
+const char* fixtureCodeBin(const struct fixtureParams *params, u8 **out, u32 *outSize) {
+	struct sectionDescriptor *sec;
+	struct footer *ftr;
+	struct config *cfg;
+	const char *saveId = params->saveLibrary ? params->saveLibrary : saveLibraryId(params->saveType);
+	u32 cfgOffset, descOffset, size, state = params->seed ? params->seed : 1;
+	u8 *code;
+
+	if(params->romSize < FIXTURE_MIN_ROM_SIZE || params->romSize > FIXTURE_MAX_ROM_SIZE) return "ROM size out of range";
+	if(params->nDesc < 2) return "need at least 2 section descriptors";
+	cfgOffset = alignUp(params->romSize, 0x10);
+	descOffset = alignUp(cfgOffset + sizeof(struct config), 0x10);
+	size = descOffset + params->nDesc * sizeof(struct sectionDescriptor) + sizeof(struct footer);
+	code = malloc(size);
+	if(!code) return "can't allocate memory (code.bin)";
+	memset(code, 0, size);
+
+	//ROM: random start with a header, then blank
+	for(u32 i=0; i<params->romSize && i<FIXTURE_RANDOM_SIZE; i++)
+		code[i] = xorshift(&state);
+	if(params->romSize > FIXTURE_RANDOM_SIZE)
+		memset(code + FIXTURE_RANDOM_SIZE, 0xff, params->romSize - FIXTURE_RANDOM_SIZE);
+	memcpy(code + 0xa0, "FIXTURE\0\0\0\0\0AFXE01", 18);	//title, game code, maker code
+	if(saveId)
+		memcpy(code + 0x200, saveId, strlen(saveId));
+	if(!params->saveLibrary && params->saveType <= FLASM_1M_SANYO && !(params->saveType & 1)
+			&& params->saveType >= FLASH_512K_ATMEL_RTC)
+		memcpy(code + 0x220, "SIIRTC_V001", 11);	//the RTC types
+
+	cfg = (struct config*)(code + cfgOffset);
+	cfg->romSize = params->romSize;
+	cfg->saveType = params->saveType;
+	cfg->sleepButtons = params->sleepButtons;
+	cfg->saveConfig = params->saveConfig;
+	cfg->lcdGhosting = params->lcdGhosting;
+	memcpy(cfg->videoLUT, params->videoLUT, sizeof(cfg->videoLUT));
+
+	sec = (struct sectionDescriptor*)(code + descOffset);
+	for(int i=0; i<params->nDesc; i++) {
+		sec[i].type = i == 1 ? 1 : 0;
+		sec[i].offset = i == 1 ? cfgOffset : 0;
+		sec[i].size = i == 1 ? sizeof(struct config) : params->romSize;
+	}
+	ftr = (struct footer*)(code + size - sizeof(struct footer));
+	ftr->magic = 0x4141432e;	//'.CAA'
+	ftr->active = 1;
+	ftr->offset = descOffset;
+	ftr->nDesc = params->nDesc << 4;
+
+	*out = code;
+	*outSize = size;
+	return NULL;
+}
+
+//exefs with .code and a banner
+static const char* buildExefs(const struct fixtureParams *params, u8 **out, u32 *outSize) {
+	static const u8 banner[0x100] = "BANNER";
+	struct exefs exefs;
+	const char *result;
+	u8 *code, *packed;
+	u32 codeSize, packedSize;
+
+	result = fixtureCodeBin(params, &code, &codeSize);
+	if(result) return result;
+	if(params->compress) {
+		result = lzCompress(code, codeSize, &packed, &packedSize);
+		free(code);
+		if(result) return result;
+		code = packed;
+		codeSize = packedSize;
+	}
+
+	memset(&exefs, 0, sizeof(exefs));
+	memcpy(exefs.header.files[0].name, ".code", 5);
+	exefsReplaceFile(&exefs, 0, code, codeSize);
+	memcpy(exefs.header.files[1].name, "banner", 6);
+	exefs.files[1] = banner;
+	exefs.header.files[1].size = sizeof(banner);
+
+	*outSize = exefsBuildSize(&exefs);
+	*out = malloc(*outSize);
+	if(!*out) { exefsFree(&exefs); return "can't allocate memory (exefs)"; }
+	exefsBuild(&exefs, *out);
+	exefsFree(&exefs);
+	return NULL;
+}
+
+//decrypted NCCH: header, exheader, exefs, romfs
+static const char* buildNcch(const struct fixtureParams *params, u64 titleId, u8 **out, u32 *outSize) {
+	struct ncchHeader *hdr;
+	const char *result;
+	u8 *exefs, *ncch, *exh, *romfs;
+	u32 exefsSize, exefsOffset, romfsOffset, size;
+
+	result = buildExefs(params, &exefs, &exefsSize);
+	if(result) return result;
+	exefsOffset = sizeof(struct ncchHeader) + FIXTURE_EXHEADER_SIZE;
+	romfsOffset = alignUp(exefsOffset + alignUp(exefsSize, NCCH_MEDIA_UNIT), 0x1000);
+	size = romfsOffset + FIXTURE_ROMFS_SIZE;
+	ncch = calloc(1, size);
+	if(!ncch) { free(exefs); return "can't allocate memory (NCCH)"; }
+
+	exh = ncch + sizeof(struct ncchHeader);
+	memcpy(exh, "FIXTURE", 7);
+	if(params->compress)
+		exh[EXHEADER_FLAGS] |= EXHEADER_FLAG_COMPRESSED;
+	memcpy(ncch + exefsOffset, exefs, exefsSize);
+	free(exefs);
+	romfs = ncch + romfsOffset;
+	for(u32 i=0; i<FIXTURE_ROMFS_SIZE; i+=4)
+		memcpy(romfs + i, "RMFS", 4);
+
+	hdr = (struct ncchHeader*)ncch;
+	hdr->magic = NCCH_MAGIC;
+	hdr->contentSize = size / NCCH_MEDIA_UNIT;
+	hdr->partitionId = hdr->programId = titleId;
+	memcpy(hdr->productCode, "CTR-P-AFXE", 10);
+	hdr->exheaderSize = 0x400;
+	sha256(exh, hdr->exheaderSize, hdr->exheaderHash);
+	hdr->flags[7] = NCCH_FLAG7_NOCRYPTO;
+	hdr->exefsOffset = exefsOffset / NCCH_MEDIA_UNIT;
+	hdr->exefsSize = alignUp(exefsSize, NCCH_MEDIA_UNIT) / NCCH_MEDIA_UNIT;
+	hdr->exefsHashSize = 1;
+	sha256(ncch + exefsOffset, NCCH_MEDIA_UNIT, hdr->exefsHash);
+	hdr->romfsOffset = romfsOffset / NCCH_MEDIA_UNIT;
+	hdr->romfsSize = FIXTURE_ROMFS_SIZE / NCCH_MEDIA_UNIT;
+	hdr->romfsHashSize = 1;
+	sha256(romfs, NCCH_MEDIA_UNIT, hdr->romfsHash);
+
+	*out = ncch;
+	*outSize = size;
+	return NULL;
+}
+
+//cia around the NCCH and optional manual, with dummy cert chain and ticket and an unsigned TMD
+const char* fixtureCia(const struct fixtureParams *params, u8 **out, u64 *outSize) {
+	u64 titleId = 0x0004000000f00000ull | ((params->seed & 0xfff) << 8);
+	const u8 *contents[2];
+	u32 contentSizes[2], tmdSize, offset;
+	u32 certOffset, tikOffset, tmdOffset, contentOffset, tikSize = FIXTURE_SIG_SIZE + FIXTURE_TIK_BODY_SIZE;
+	int nContents = params->manualSize ? 2 : 1;
+	const char *result;
+	u8 *ncch, *manual = NULL, *cia, *tmd, *chunk, *info;
+	u32 ncchSize;
+	u64 size, contentSize;
+
+	result = buildNcch(params, titleId, &ncch, &ncchSize);
+	if(result) return result;
+	contents[0] = ncch;
+	contentSizes[0] = ncchSize;
+	if(params->manualSize) {
+		manual = malloc(params->manualSize);
+		if(!manual) { free(ncch); return "can't allocate memory (manual)"; }
+		memset(manual, 'M', params->manualSize);
+		contents[1] = manual;
+		contentSizes[1] = params->manualSize;
+	}
+
+	tmdSize = FIXTURE_SIG_SIZE + TMD_CHUNK_RECORDS + nContents * TMD_CHUNK_SIZE;
+	certOffset = alignUp(0x2020, CIA_ALIGN);
+	tikOffset = alignUp(certOffset + FIXTURE_CERT_SIZE, CIA_ALIGN);
+	tmdOffset = alignUp(tikOffset + tikSize, CIA_ALIGN);
+	contentOffset = alignUp(tmdOffset + tmdSize, CIA_ALIGN);
+	contentSize = 0;
+	for(int i=0; i<nContents; i++)
+		contentSize += contentSizes[i];
+	size = contentOffset + contentSize;
+	cia = calloc(1, size);
+	if(!cia) { free(ncch); free(manual); return "can't allocate memory (cia)"; }
+
+	//header and content index bitmap
+	putLE32(cia + 0x00, 0x2020);
+	putLE32(cia + 0x08, FIXTURE_CERT_SIZE);
+	putLE32(cia + 0x0c, tikSize);
+	putLE32(cia + 0x10, tmdSize);
+	putLE32(cia + 0x18, contentSize);
+	putLE32(cia + 0x1c, contentSize >> 32);
+	for(int i=0; i<nContents; i++)
+		cia[0x20] |= 0x80 >> i;
+	memset(cia + certOffset, 'C', FIXTURE_CERT_SIZE);
+	putBE32(cia + tikOffset, FIXTURE_TMD_SIG);
+	memset(cia + tikOffset + FIXTURE_SIG_SIZE, 'T', FIXTURE_TIK_BODY_SIZE);
+
+	//TMD: content 0 is the game with id 2 and content 1 the manual with id 3, like Nintendo's VCs
+	putBE32(cia + tmdOffset, FIXTURE_TMD_SIG);
+	tmd = cia + tmdOffset + FIXTURE_SIG_SIZE;
+	putBE64(tmd + TMD_TITLE_ID, titleId);
+	putBE16(tmd + TMD_CONTENT_COUNT, nContents);
+	chunk = tmd + TMD_CHUNK_RECORDS;
+	offset = contentOffset;
+	for(int i=0; i<nContents; i++, chunk += TMD_CHUNK_SIZE) {
+		putBE32(chunk + 0x00, 2 + i);
+		putBE16(chunk + 0x04, i);
+		putBE64(chunk + 0x08, contentSizes[i]);
+		sha256(contents[i], contentSizes[i], chunk + 0x10);
+		memcpy(cia + offset, contents[i], contentSizes[i]);
+		offset += contentSizes[i];
+	}
+	info = tmd + TMD_INFO_RECORDS;
+	putBE16(info + 2, nContents);
+	sha256(tmd + TMD_CHUNK_RECORDS, nContents * TMD_CHUNK_SIZE, info + 4);
+	sha256(info, TMD_INFO_COUNT * TMD_INFO_SIZE, tmd + TMD_INFO_HASH);
+
+	free(ncch);
+	free(manual);
+	*out = cia;
+	*outSize = size;
+	return NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef __FIXTURE_H__
+#define __FIXTURE_H__
+
+/* Synthetic GBA VC fixtures
+ * Builds a code.bin laid out the way processCodeBin expects (ROM, config,
+ * section descriptors, then the '.CAA' footer) and wraps it in an exefs,
+ * a decrypted NCCH and a cia, optionally with a second manual-like content.
+ * The ROM is pseudo-random data from a seed, so the same parameters always
+ * give the same file.
+ */
+
+#include "../src/gbacia.h"
+
+#define FIXTURE_MIN_ROM_SIZE 0x400	//room for the header and save library ID
+#define FIXTURE_MAX_ROM_SIZE (32 << 20)
+
+struct fixtureParams {
+	u32 romSize;	//FIXTURE_MIN_ROM_SIZE to FIXTURE_MAX_ROM_SIZE
+	int nDesc;	//section descriptors, at least 2: the ROM and the config; extra ones are more ROM sections
+	u32 saveType;	//enum saveType -- the ROM also gets the matching save library ID string
+	const char *saveLibrary;	//put this save library ID in the ROM instead, for a mismatch; "" for none, NULL for the matching one
+	u16 sleepButtons;
+	u32 lcdGhosting;
+	struct saveConfig saveConfig;
+	u8 videoLUT[3 * 256];
+	u32 manualSize;	//size of a second content at index 1, 0 for none
+	int compress;	//LZ compress .code and flag it in the exheader
+	u32 seed;
+};
+
+void fixtureDefaults(struct fixtureParams *params);	//256 KB SRAM game with an identity LUT, no manual
+//both return a string on failure, NULL on success; *out is malloc'd
+const char* fixtureCodeBin(const struct fixtureParams *params, u8 **out, u32 *outSize);
+const char* fixtureCia(const struct fixtureParams *params, u8 **out, u64 *outSize);
+
+#endif /* __FIXTURE_H__ */
@@ -0,0 +1,115 @@
+/* agb_edit fixture generator: writes synthetic GBA VC cias (or bare code.bins)
+ * for load testing. Built with "make fixtures".
+ */
+
+#include "fixture.h"
+
+static void usage(void) {
+	printf(
+"Usage: agb_mkfixture [options] OUT\n"
+"Writes a synthetic decrypted GBA VC cia to OUT. With -count N, writes N of them\n"
+"named OUT0000.cia, OUT0001.cia... each with its own seed.\n\n"
+"Options:\n"
+" -rom SIZE      ROM size in bytes, up to 32 MB (default 0x40000)\n"
+" -desc N        Section descriptors in the footer, at least 2 (default 2)\n"
+" -save TYPE     Save type number, see enum saveType (default 0xe, SRAM)\n"
+" -savelib ID    Save library ID to put in the ROM instead of the one that goes\n"
+"                with -save, like FLASH1M_V103, or none\n"
+" -buttons MASK  Sleep buttons in the config (default 0)\n"
+" -ghost N       LCD ghosting in the config (default 0x80)\n"
+" -savecfg A,B,C,D  Save chip cycle counts in the config (default 0,0,0,0)\n"
+" -manual SIZE   Add a manual-like second content of SIZE bytes\n"
+" -compress      LZ compress .code like some official VCs\n"
+" -seed N        Seed for the ROM data (default 1)\n"
+" -count N       Number of files to write\n"
+" -codebin       Write just the code.bin instead of a cia\n");
+}
+
+static const char* writeFile(const char *fname, const u8 *data, u64 size) {
+	size_t nwritten;
+	FILE *fp = fopen(fname, "wb");
+	if(!fp) return "can't create file";
+	nwritten = fwrite(data, 1, size, fp);
+	if(fclose(fp) != 0 || nwritten != size) return "can't write file";
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	struct fixtureParams params;
+	const char *outName = NULL, *result;
+	char fname[4096];
+	int count = 0, codeBinOnly = 0, i;
+	u32 codeSize;
+	u64 size;
+	u8 *data;
+
+	fixtureDefaults(&params);
+	for(i=1; i<argc; i++) {
+		const char *arg = argv[i], *val = i+1 < argc ? argv[i+1] : NULL;
+		if(0 == strcmp(arg, "-compress")) {
+			params.compress = 1;
+		} else if(0 == strcmp(arg, "-codebin")) {
+			codeBinOnly = 1;
+		} else if(arg[0] == '-' && !val) {
+			printf("ERROR: %s needs a value\n", arg);
+			return 1;
+		} else if(0 == strcmp(arg, "-rom")) {
+			params.romSize = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-desc")) {
+			params.nDesc = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-save")) {
+			params.saveType = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-savelib")) {
+			params.saveLibrary = 0 == strcmp(argv[++i], "none") ? "" : argv[i];
+		} else if(0 == strcmp(arg, "-buttons")) {
+			params.sleepButtons = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-ghost")) {
+			params.lcdGhosting = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-savecfg")) {
+			struct saveConfig *sc = &params.saveConfig;
+			if(4 != sscanf(argv[++i], "%u,%u,%u,%u", &sc->flashChipEraseCycles, &sc->flashSectorEraseCycles,
+					&sc->flashProgramCycles, &sc->eepromWriteCycles)) {
+				printf("ERROR: -savecfg needs 4 numbers separated by commas\n");
+				return 1;
+			}
+		} else if(0 == strcmp(arg, "-manual")) {
+			params.manualSize = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-seed")) {
+			params.seed = strtoul(argv[++i], NULL, 0);
+		} else if(0 == strcmp(arg, "-count")) {
+			count = atoi(argv[++i]);
+		} else if(arg[0] == '-') {
+			printf("ERROR: unknown option %s\n", arg);
+			return 1;
+		} else {
+			outName = arg;
+		}
+	}
+	if(!outName) {
+		usage();
+		return 1;
+	}
+
+	for(i=0; i<(count ? count : 1); i++) {
+		if(count)
+			snprintf(fname, sizeof(fname), "%s%04d.%s", outName, i, codeBinOnly ? "bin" : "cia");
+		else
+			snprintf(fname, sizeof(fname), "%s", outName);
+		if(codeBinOnly) {
+			result = fixtureCodeBin(&params, &data, &codeSize);
+			size = codeSize;
+		} else {
+			result = fixtureCia(&params, &data, &size);
+		}
+		if(!result) {
+			result = writeFile(fname, data, size);
+			free(data);
+		}
+		if(result) {
+			printf("ERROR: %s: %s\n", fname, result);
+			return 1;
+		}
+		++params.seed;
+	}
+	return 0;
+}
@@ -0,0 +1,149 @@
+/* agb_edit parallel batch runner */
+
+#include <pthread.h>
+#include "batch.h"
+#include "trace.h"
+#include "report.h"
+#include "platform.h"
+
+struct batch {
+	struct job *jobs;
+	int nJobs;
+	int nextJob;	//next job a worker should pick up
+	int nextToPrint;	//next job whose log goes to stdout
+	int nextWorker;	//number for the next worker thread that starts
+	int *done;
+	pthread_mutex_t lock;
+};
+
+//copy a finished job's log to stdout and delete it
+static void dumpLog(struct job *job) {
+	char buf[65536];
+	size_t n;
+	FILE *fp = fopen(job->logName, "rb");
+	if(!fp) return;
+	while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		fwrite(buf, 1, n, stdout);
+	fclose(fp);
+	fflush(stdout);
+	remove(job->logName);
+}
+
+//put a finished job's output where it goes: its JSON object into the report, or its log to stdout
+static void finishJob(struct job *job) {
+	if(job->report)
+		reportTitle(job->report, job);
+	else
+		dumpLog(job);
+}
+
+static void runJob(struct job *job) {
+	struct traceSpan span;
+
+	if(job->logName[0] != '\0') {
+		job->log = fopen(job->logName, "w");
+		if(!job->log) {
+			job->status = "can't create log file";
+			return;
+		}
+	}
+	traceBegin(&span, "process");
+	job->status = process(job);
+	traceEnd(&span, job, 0, 0, TRACE_NO_EXIT_CODE);
+	traceBegin(&span, "cleanup");
+	cleanup(job);
+	traceEnd(&span, job, 0, 0, TRACE_NO_EXIT_CODE);
+	if(job->log != stdout)
+		fclose(job->log);
+}
+
+static void* worker(void *arg) {
+	struct batch *b = arg;
+	int i, id;
+
+	pthread_mutex_lock(&b->lock);
+	id = b->nextWorker++;
+	pthread_mutex_unlock(&b->lock);
+	while(1) {
+		pthread_mutex_lock(&b->lock);
+		i = b->nextJob++;
+		pthread_mutex_unlock(&b->lock);
+		if(i >= b->nJobs)
+			break;
+
+		b->jobs[i].worker = id;
+		runJob(&b->jobs[i]);
+
+		//print every log that's now next in line
+		pthread_mutex_lock(&b->lock);
+		b->done[i] = 1;
+		while(b->nextToPrint < b->nJobs && b->done[b->nextToPrint])
+			finishJob(&b->jobs[b->nextToPrint++]);
+		pthread_mutex_unlock(&b->lock);
+	}
+	return NULL;
+}
+
+void runBatch(struct job *jobs, int nJobs, int nWorkers) {
+	struct batch b;
+	pthread_t *threads;
+	int i;
+
+	if(nWorkers > nJobs) nWorkers = nJobs;
+	if(nWorkers < 1) nWorkers = 1;
+
+	//serial: same as it always was, everything straight to stdout
+	//with a JSON report the text log is thrown away, since the report has it all
+	if(nWorkers == 1) {
+		for(i=0; i<nJobs; i++) {
+			strcpy(jobs[i].tmpName, "UNPACKTMP");
+			strcpy(jobs[i].logName, jobs[i].report ? NULL_DEVICE : "");
+			jobs[i].log = stdout;
+			jobs[i].worker = 0;
+			runJob(&jobs[i]);
+			if(jobs[i].report)
+				reportTitle(jobs[i].report, &jobs[i]);
+		}
+		return;
+	}
+
+	printf("Running %d jobs at a time\n", nWorkers);
+	fflush(stdout);
+	for(i=0; i<nJobs; i++) {
+		snprintf(jobs[i].tmpName, sizeof(jobs[i].tmpName), "UNPACKTMP.%d", i);
+		if(jobs[i].report)
+			strcpy(jobs[i].logName, NULL_DEVICE);
+		else
+			snprintf(jobs[i].logName, sizeof(jobs[i].logName), "UNPACKTMP.%d.log", i);
+		jobs[i].log = NULL;
+	}
+
+	b.jobs = jobs;
+	b.nJobs = nJobs;
+	b.nextJob = 0;
+	b.nextToPrint = 0;
+	b.nextWorker = 0;
+	b.done = calloc(nJobs, sizeof(int));
+	threads = calloc(nWorkers, sizeof(pthread_t));
+	if(!b.done || !threads) {
+		printf("Can't allocate memory for workers, running one job at a time\n");
+		free(b.done);
+		free(threads);
+		runBatch(jobs, nJobs, 1);
+		return;
+	}
+	pthread_mutex_init(&b.lock, NULL);
+
+	for(i=0; i<nWorkers; i++) {
+		if(0 != pthread_create(&threads[i], NULL, worker, &b))
+			break;
+	}
+	if(i == 0)	//couldn't start any threads, so do it all on this one
+		worker(&b);
+	while(i-- > 0)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&b.lock);
+	free(b.done);
+	free(threads);
+}
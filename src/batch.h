@@ -0,0 +1,15 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+/* Batch runner: works through a list of jobs on a pool of worker threads.
+ * Every job gets its own workspace and log; logs are copied to stdout in
+ * input order as the jobs finish, so the output reads the same as a serial run.
+ * With a JSON report, each job's object is written in input order the same way.
+ */
+
+#include "gbacia.h"
+
+//jobs must already have fname and settings filled in
+void runBatch(struct job *jobs, int nJobs, int nWorkers);
+
+#endif /* __BATCH_H__ */
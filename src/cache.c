@@ -0,0 +1,234 @@
+/* agb_edit content-addressed cache of unpacked titles */
+
+#include <time.h>
+#include "cache.h"
+#include "platform.h"
+
+#define CACHE_STAMP "lastused"	//its modified time is when the entry was last used
+
+//an entry found while looking for things to evict
+struct cacheItem {
+	char name[2*SHA256_SIZE + 1];
+	u64 size;
+	s64 used;
+};
+
+struct cacheScan {
+	const char *dir;
+	struct cacheItem *items;
+	int nItems, cap;
+	u64 total;
+	s64 now;
+};
+
+struct sizeScan {
+	u64 size;
+	s64 used;
+};
+
+static int isKey(const char *name) {
+	int i;
+	for(i=0; i<2*SHA256_SIZE; i++)
+		if(!isxdigit((unsigned char)name[i])) return 0;
+	return name[i] == '\0';
+}
+
+static void tempName(struct cache *cache, char *out, size_t outSize) {
+	unsigned int n;
+	pthread_mutex_lock(&cache->lock);
+	n = cache->nextTemp++;
+	pthread_mutex_unlock(&cache->lock);
+	snprintf(out, outSize, "%s" PATH_SEP "tmp.%d.%u", cache->dir, processId(), n);
+}
+
+//these need cache->lock held
+static int isPinned(struct cache *cache, const char *key) {
+	for(int i=0; i<cache->nPins; i++)
+		if(0 == strcmp(cache->pins[i].key, key))
+			return 1;
+	return 0;
+}
+
+static int pin(struct cache *cache, const char *key) {
+	int i;
+	for(i=0; i<cache->nPins && 0 != strcmp(cache->pins[i].key, key); i++);
+	if(i == cache->nPins) {
+		if(cache->nPins == cache->pinCap) {
+			struct cachePin *grown = realloc(cache->pins, (cache->pinCap ? cache->pinCap*2 : 16) * sizeof(struct cachePin));
+			if(!grown) return -1;
+			cache->pins = grown;
+			cache->pinCap = cache->pinCap ? cache->pinCap*2 : 16;
+		}
+		strcpy(cache->pins[i].key, key);
+		cache->pins[i].count = 0;
+		++cache->nPins;
+	}
+	++cache->pins[i].count;
+	return 0;
+}
+
+static void unpin(struct cache *cache, const char *key) {
+	for(int i=0; i<cache->nPins; i++) {
+		if(0 == strcmp(cache->pins[i].key, key)) {
+			if(--cache->pins[i].count == 0)
+				cache->pins[i] = cache->pins[--cache->nPins];
+			return;
+		}
+	}
+}
+
+static int addEntrySize(void *ctx, const struct dirEntry *entry) {
+	struct sizeScan *scan = ctx;
+	scan->size += entry->size;
+	if(0 == strcmp(entry->name, CACHE_STAMP))
+		scan->used = entry->mtime;
+	return 0;
+}
+
+static int addItem(void *ctx, const struct dirEntry *entry) {
+	struct cacheScan *scan = ctx;
+	struct sizeScan size = {0, 0};
+	char path[4096];
+
+	if(!entry->isDir) return 0;
+	snprintf(path, sizeof(path), "%s" PATH_SEP "%s", scan->dir, entry->name);
+	if(0 == strncmp(entry->name, "tmp.", 4)) {
+		if(scan->now - entry->mtime > CACHE_STALE_SECONDS)
+			removeTree(path);
+		return 0;
+	}
+	if(!isKey(entry->name)) return 0;
+
+	if(scan->nItems == scan->cap) {
+		struct cacheItem *grown = realloc(scan->items, (scan->cap ? scan->cap*2 : 64) * sizeof(struct cacheItem));
+		if(!grown) return 1;	//evict what we've seen so far
+		scan->items = grown;
+		scan->cap = scan->cap ? scan->cap*2 : 64;
+	}
+	listDir(path, addEntrySize, &size);
+	strcpy(scan->items[scan->nItems].name, entry->name);
+	scan->items[scan->nItems].size = size.size;
+	scan->items[scan->nItems].used = size.used;
+	scan->total += size.size;
+	++scan->nItems;
+	return 0;
+}
+
+static int byLastUse(const void *a, const void *b) {
+	s64 x = ((const struct cacheItem*)a)->used, y = ((const struct cacheItem*)b)->used;
+	return x < y ? -1 : x > y;
+}
+
+//drop least recently used entries until we're under the size limit, never the one named keep,
+//one a worker has open, or one used since this run started
+static void evict(struct cache *cache, const char *keep) {
+	struct cacheScan scan;
+	char path[4096], doomed[4096];
+	int i, moved;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.dir = cache->dir;
+	scan.now = time(NULL);
+	pthread_mutex_lock(&cache->lock);	//one evicting worker is plenty
+	listDir(cache->dir, addItem, &scan);
+	qsort(scan.items, scan.nItems, sizeof(struct cacheItem), byLastUse);
+	pthread_mutex_unlock(&cache->lock);
+	for(i=0; i<scan.nItems && scan.total > cache->maxSize; i++) {
+		if(0 == strcmp(scan.items[i].name, keep) || scan.items[i].used >= cache->started)
+			continue;
+		//move it out of the way first, so nobody can pick it up half deleted
+		//checking the pins and renaming go together, so nobody can open it in between
+		snprintf(path, sizeof(path), "%s" PATH_SEP "%s", cache->dir, scan.items[i].name);
+		tempName(cache, doomed, sizeof(doomed));
+		pthread_mutex_lock(&cache->lock);
+		moved = !isPinned(cache, scan.items[i].name) && 0 == rename(path, doomed);
+		pthread_mutex_unlock(&cache->lock);
+		if(moved) {
+			removeTree(doomed);
+			scan.total -= scan.items[i].size;
+		}
+	}
+	free(scan.items);
+}
+
+const char* cacheInit(struct cache *cache, const char *dir, u64 maxSize) {
+	memset(cache, 0, sizeof(struct cache));
+	snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+	cache->maxSize = maxSize;
+	cache->started = time(NULL);
+	if(makeDir(cache->dir)) return "can't create cache dir";
+	if(pthread_mutex_init(&cache->lock, NULL)) return "can't create cache lock";
+	return NULL;
+}
+
+void cacheFree(struct cache *cache) {
+	free(cache->pins);
+	pthread_mutex_destroy(&cache->lock);
+}
+
+const char* cacheOpen(struct cache *cache, const u8 key[SHA256_SIZE], struct cacheEntry *entry) {
+	char stamp[4096];
+	int i;
+
+	memset(entry, 0, sizeof(struct cacheEntry));
+	entry->cache = cache;
+	for(i=0; i<SHA256_SIZE; i++)
+		sprintf(entry->key + i*2, "%02x", key[i]);
+
+	//pinned before looking, so it can't be evicted between finding it and using it
+	pthread_mutex_lock(&cache->lock);
+	entry->pinned = 0 == pin(cache, entry->key);
+	pthread_mutex_unlock(&cache->lock);
+	if(!entry->pinned) {
+		entry->cache = NULL;
+		return "can't allocate memory (cache pin)";
+	}
+
+	//an entry that's there under its key is complete
+	snprintf(entry->dir, sizeof(entry->dir), "%s" PATH_SEP "%s", cache->dir, entry->key);
+	snprintf(stamp, sizeof(stamp), "%s" PATH_SEP CACHE_STAMP, entry->dir);
+	if(0 == touchFile(stamp)) {
+		entry->hit = 1;
+		return NULL;
+	}
+
+	//otherwise unpack somewhere nobody else will look until it's done
+	tempName(cache, entry->dir, sizeof(entry->dir));
+	if(makeDir(entry->dir)) {
+		entry->hit = 1;	//there's no temp dir to throw away
+		cacheClose(entry);	//so the failed open leaves nothing to commit or close
+		entry->hit = 0;
+		return "can't create cache temp dir";
+	}
+	return NULL;
+}
+
+const char* cacheCommit(struct cacheEntry *entry) {
+	char final[4096], stamp[4096];
+
+	if(entry->hit || entry->committed) return NULL;
+	snprintf(stamp, sizeof(stamp), "%s" PATH_SEP CACHE_STAMP, entry->dir);
+	if(touchFile(stamp)) return "can't write cache stamp";
+	snprintf(final, sizeof(final), "%s" PATH_SEP "%s", entry->cache->dir, entry->key);
+	if(0 != rename(entry->dir, final)) {
+		//another worker got the same cia into the cache first -- theirs is just as good
+		removeTree(entry->dir);
+		snprintf(stamp, sizeof(stamp), "%s" PATH_SEP CACHE_STAMP, final);
+		if(touchFile(stamp)) return "can't move unpacked files into cache";
+	}
+	snprintf(entry->dir, sizeof(entry->dir), "%s", final);
+	entry->committed = 1;
+	evict(entry->cache, entry->key);
+	return NULL;
+}
+
+void cacheClose(struct cacheEntry *entry) {
+	if(entry->cache && !entry->hit && !entry->committed)
+		removeTree(entry->dir);
+	if(entry->cache && entry->pinned) {
+		pthread_mutex_lock(&entry->cache->lock);
+		unpin(entry->cache, entry->key);
+		pthread_mutex_unlock(&entry->cache->lock);
+	}
+	entry->cache = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+/* On-disk cache of what the external tools unpack
+ * ctrtool's decrypted contents and 3dstool's split of the cxi only depend on
+ * the input cia, so they're kept in a directory per cia, named after the
+ * SHA-256 of the whole cia. A later run on the same cia goes straight to
+ * patching and rebuilding.
+ * Entries are unpacked into a temp directory inside the cache and renamed
+ * into place once complete, so an entry that exists under its hash is always
+ * whole, and workers (or other agb_edit processes) sharing the cache never
+ * see one half written. When the cache grows past its size limit, the least
+ * recently used entries are evicted, also by renaming them out of the way
+ * before deleting them. Entries a worker has open are pinned and never
+ * evicted, and neither is anything used since this run started, which covers
+ * other processes using the same cache.
+ */
+
+#include <pthread.h>
+#include "gbacia.h"
+#include "sha256.h"
+
+#define CACHE_SIZE_DEFAULT (1024ULL << 20)
+#define CACHE_STALE_SECONDS (24*60*60)	//temp dirs older than this were left by a run that died
+
+//an entry some worker has open
+struct cachePin {
+	char key[2*SHA256_SIZE + 1];
+	int count;
+};
+
+struct cache {
+	char dir[4096];
+	u64 maxSize;
+	s64 started;	//when this run started -- entries used since then may be in use by another process
+	unsigned int nextTemp;	//for naming temp dirs
+	struct cachePin *pins;
+	int nPins, pinCap;
+	pthread_mutex_t lock;	//covers nextTemp and the pins
+};
+
+struct cacheEntry {
+	struct cache *cache;
+	char key[2*SHA256_SIZE + 1];
+	char dir[4096];	//where to read or unpack files: the entry itself on a hit, a temp dir on a miss
+	int hit;
+	int committed;
+	int pinned;
+};
+
+//all return a string on failure, NULL on success
+const char* cacheInit(struct cache *cache, const char *dir, u64 maxSize);
+void cacheFree(struct cache *cache);
+const char* cacheOpen(struct cache *cache, const u8 key[SHA256_SIZE], struct cacheEntry *entry);
+//move a filled in miss into the cache -- entry->dir is the entry itself after this
+const char* cacheCommit(struct cacheEntry *entry);
+void cacheClose(struct cacheEntry *entry);	//throws away a miss that never got committed
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,421 @@
+/* agb_edit library catalog scanning and index file */
+
+#include "catalog.h"
+#include "cia.h"
+#include "ncch.h"
+#include "exefs.h"
+#include "lz.h"
+#include "sha256.h"
+
+#define FOOTER_MAGIC 0x4141432e	//'.CAA'
+
+static u64 alignUp(u64 value, u64 alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//FNV-1a, for finding paths from the old index
+static u64 hashPath(const char *s) {
+	u64 h = 0xcbf29ce484222325ULL;
+	while(*s) {
+		h ^= (u8)*s++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+u64 catalogLutHash(const u8 lut[3*256]) {
+	u8 hash[SHA256_SIZE];
+	sha256(lut, 3*256, hash);
+	return getBE64(hash);
+}
+
+const char* catalogStatusToString(u32 status) {
+	switch(status) {
+		case CATALOG_OK: return "OK";
+		case CATALOG_UNREADABLE: return "unreadable";
+		case CATALOG_ENCRYPTED: return "encrypted";
+		case CATALOG_NO_CONFIG: return "no config";
+		default: return "unknown";
+	}
+}
+
+void catalogGetEntry(const struct catalog *cat, u32 i, struct catalogEntry *entry) {
+	entry->titleId = ((const u64*)cat->cols[CATALOG_TITLE_ID])[i];
+	entry->fileSize = ((const u64*)cat->cols[CATALOG_FILE_SIZE])[i];
+	entry->mtime = ((const s64*)cat->cols[CATALOG_MTIME])[i];
+	entry->lutHash = ((const u64*)cat->cols[CATALOG_LUT_HASH])[i];
+	entry->path = cat->paths + ((const u32*)cat->cols[CATALOG_PATH])[i];
+	entry->romSize = ((const u32*)cat->cols[CATALOG_ROM_SIZE])[i];
+	entry->saveType = ((const u32*)cat->cols[CATALOG_SAVE_TYPE])[i];
+	entry->lcdGhosting = ((const u32*)cat->cols[CATALOG_LCD_GHOSTING])[i];
+	entry->sleepButtons = ((const u16*)cat->cols[CATALOG_SLEEP_BUTTONS])[i];
+	entry->status = ((const u8*)cat->cols[CATALOG_STATUS])[i];
+	entry->flags = ((const u8*)cat->cols[CATALOG_FLAGS])[i];
+}
+
+//append a title to a catalog being built -- path is copied
+static const char* catalogAdd(struct catalog *cat, const struct catalogEntry *entry) {
+	u64 len = strlen(entry->path) + 1;
+	u32 i;
+
+	if(cat->n == cat->cap) {
+		u32 cap = cat->cap ? cat->cap*2 : 1024;
+		for(i=0; i<CATALOG_N_COLUMNS; i++) {
+			void *grown = realloc(cat->cols[i], (size_t)cap * catalogColumnSize[i]);
+			if(!grown) return "can't allocate memory (catalog)";
+			cat->cols[i] = grown;
+		}
+		cat->cap = cap;
+	}
+	if(cat->pathsSize + len > cat->pathsCap) {
+		u64 cap = cat->pathsCap ? cat->pathsCap*2 : 65536;
+		char *grown;
+		while(cap < cat->pathsSize + len) cap *= 2;
+		if(cap > 0xffffffff) return "too many paths for the catalog";
+		grown = realloc(cat->paths, cap);
+		if(!grown) return "can't allocate memory (catalog paths)";
+		cat->paths = grown;
+		cat->pathsCap = cap;
+	}
+
+	i = cat->n++;
+	((u64*)cat->cols[CATALOG_TITLE_ID])[i] = entry->titleId;
+	((u64*)cat->cols[CATALOG_FILE_SIZE])[i] = entry->fileSize;
+	((s64*)cat->cols[CATALOG_MTIME])[i] = entry->mtime;
+	((u64*)cat->cols[CATALOG_LUT_HASH])[i] = entry->lutHash;
+	((u32*)cat->cols[CATALOG_PATH])[i] = cat->pathsSize;
+	((u32*)cat->cols[CATALOG_ROM_SIZE])[i] = entry->romSize;
+	((u32*)cat->cols[CATALOG_SAVE_TYPE])[i] = entry->saveType;
+	((u32*)cat->cols[CATALOG_LCD_GHOSTING])[i] = entry->lcdGhosting;
+	((u16*)cat->cols[CATALOG_SLEEP_BUTTONS])[i] = entry->sleepButtons;
+	((u8*)cat->cols[CATALOG_STATUS])[i] = entry->status;
+	((u8*)cat->cols[CATALOG_FLAGS])[i] = entry->flags;
+	memcpy(cat->paths + cat->pathsSize, entry->path, len);
+	cat->pathsSize += len;
+	return NULL;
+}
+
+const char* catalogLoad(struct catalog *cat, const char *fname) {
+	const struct catalogHeader *hdr;
+	const char *result;
+	u32 i;
+
+	memset(cat, 0, sizeof(struct catalog));
+	result = mapFile(&cat->map, fname);
+	if(result) return result;
+	hdr = (const struct catalogHeader*)cat->map.data;
+
+	//check everything up front, so using it can't go out of bounds
+	if(cat->map.size < sizeof(struct catalogHeader) || hdr->magic != CATALOG_MAGIC) { catalogFree(cat); return "not a catalog index"; }
+	if(hdr->version != CATALOG_VERSION || hdr->nColumns != CATALOG_N_COLUMNS) { catalogFree(cat); return "catalog index is from a different version"; }
+	cat->n = hdr->nEntries;
+	for(i=0; i<CATALOG_N_COLUMNS; i++) {
+		if(hdr->columnOffset[i] % CATALOG_ALIGN || hdr->columnOffset[i] > cat->map.size
+				|| (u64)cat->n * catalogColumnSize[i] > cat->map.size - hdr->columnOffset[i]) {
+			catalogFree(cat);
+			return "catalog index is truncated";
+		}
+		cat->cols[i] = (void*)(cat->map.data + hdr->columnOffset[i]);
+	}
+	if(hdr->pathsOffset > cat->map.size || hdr->pathsSize > cat->map.size - hdr->pathsOffset
+			|| hdr->pathsSize == 0 || cat->map.data[hdr->pathsOffset + hdr->pathsSize - 1] != '\0') {
+		catalogFree(cat);
+		return "catalog index paths are damaged";
+	}
+	cat->paths = (char*)(cat->map.data + hdr->pathsOffset);
+	cat->pathsSize = hdr->pathsSize;
+	for(i=0; i<cat->n; i++) {
+		if(((const u32*)cat->cols[CATALOG_PATH])[i] >= cat->pathsSize) {
+			catalogFree(cat);
+			return "catalog index paths are damaged";
+		}
+	}
+	return NULL;
+}
+
+void catalogFree(struct catalog *cat) {
+	if(cat->map.data) {
+		unmapFile(&cat->map);
+	} else {
+		for(int i=0; i<CATALOG_N_COLUMNS; i++)
+			free(cat->cols[i]);
+		free(cat->paths);
+	}
+	memset(cat, 0, sizeof(struct catalog));
+}
+
+//write the index out beside fname and then move it into place, so a reader never sees half of one
+static const char* catalogWrite(const struct catalog *cat, const char *fname) {
+	static const u8 zeros[CATALOG_ALIGN];
+	struct catalogHeader hdr;
+	char tmpName[4096];
+	u64 pos, size;
+	const char *result = NULL;
+	FILE *fp;
+	int i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CATALOG_MAGIC;
+	hdr.version = CATALOG_VERSION;
+	hdr.nEntries = cat->n;
+	hdr.nColumns = CATALOG_N_COLUMNS;
+	pos = sizeof(hdr);
+	for(i=0; i<CATALOG_N_COLUMNS; i++) {
+		hdr.columnOffset[i] = alignUp(pos, CATALOG_ALIGN);
+		pos = hdr.columnOffset[i] + (u64)cat->n * catalogColumnSize[i];
+	}
+	hdr.pathsOffset = pos;
+	hdr.pathsSize = cat->pathsSize ? cat->pathsSize : 1;	//always at least the NUL so the index is never empty there
+
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", fname);
+	fp = fopen(tmpName, "wb");
+	if(!fp) return "can't create catalog index";
+	pos = 0;
+	if(fwrite(&hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) result = "can't write catalog index";
+	pos += sizeof(hdr);
+	for(i=0; i<CATALOG_N_COLUMNS && !result; i++) {
+		size = (u64)cat->n * catalogColumnSize[i];
+		if(fwrite(zeros, 1, hdr.columnOffset[i] - pos, fp) != hdr.columnOffset[i] - pos
+				|| (size && fwrite(cat->cols[i], 1, size, fp) != size))
+			result = "can't write catalog index";
+		pos = hdr.columnOffset[i] + size;
+	}
+	if(!result) {
+		if(cat->pathsSize ? fwrite(cat->paths, 1, cat->pathsSize, fp) != cat->pathsSize : fputc('\0', fp) == EOF)
+			result = "can't write catalog index";
+	}
+	if(fclose(fp) != 0 && !result) result = "can't write catalog index";
+	if(!result && rename(tmpName, fname) != 0) {
+		remove(fname);	//Windows won't rename over a file
+		if(rename(tmpName, fname) != 0) result = "can't replace catalog index";
+	}
+	if(result) remove(tmpName);
+	return result;
+}
+
+//pick the config out of a code.bin, quietly -- same checks as processCodeBin makes before editing
+static int findConfig(const u8 *code, u32 codeSize, struct config *cfg) {
+	struct footer ftr;
+	struct sectionDescriptor sec;
+	u32 i, nDesc, nCfg = 0;
+
+	if(codeSize < sizeof(struct footer)) return 0;
+	memcpy(&ftr, code + codeSize - sizeof(struct footer), sizeof(struct footer));
+	if(ftr.magic != FOOTER_MAGIC || ftr.active != 1) return 0;
+	nDesc = ftr.nDesc >> 4;
+	if(ftr.offset > codeSize || nDesc > (codeSize - ftr.offset) / sizeof(struct sectionDescriptor)) return 0;
+	for(i=0; i<nDesc; i++) {
+		memcpy(&sec, code + ftr.offset + i*sizeof(struct sectionDescriptor), sizeof(struct sectionDescriptor));
+		if(sec.type == 1) {
+			if(sec.size != sizeof(struct config) || sec.offset == 0 || sec.offset == 0xffffffff
+					|| sec.offset > codeSize - sizeof(struct config))
+				return 0;
+			memcpy(cfg, code + sec.offset, sizeof(struct config));
+			++nCfg;
+		} else if(sec.type != 0 || sec.offset != 0) {
+			return 0;
+		}
+	}
+	return nCfg == 1;
+}
+
+//read one cia's config into entry -- never fails outright, the status says how far it got
+static void readTitle(const char *path, struct catalogEntry *entry) {
+	const struct ciaContent *content;
+	struct cia cia;
+	struct ncchHeader ncch;
+	struct exefs exefs;
+	struct config cfg;
+	const u8 *exefsData, *code;
+	u8 *decompressed = NULL;
+	u32 codeSize;
+	int i;
+
+	entry->status = CATALOG_UNREADABLE;
+	if(ciaOpen(&cia, path))
+		return;
+	entry->titleId = cia.titleId;
+	if(cia.nContents > 1)
+		entry->flags |= CATALOG_FLAG_MANUAL;
+	entry->status = CATALOG_ENCRYPTED;
+	if(ciaIsEncrypted(&cia))
+		goto done;
+	entry->status = CATALOG_NO_CONFIG;
+	content = &cia.contents[cia.mainContent];
+	memset(&ncch, 0, sizeof(ncch));
+	if(ncchParse(content->data, content->size, &ncch)) {
+		if(ncch.magic == NCCH_MAGIC && !(ncch.flags[7] & NCCH_FLAG7_NOCRYPTO))
+			entry->status = CATALOG_ENCRYPTED;
+		goto done;
+	}
+
+	//.code out of the exefs, decompressed if it has to be
+	exefsData = content->data + (u64)ncch.exefsOffset * NCCH_MEDIA_UNIT;
+	if(exefsParse(&exefs, exefsData, (u64)ncch.exefsSize * NCCH_MEDIA_UNIT))
+		goto done;
+	i = exefsFindFile(&exefs.header, ".code");
+	if(i < 0)
+		goto done;
+	code = exefs.files[i];
+	codeSize = exefs.header.files[i].size;
+	if(ncch.exheaderSize > EXHEADER_FLAGS && (content->data[sizeof(struct ncchHeader) + EXHEADER_FLAGS] & EXHEADER_FLAG_COMPRESSED)) {
+		entry->flags |= CATALOG_FLAG_COMPRESSED;
+		if(lzDecompress(code, codeSize, &decompressed, &codeSize))
+			goto done;
+		code = decompressed;
+	}
+
+	if(findConfig(code, codeSize, &cfg)) {
+		entry->status = CATALOG_OK;
+		entry->romSize = cfg.romSize;
+		entry->saveType = cfg.saveType;
+		entry->sleepButtons = cfg.sleepButtons;
+		entry->lcdGhosting = cfg.lcdGhosting;
+		entry->lutHash = catalogLutHash(cfg.videoLUT);
+	}
+
+done:
+	free(decompressed);
+	ciaClose(&cia);
+}
+
+//a scan in progress
+struct scan {
+	struct catalog *old, *cat;
+	u32 *table;	//open addressing over old's paths: index + 1, 0 for empty
+	u32 mask;
+	u8 *seen;	//which of old's entries turned up again
+	FILE *log;
+	struct catalogStats *stats;
+	char path[4096];	//dir being listed, grown and shrunk as we go down and back up
+	const char *result;
+};
+
+static void buildTable(struct scan *s) {
+	struct catalogEntry entry;
+	u32 size = 16, i, h;
+
+	while(size < s->old->n * 2) size *= 2;
+	s->table = calloc(size, sizeof(u32));
+	s->seen = calloc(s->old->n ? s->old->n : 1, 1);
+	if(!s->table || !s->seen) {	//not worth failing over -- everything just gets read again
+		free(s->table);
+		free(s->seen);
+		s->table = NULL;
+		s->seen = NULL;
+		return;
+	}
+	s->mask = size - 1;
+	for(i=0; i<s->old->n; i++) {
+		catalogGetEntry(s->old, i, &entry);
+		for(h = hashPath(entry.path) & s->mask; s->table[h]; h = (h + 1) & s->mask);
+		s->table[h] = i + 1;
+	}
+}
+
+//the old index's entry for path, or -1
+static s64 findOld(const struct scan *s, const char *path) {
+	u32 h;
+	if(!s->table) return -1;
+	for(h = hashPath(path) & s->mask; s->table[h]; h = (h + 1) & s->mask) {
+		u32 i = s->table[h] - 1;
+		if(0 == strcmp(s->old->paths + ((const u32*)s->old->cols[CATALOG_PATH])[i], path))
+			return i;
+	}
+	return -1;
+}
+
+static int hasCiaExtension(const char *name) {
+	size_t len = strlen(name);
+	return len > 4 && 0 == strcasecmp(name + len - 4, ".cia");
+}
+
+static int visit(void *ctx, const struct dirEntry *dirEntry) {
+	struct scan *s = ctx;
+	struct catalogEntry entry;
+	size_t len = strlen(s->path);
+	s64 old;
+
+	if(len + 1 + strlen(dirEntry->name) >= sizeof(s->path)) {
+		fprintf(s->log, "  %s" PATH_SEP "%s: path too long, skipped\n", s->path, dirEntry->name);
+		return 0;
+	}
+	snprintf(s->path + len, sizeof(s->path) - len, PATH_SEP "%s", dirEntry->name);
+	if(dirEntry->isDir) {
+		if(listDir(s->path, visit, s) < 0)
+			fprintf(s->log, "  %s: can't read directory\n", s->path);
+	} else if(hasCiaExtension(dirEntry->name)) {
+		old = findOld(s, s->path);
+		if(old >= 0 && s->seen[old]) {
+			//same file reached twice, e.g. through overlapping dirs
+		} else if(old >= 0 && ((const u64*)s->old->cols[CATALOG_FILE_SIZE])[old] == dirEntry->size
+				&& ((const s64*)s->old->cols[CATALOG_MTIME])[old] == dirEntry->mtime) {
+			catalogGetEntry(s->old, old, &entry);
+			s->result = catalogAdd(s->cat, &entry);
+			s->seen[old] = 1;
+			++s->stats->nUnchanged;
+		} else {
+			memset(&entry, 0, sizeof(entry));
+			entry.path = s->path;
+			entry.fileSize = dirEntry->size;
+			entry.mtime = dirEntry->mtime;
+			readTitle(s->path, &entry);
+			if(entry.status != CATALOG_OK) {
+				fprintf(s->log, "  %s: %s\n", s->path, catalogStatusToString(entry.status));
+				++s->stats->nBad;
+			}
+			s->result = catalogAdd(s->cat, &entry);
+			if(old >= 0)
+				s->seen[old] = 1;
+			++s->stats->nRead;
+		}
+	}
+	s->path[len] = '\0';
+	return s->result != NULL;
+}
+
+const char* catalogScan(const char *fname, char *const *dirs, int nDirs, FILE *log, struct catalogStats *stats) {
+	struct catalog old, cat;
+	struct scan s;
+	const char *result;
+	int i;
+
+	memset(stats, 0, sizeof(struct catalogStats));
+	memset(&cat, 0, sizeof(cat));
+	memset(&s, 0, sizeof(s));
+	result = catalogLoad(&old, fname);
+	if(result) {
+		FILE *fp = fopen(fname, "rb");
+		if(fp) {	//it's there, just no good
+			fclose(fp);
+			fprintf(log, "WARNING: %s: %s, reading everything again\n", fname, result);
+		}
+	}
+	s.old = &old;
+	s.cat = &cat;
+	s.log = log;
+	s.stats = stats;
+	buildTable(&s);
+
+	for(i=0; i<nDirs && !s.result; i++) {
+		snprintf(s.path, sizeof(s.path), "%s", dirs[i]);
+		//trailing separators would end up doubled in the paths, and then they'd never match the last scan
+		for(size_t len = strlen(s.path); len > 1 && (s.path[len-1] == '/' || s.path[len-1] == '\\'); len--)
+			s.path[len-1] = '\0';
+		if(listDir(s.path, visit, &s) < 0 && !s.result)
+			s.result = "can't read directory";
+		if(s.result)
+			fprintf(log, "ERROR: %s: %s\n", dirs[i], s.result);
+	}
+	if(s.seen) {
+		for(u32 j=0; j<old.n; j++)
+			if(!s.seen[j]) ++stats->nDropped;
+	}
+	free(s.table);
+	free(s.seen);
+	catalogFree(&old);	//Windows won't replace it while it's mapped
+
+	result = s.result ? s.result : catalogWrite(&cat, fname);
+	catalogFree(&cat);
+	return result;
+}
@@ -0,0 +1,100 @@
+#ifndef __CATALOG_H__
+#define __CATALOG_H__
+
+/* Library catalog: an index of the config of every cia under some directories
+ * Scanning only reads as much of each cia as it takes to get to the config
+ * (the TMD, the NCCH and exefs headers, and the footer, section descriptors
+ * and config at the end of code.bin), and a rescan only reads cias whose size
+ * or modified time changed since the last one.
+ * The index file is laid out in columns so it can be mapped and filtered
+ * without any parsing: a header, then each column as a plain array with one
+ * element per title (each starting on a 64 byte boundary), then the paths
+ * as NUL terminated strings. Everything is little endian.
+ */
+
+#include "gbacia.h"
+#include "platform.h"
+
+#define CATALOG_MAGIC 0x49424741	//'AGBI'
+#define CATALOG_VERSION 1
+#define CATALOG_ALIGN 64
+
+//the columns, in the order they're stored
+enum catalogColumn {
+	CATALOG_TITLE_ID,	//u64
+	CATALOG_FILE_SIZE,	//u64
+	CATALOG_MTIME,	//s64, seconds since 1970
+	CATALOG_LUT_HASH,	//u64, see catalogLutHash
+	CATALOG_PATH,	//u32 offset into the paths
+	CATALOG_ROM_SIZE,	//u32, the rest are straight from struct config
+	CATALOG_SAVE_TYPE,	//u32
+	CATALOG_LCD_GHOSTING,	//u32
+	CATALOG_SLEEP_BUTTONS,	//u16
+	CATALOG_STATUS,	//u8, enum catalogStatus
+	CATALOG_FLAGS,	//u8, CATALOG_FLAG_*
+	CATALOG_N_COLUMNS
+};
+
+//size of one element of each column
+static const u8 catalogColumnSize[CATALOG_N_COLUMNS] = {8, 8, 8, 8, 4, 4, 4, 4, 2, 1, 1};
+
+//whether the config fields mean anything -- the title ID does as long as the cia could be opened
+enum catalogStatus {
+	CATALOG_OK = 0,
+	CATALOG_UNREADABLE,	//not a cia we can open
+	CATALOG_ENCRYPTED,	//needs ctrtool to get at
+	CATALOG_NO_CONFIG	//not a GBA VC, or its code.bin doesn't have exactly one good config
+};
+
+#define CATALOG_FLAG_COMPRESSED 0x01	//.code is LZ compressed
+#define CATALOG_FLAG_MANUAL 0x02	//the cia has more than one content, e.g. an official VC's manual
+
+//index file header
+struct catalogHeader {	//0x80 bytes
+	u32 magic;	//'AGBI'
+	u32 version;
+	u32 nEntries;
+	u32 nColumns;	//CATALOG_N_COLUMNS
+	u64 columnOffset[CATALOG_N_COLUMNS];	//from the start of the file
+	u64 pathsOffset, pathsSize;
+	u8 reserved[0x80 - 0x10 - 8*CATALOG_N_COLUMNS - 0x10];
+} __attribute__((aligned(1)));
+
+//one title, gathered from the columns
+struct catalogEntry {
+	u64 titleId, fileSize, lutHash;
+	s64 mtime;
+	const char *path;
+	u32 romSize, saveType, lcdGhosting;
+	u16 sleepButtons;
+	u8 status, flags;
+};
+
+//an index in memory -- either mapped from a file, in which case it can't be added to, or being built
+struct catalog {
+	u32 n, cap;
+	void *cols[CATALOG_N_COLUMNS];
+	char *paths;
+	u64 pathsSize, pathsCap;
+	struct fileMap map;	//the file it was loaded from, if it was
+};
+
+//what a scan did
+struct catalogStats {
+	u32 nRead;	//new or changed since the last scan
+	u32 nUnchanged;
+	u32 nDropped;	//in the old index but not found this time
+	u32 nBad;	//read, but not with status CATALOG_OK
+};
+
+//all return a string on failure, NULL on success
+const char* catalogLoad(struct catalog *cat, const char *fname);
+void catalogFree(struct catalog *cat);
+void catalogGetEntry(const struct catalog *cat, u32 i, struct catalogEntry *entry);
+//walk the dirs for cias and write a fresh index to fname, reusing what's still valid from the one there
+//titles that can't be read fully are still indexed, and noted in log
+const char* catalogScan(const char *fname, char *const *dirs, int nDirs, FILE *log, struct catalogStats *stats);
+u64 catalogLutHash(const u8 lut[3*256]);	//fingerprint of a video LUT, to compare LUTs by
+const char* catalogStatusToString(u32 status);
+
+#endif /* __CATALOG_H__ */
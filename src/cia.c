@@ -0,0 +1,253 @@
+/* agb_edit native cia container reader */
+
+#include "cia.h"
+#include "sha256.h"
+
+static u32 alignUp(u32 value, u32 alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static u32 getLE32(const u8 *p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((u32)p[3]<<24);
+}
+
+static void putLE32(u8 *p, u32 v) {
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+static void putBE16(u8 *p, u16 v) {
+	p[0] = v>>8; p[1] = v;
+}
+
+static void putBE64(u8 *p, u64 v) {
+	for(int i=7; i>=0; i--, v>>=8)
+		p[i] = v;
+}
+
+//size of the signature block in front of a TMD or ticket, including the type and padding
+static u32 sigBlockSize(u32 sigType) {
+	switch(sigType) {
+		case 0x10000: case 0x10003:	//RSA-4096 with SHA-1 / SHA-256
+			return 4 + 0x200 + 0x3c;
+		case 0x10001: case 0x10004:	//RSA-2048 with SHA-1 / SHA-256
+			return 4 + 0x100 + 0x3c;
+		case 0x10002: case 0x10005:	//ECDSA with SHA-1 / SHA-256
+			return 4 + 0x3c + 0x40;
+		default:
+			return 0;
+	}
+}
+
+//map and parse a cia -- on failure nothing needs to be cleaned up
+const char* ciaOpen(struct cia *cia, const char *fname) {
+	const u8 *hdr, *tmd, *chunk;
+	const char *result;
+	u32 sigSize, nChunks;
+	u64 offset;
+	int i;
+
+	memset(cia, 0, sizeof(struct cia));
+	result = mapFile(&cia->map, fname);
+	if(result) return result;
+	hdr = cia->map.data;
+
+	//fixed size header, followed by the content index bitmap
+	if(cia->map.size < 0x20 + 0x2000) { ciaClose(cia); return "file too small to be a cia"; }
+	cia->headerSize = getLE32(hdr + 0x00);
+	cia->type = hdr[0x04] | (hdr[0x05]<<8);
+	cia->version = hdr[0x06] | (hdr[0x07]<<8);
+	cia->certSize = getLE32(hdr + 0x08);
+	cia->tikSize = getLE32(hdr + 0x0c);
+	cia->tmdSize = getLE32(hdr + 0x10);
+	cia->metaSize = getLE32(hdr + 0x14);
+	cia->contentSize = getLE32(hdr + 0x18) | ((u64)getLE32(hdr + 0x1c) << 32);
+	if(cia->headerSize != 0x2020) { ciaClose(cia); return "bad cia header size"; }
+
+	//sections follow each other, each aligned to 0x40
+	cia->certOffset = alignUp(cia->headerSize, CIA_ALIGN);
+	cia->tikOffset = alignUp(cia->certOffset + cia->certSize, CIA_ALIGN);
+	cia->tmdOffset = alignUp(cia->tikOffset + cia->tikSize, CIA_ALIGN);
+	cia->contentOffset = alignUp(cia->tmdOffset + cia->tmdSize, CIA_ALIGN);
+	cia->metaOffset = (cia->contentOffset + cia->contentSize + CIA_ALIGN - 1) & ~(u64)(CIA_ALIGN - 1);
+	if((u64)cia->tmdOffset + cia->tmdSize > cia->map.size || cia->contentOffset + cia->contentSize > cia->map.size) {
+		ciaClose(cia);
+		return "cia is truncated";
+	}
+
+	//TMD -- skip its signature to get to the header
+	tmd = hdr + cia->tmdOffset;
+	sigSize = sigBlockSize(getBE32(tmd));
+	if(sigSize == 0) { ciaClose(cia); return "unknown TMD signature type"; }
+	if(sigSize + TMD_CHUNK_RECORDS > cia->tmdSize) { ciaClose(cia); return "TMD is too small"; }
+	cia->tmdHeaderOffset = cia->tmdOffset + sigSize;
+	tmd = hdr + cia->tmdHeaderOffset;
+	cia->titleId = getBE64(tmd + TMD_TITLE_ID);
+	nChunks = getBE16(tmd + TMD_CONTENT_COUNT);
+	if(sigSize + TMD_CHUNK_RECORDS + nChunks*TMD_CHUNK_SIZE > cia->tmdSize) { ciaClose(cia); return "TMD content records are truncated"; }
+
+	cia->contents = calloc(nChunks ? nChunks : 1, sizeof(struct ciaContent));
+	if(!cia->contents) { ciaClose(cia); return "can't allocate memory (contents)"; }
+
+	//walk the content chunk records -- contents present in the index bitmap are stored back to back
+	offset = cia->contentOffset;
+	cia->nContents = 0;
+	cia->mainContent = -1;
+	for(i=0; i<nChunks; i++) {
+		struct ciaContent *c = &cia->contents[cia->nContents];
+		chunk = tmd + TMD_CHUNK_RECORDS + i*TMD_CHUNK_SIZE;
+		c->id = getBE32(chunk + 0x00);
+		c->index = getBE16(chunk + 0x04);
+		c->type = getBE16(chunk + 0x06);
+		c->size = getBE64(chunk + 0x08);
+		memcpy(c->hash, chunk + 0x10, sizeof(c->hash));
+		c->chunkOffset = chunk - hdr;
+		if(!(hdr[0x20 + c->index/8] & (0x80 >> (c->index%8))))
+			continue;	//listed in the TMD but not included in this cia
+		if(offset + c->size > cia->contentOffset + cia->contentSize) { ciaClose(cia); return "content runs past end of cia"; }
+		c->offset = offset;
+		c->data = hdr + offset;
+		offset += c->size;
+		if(c->index == 0)
+			cia->mainContent = cia->nContents;
+		++cia->nContents;
+	}
+	if(cia->mainContent < 0) { ciaClose(cia); return "cia has no main content (index 0)"; }
+
+	return NULL;
+}
+
+void ciaClose(struct cia *cia) {
+	free(cia->contents);
+	cia->contents = NULL;
+	cia->nContents = 0;
+	if(cia->map.data)
+		unmapFile(&cia->map);
+}
+
+//contents are encrypted with the title key -- we can't read those without ctrtool
+int ciaIsEncrypted(const struct cia *cia) {
+	for(int i=0; i<cia->nContents; i++)
+		if(cia->contents[i].type & CIA_CONTENT_ENCRYPTED)
+			return 1;
+	return 0;
+}
+
+//build the name a content gets when dumped -- same scheme as ctrtool: prefix.index.id
+void ciaContentFileName(char *out, size_t outSize, const char *prefix, const struct ciaContent *content) {
+	snprintf(out, outSize, "%s.%04x.%08x", prefix, content->index, content->id);
+}
+
+//write one content out to its own file, named like ctrtool --contents does
+const char* ciaWriteContent(const struct cia *cia, const struct ciaContent *c, const char *prefix) {
+	char fname[4096];
+	const char *result;
+	FILE *fp;
+
+	ciaContentFileName(fname, sizeof(fname), prefix, c);
+	fp = fopen(fname, "wb");
+	if(!fp) return "can't create content file";
+	result = copyRange(&cia->map, c->offset, c->size, fp);
+	if(fclose(fp) != 0 && !result) result = "can't write content file";
+	return result;
+}
+
+//write every content out to its own file, like ctrtool --contents
+const char* ciaWriteContents(const struct cia *cia, const char *prefix) {
+	const char *result;
+	for(int i=0; i<cia->nContents; i++) {
+		result = ciaWriteContent(cia, &cia->contents[i], prefix);
+		if(result) return result;
+	}
+	return NULL;
+}
+
+static const char* writeZeros(u64 size, FILE *out) {
+	static const u8 zeros[CIA_ALIGN];
+	if(size && fwrite(zeros, 1, size, out) != size) return "can't write padding";
+	return NULL;
+}
+
+//build a new cia from this one with some contents swapped out
+//replacements has an entry for each of cia->contents: NULL to pass the content through from the cia as-is,
+//or a decrypted content to use in its place. The cert chain, ticket, meta and TMD layout are kept;
+//only the replaced contents' chunk records and the TMD hashes over them change.
+const char* ciaRebuild(const struct cia *cia, const struct fileMap *const *replacements, const char *outName) {
+	const char *result = NULL;
+	u8 *pre, *chunk, *info;
+	u64 contentSize = 0, pos;
+	int i;
+	FILE *fp;
+
+	if(cia->metaOffset + cia->metaSize > cia->map.size) return "cia meta runs past end of file";
+	pre = malloc(cia->contentOffset);
+	if(!pre) return "can't allocate memory (cia rebuild)";
+
+	//everything up to the contents: header, cert chain, ticket and TMD
+	memcpy(pre, cia->map.data, cia->contentOffset);
+	for(i=0; i<cia->nContents; i++) {
+		const struct ciaContent *c = &cia->contents[i];
+		if(replacements[i]) {
+			chunk = pre + c->chunkOffset;
+			putBE16(chunk + 0x06, c->type & ~CIA_CONTENT_ENCRYPTED);	//we only ever write contents decrypted
+			putBE64(chunk + 0x08, replacements[i]->size);
+			sha256(replacements[i]->data, replacements[i]->size, chunk + 0x10);
+			contentSize += replacements[i]->size;
+		} else {
+			contentSize += c->size;
+		}
+	}
+	putLE32(pre + 0x18, contentSize);
+	putLE32(pre + 0x1c, contentSize >> 32);
+
+	//redo the content info records that cover the chunk records, then the TMD header hash over them
+	info = pre + cia->tmdHeaderOffset + TMD_INFO_RECORDS;
+	chunk = pre + cia->tmdHeaderOffset + TMD_CHUNK_RECORDS;
+	for(i=0; i<TMD_INFO_COUNT; i++) {
+		u32 first = getBE16(info + i*TMD_INFO_SIZE), count = getBE16(info + i*TMD_INFO_SIZE + 2);
+		if(count == 0)
+			continue;
+		if(cia->tmdHeaderOffset + TMD_CHUNK_RECORDS + (first + count)*TMD_CHUNK_SIZE > cia->tmdOffset + cia->tmdSize) {
+			free(pre);
+			return "TMD content info record is out of range";
+		}
+		sha256(chunk + first*TMD_CHUNK_SIZE, count*TMD_CHUNK_SIZE, info + i*TMD_INFO_SIZE + 4);
+	}
+	sha256(info, TMD_INFO_COUNT*TMD_INFO_SIZE, pre + cia->tmdHeaderOffset + TMD_INFO_HASH);
+
+	//write it all out, splicing contents straight from the cia or the replacements
+	fp = fopen(outName, "wb");
+	if(!fp) { free(pre); return "can't create cia"; }
+	if(fwrite(pre, 1, cia->contentOffset, fp) != cia->contentOffset) result = "can't write cia header";
+	free(pre);
+	for(i=0; i<cia->nContents && !result; i++) {
+		if(replacements[i])
+			result = copyRange(replacements[i], 0, replacements[i]->size, fp);
+		else
+			result = copyRange(&cia->map, cia->contents[i].offset, cia->contents[i].size, fp);
+	}
+	if(!result && cia->metaSize) {
+		pos = cia->contentOffset + contentSize;
+		result = writeZeros(((pos + CIA_ALIGN - 1) & ~(u64)(CIA_ALIGN - 1)) - pos, fp);
+		if(!result) result = copyRange(&cia->map, cia->metaOffset, cia->metaSize, fp);
+	}
+	if(fclose(fp) != 0 && !result) result = "can't write cia";
+	if(result) remove(outName);
+	return result;
+}
+
+//print what we found in the cia -- stands in for the info ctrtool used to show
+void ciaPrintInfo(const struct cia *cia, FILE *out) {
+	fprintf(out, "==== CIA INFO ====\n");
+	fprintf(out, "Title ID: %016llx\n", cia->titleId);
+	fprintf(out, "Cert chain: 0x%x bytes @ 0x%x\n", cia->certSize, cia->certOffset);
+	fprintf(out, "Ticket: 0x%x bytes @ 0x%x\n", cia->tikSize, cia->tikOffset);
+	fprintf(out, "TMD: 0x%x bytes @ 0x%x\n", cia->tmdSize, cia->tmdOffset);
+	fprintf(out, "Meta: 0x%x bytes\n", cia->metaSize);
+	for(int i=0; i<cia->nContents; i++) {
+		const struct ciaContent *c = &cia->contents[i];
+		fprintf(out, " Content %d: index %04x id %08x, 0x%llx bytes @ 0x%llx%s%s\n", i, c->index, c->id,
+				c->size, c->offset, (c->type & CIA_CONTENT_ENCRYPTED)?" [encrypted]":"",
+				i==cia->mainContent?" [main]":"");
+	}
+	fputc('\n', out);
+}
@@ -0,0 +1,72 @@
+#ifndef __CIA_H__
+#define __CIA_H__
+
+/* Native cia container reader and writer
+ * Maps the whole cia read-only and parses the header, cert chain, ticket,
+ * TMD and content index out of it. Contents are exposed as views into the
+ * mapping, so nothing gets copied until somebody actually writes it out.
+ * Rebuilding keeps everything but the contents we replace and the TMD
+ * fields that describe them.
+ */
+
+#include "gbacia.h"
+#include "platform.h"
+
+#define CIA_ALIGN 0x40	//every section in a cia starts on a 0x40 byte boundary
+#define CIA_CONTENT_ENCRYPTED 0x0001	//content type flag: content is AES encrypted with the title key
+
+//TMD header layout (offsets relative to the end of the signature)
+#define TMD_TITLE_ID 0x4c
+#define TMD_CONTENT_COUNT 0x9e
+#define TMD_INFO_HASH 0xa4	//SHA-256 of all 64 content info records
+#define TMD_INFO_RECORDS 0xc4	//64 content info records of 0x24 bytes each follow the 0xc4 byte header
+#define TMD_INFO_SIZE 0x24
+#define TMD_INFO_COUNT 64
+#define TMD_CHUNK_RECORDS (TMD_INFO_RECORDS + TMD_INFO_COUNT*TMD_INFO_SIZE)
+#define TMD_CHUNK_SIZE 0x30
+
+//one content as described by its TMD content chunk record
+struct ciaContent {
+	u32 id;
+	u16 index;	//content index -- 0 is the main executable, 1 the manual, etc.
+	u16 type;	//flags, see CIA_CONTENT_*
+	u64 size;
+	u8 hash[32];	//SHA-256 of the content, as recorded in the TMD
+	u64 offset;	//offset of the content within the cia
+	u32 chunkOffset;	//offset of this content's chunk record within the cia
+	const u8 *data;	//view into the mapped cia -- NOT a copy
+};
+
+struct cia {
+	struct fileMap map;
+	u32 headerSize;
+	u16 type, version;
+	u32 certOffset, certSize;
+	u32 tikOffset, tikSize;
+	u32 tmdOffset, tmdSize;
+	u64 contentOffset, contentSize;
+	u64 metaOffset;
+	u32 metaSize;
+	u32 tmdHeaderOffset;	//offset of the TMD header (just past its signature) within the cia
+	u64 titleId;
+	int nContents;
+	struct ciaContent *contents;	//only contents that are actually present in the cia
+	int mainContent;	//index into contents of the content with content index 0
+};
+
+//returns a string on failure, NULL on success
+const char* ciaOpen(struct cia *cia, const char *fname);
+void ciaClose(struct cia *cia);
+int ciaIsEncrypted(const struct cia *cia);
+const char* ciaWriteContent(const struct cia *cia, const struct ciaContent *c, const char *prefix);
+const char* ciaWriteContents(const struct cia *cia, const char *prefix);
+const char* ciaRebuild(const struct cia *cia, const struct fileMap *const *replacements, const char *outName);
+void ciaContentFileName(char *out, size_t outSize, const char *prefix, const struct ciaContent *content);
+void ciaPrintInfo(const struct cia *cia, FILE *out);
+
+//big endian accessors -- TMD and ticket fields are big endian, unlike everything else we touch
+static inline u16 getBE16(const u8 *p) { return (p[0]<<8) | p[1]; }
+static inline u32 getBE32(const u8 *p) { return ((u32)p[0]<<24) | ((u32)p[1]<<16) | ((u32)p[2]<<8) | p[3]; }
+static inline u64 getBE64(const u8 *p) { return ((u64)getBE32(p)<<32) | getBE32(p+4); }
+
+#endif /* __CIA_H__ */
@@ -5,6 +5,8 @@
 #include "console_ui.h"
 #include "gbacia.h"
 #include "videolut.h"
+#include "savetype.h"
+#include "platform.h"
 
 //ask the user something, present options, and return the one they picked
 //question: prompt string to show the user (may contain multiple lines for multiple choice)
@@ -21,7 +23,7 @@ static char prompt(const char *question, const char *keys) {
 	fflush(stdout);
 
 	while(1) {
-		ch = _getch();
+		ch = readKey();
 		if(ch == '\r')
 			ch = '\n';
 		for(i=0, groupkey=0; keys[i]!='\0' || keys[i+1]!='\0'; i++) {
@@ -118,13 +120,13 @@ static void editVideoParams(void) {
 	double numReal;
 
 	printf(" ===== VIDEO PARAMETER EDITOR =====\n");
-	lcdGhosting = 255;
+	edits.lcdGhosting = 255;
 	lutResetParams(1);
 
 	do {
 		if(print) {
-			makeVideoLUT();
-			printVideoLUT(videoLUT, lcdGhosting);
+			makeVideoLUT(edits.videoLUT);
+			printVideoLUT(stdout, edits.videoLUT, edits.lcdGhosting);
 		}
 		print = 1;
 		lutGetWhitePointColor(&red, &green, &blue);
@@ -148,7 +150,7 @@ static void editVideoParams(void) {
 				channelNames[lutGetActiveChannel()],
 				lutGetBrightness(), lutGetContrast(), lutGetGammaIn(), lutGetGammaOut(),
 				lutGetInvert(), lutGetSolarize(), red, green, blue, lutGetColorTemp(),
-				lutGetCeiling(), lutGetFloor(), lcdGhosting);
+				lutGetCeiling(), lutGetFloor(), edits.lcdGhosting);
 		choice = prompt(str, "Aa\0Bb\0Cc\0Dd\0IiLl1\0Oo0\0Vv\0Ss5\0Ww\0Tt\0Xx\0Nn\0Gg\0Rr\0Kk\0Qq\0");
 
 		switch(choice) {
@@ -221,8 +223,8 @@ static void editVideoParams(void) {
 			case 'G':
 				numInt = promptInt("Enter LCD ghosting value (1=max; 255=none; Nintendo uses 80-90 or so)", 1, 255, &isGood);
 				if(isGood) {
-					lcdGhosting = numInt;
-					setLcdGhosting = 1;
+					edits.lcdGhosting = numInt;
+					edits.setLcdGhosting = 1;
 				} else print = 0;
 				break;
 			case 'R':
@@ -231,7 +233,7 @@ static void editVideoParams(void) {
 				break;
 			case 'K':
 				printf("OK - Will use this video LUT and LCD ghosting value\n");
-				setVideoLUT = 1;
+				edits.setVideoLUT = 1;
 				done = 1;
 				break;
 			default:
@@ -243,53 +245,55 @@ static void editVideoParams(void) {
 }
 
 //print video LUT data of 256 3-byte entries
-void printVideoLUT(u8 lut[3*256], int ghosting) {
+//draw a graph to give a quick visualization of the LUT, one NUL terminated row per line, top row first
+void drawVideoLUT(const u8 lut[3*256], char rows[LUT_H][LUT_W+1]) {
 	int x, y, i, color;
-	char graph[LUT_W][LUT_H];
+	char *p;
 
-	//raw hex dump of all the data in order, with spaces between RGB triplets
-	for(i=0; i<3*256; i+=3)
-		printf("%s%02x %02x %02x", i==0?"":"  ", lut[i], lut[i+1], lut[i+2]);
-
-	printf("\nGraphical representation of video LUT:\n");
-	//now generate a graph to give a quick visualization of the LUT
 	//draw border and fill graph with spaces
 	for(y=0; y<LUT_H; y++) {
 		for(x=0; x<LUT_W; x++) {
 			if(y == 0 || y == LUT_H-1) {
 				if(x == 0 || x == LUT_W-1) {
-					graph[x][y] = '+';
+					rows[y][x] = '+';
 				} else {
-					graph[x][y] = '-';
+					rows[y][x] = '-';
 				}
 			} else if(x == 0 || x == LUT_W-1) {
-				graph[x][y] = '|';
+				rows[y][x] = '|';
 			} else {
-				graph[x][y] = ' ';
+				rows[y][x] = ' ';
 			}
 		}
+		rows[y][LUT_W] = '\0';
 	}
-	//now draw the graph in the array
+	//now draw the graph in the array -- values go up from the bottom row
 	for(i=0; i<3*256; i+=3) {
 		x = ((i/3) * (LUT_W-1) + 127) / 255;
-		if(x<0 || x>=LUT_W) printf("WARN: BAD X %d (i=%d)\n", x, i);
 		for(color=0; color<3; color++) {
 			y = (lut[i+color] * (LUT_H-1) + 127) / 255;
-			if(y<0 || y>=LUT_H) printf("WARN: BAD Y %d (i=%d color=%d, value=%d)\n", y, i, color, lut[i+color]);
-			if((isalpha(graph[x][y]) && graph[x][y]!="RGB"[color]) || graph[x][y]=='*')
-				graph[x][y] = '*';
+			p = &rows[LUT_H-1-y][x];
+			if((isalpha(*p) && *p!="RGB"[color]) || *p=='*')
+				*p = '*';
 			else
-				graph[x][y] = "RGB"[color];
+				*p = "RGB"[color];
 		}
 	}
-	//print it
-	for(y=LUT_H-1; y>=0; y--) {
-		for(x=0; x<LUT_W; x++) {
-			putchar(graph[x][y]);
-		}
-		putchar('\n');
-	}
-	printf("LCD Ghosting: %d (0x%02x)\n\n", ghosting, ghosting);
+}
+
+void printVideoLUT(FILE *out, u8 lut[3*256], int ghosting) {
+	char graph[LUT_H][LUT_W+1];
+	int i;
+
+	//raw hex dump of all the data in order, with spaces between RGB triplets
+	for(i=0; i<3*256; i+=3)
+		fprintf(out, "%s%02x %02x %02x", i==0?"":"  ", lut[i], lut[i+1], lut[i+2]);
+
+	fprintf(out, "\nGraphical representation of video LUT:\n");
+	drawVideoLUT(lut, graph);
+	for(i=0; i<LUT_H; i++)
+		fprintf(out, "%s\n", graph[i]);
+	fprintf(out, "LCD Ghosting: %d (0x%02x)\n\n", ghosting, ghosting);
 }
 
 //ask the user questions and set the above globals - returns 0 if the user chooses to quit
@@ -301,7 +305,8 @@ int doQuestionnaire(void) {
 	result = prompt("What do you want to do?\n"
 			"A - Analyze cia(s) [Default; just pressing enter will select this]\n"
 			"P - Preset quick fix cia(s): Remove ghosting & dark filter; gamma correct;\n"
-			"      sleep buttons L+R+Select will be pressed when the lid closes\n"
+			"      sleep buttons L+R+Select will be pressed when the lid closes; fix a\n"
+			"      save type that doesn't match the ROM\n"
 			"E - Edit cia(s)\n"
 			"X - eXtract files from cia(s)\n"
 			"D - Dump GBA ROM(s)\n"
@@ -310,33 +315,35 @@ int doQuestionnaire(void) {
 
 	if(result == 'A') {
 		//analyze / only print info
-		onlyInfo = 1;
+		edits.onlyInfo = 1;
 		return 1;
 
 	} else if(result == 'X') {
 		//extract everything
-		onlyInfo = 1;
-		extractAll = 1;
+		edits.onlyInfo = 1;
+		edits.extractAll = 1;
 		return 1;
 
 	} else if(result == 'D') {
 		//dump the .gba ROM file
-		onlyInfo = 1;
-		dumpRom = 1;
+		edits.onlyInfo = 1;
+		edits.dumpRom = 1;
 		return 1;
 
 	} else if(result == 'P') {
-		//do default edits -- new LUT, gamma 2.2 => 1.54, ghosting=ff, sleep buttons=L R Select
+		//do default edits -- new LUT, gamma 2.2 => 1.54, ghosting=ff, sleep buttons=L R Select, save type fix
 		//sleep buttons
-		setSleepButtons = 1;
-		sleepButtons = BTN_L | BTN_R | BTN_SELECT;
+		edits.setSleepButtons = 1;
+		edits.sleepButtons = BTN_L | BTN_R | BTN_SELECT;
 		//no ghosting
-		setLcdGhosting = 1;
-		lcdGhosting = 0xff;
+		edits.setLcdGhosting = 1;
+		edits.lcdGhosting = 0xff;
 		//set up video LUT
-		setVideoLUT = 1;
+		edits.setVideoLUT = 1;
 		lutResetParams(1);	//sets up parameters for default gamma-corrected, full-brightness LUT
-		makeVideoLUT();	//builds a LUT from the parameters
+		makeVideoLUT(edits.videoLUT);	//builds a LUT from the parameters
+		//save type, if the ROM's save library says it's wrong
+		edits.fixSaveType = 1;
 		return 1;
 
 	} else if(result == 'E') {
@@ -355,7 +362,7 @@ int doQuestionnaire(void) {
 				"game when you shut the lid.\n\n");
 		result = prompt("Set a lid-close button combo?", "Yy\0Nn\n\0Qq\0");
 		if(result == 'Y') {
-			setSleepButtons = 1;
+			edits.setSleepButtons = 1;
 			do {
 				printf("\nEnter the sleep button combo you want, separated with spaces or +.\n"
 						"Valid buttons are Up Down Left Right A B Start Select L R.\n? ");
@@ -364,8 +371,8 @@ int doQuestionnaire(void) {
 					return 0;
 				if(tolower(input[0]) == 'q' && (input[1]=='\0' || isspace(input[1])))
 					return 0;
-				sleepButtons = encodeButtons(input);
-			} while(sleepButtons == 0xffff);
+				edits.sleepButtons = encodeButtons(input);
+			} while(edits.sleepButtons == 0xffff);
 		} else if(result == 'Q' || result == -1) {
 			return 0;
 		}
@@ -378,17 +385,53 @@ int doQuestionnaire(void) {
 			return 0;
 		}
 
+		result = prompt("\nFix the save type if it doesn't match the save library in the ROM? A wrong\n"
+				"save type is the usual reason a game can't save.", "Yy\0Nn\n\0Qq\0");
+		if(result == 'Y') {
+			edits.fixSaveType = 1;
+		} else if(result == 'Q' || result == -1) {
+			return 0;
+		}
+
+		result = prompt("\nSet how long the save chip takes to erase and write? Shorter means games stall\n"
+				"for less time when they save. This is set to suit each cia's save chip.\n"
+				"S - Stock, about what a real cart takes\n"
+				"F - Fast, a quarter of stock\n"
+				"X - Fastest that's still safe\n"
+				"N - No, leave it as it is [Default]\n"
+				"Q - Cancel and quit the program", "Ss\0Ff\0Xx\0Nn\n\0Qq\0");
+		if(result == 'S' || result == 'F' || result == 'X') {
+			edits.saveTiming = result == 'S' ? SAVE_TIMING_STOCK : result == 'F' ? SAVE_TIMING_FAST : SAVE_TIMING_FASTEST;
+		} else if(result == 'Q' || result == -1) {
+			return 0;
+		}
+
+		result = prompt("\nTrim the padding off the end of the ROM? Most ROMs are padded out to a power of\n"
+				"two size, and cutting that off makes a smaller cia. ROMs that look like they\n"
+				"read past their data are left alone.", "Yy\0Nn\n\0Qq\0");
+		if(result == 'Y') {
+			edits.trimRom = 1;
+		} else if(result == 'Q' || result == -1) {
+			return 0;
+		}
+
 		printf("\nSummary:\n");
-		if(setSleepButtons)
-			printf(" - Sleep buttons will be set to %s\n", decodeButtons(sleepButtons));
-		if(setLcdGhosting)
-			printf(" - LCD ghosting will be set to %d (0x%x)\n", lcdGhosting, lcdGhosting);
-		if(setVideoLUT)
+		if(edits.setSleepButtons)
+			printf(" - Sleep buttons will be set to %s\n", decodeButtons(edits.sleepButtons));
+		if(edits.setLcdGhosting)
+			printf(" - LCD ghosting will be set to %d (0x%x)\n", edits.lcdGhosting, edits.lcdGhosting);
+		if(edits.setVideoLUT)
 			printf(" - Video LUT will be set to what you made above\n");
+		if(edits.fixSaveType)
+			printf(" - Save type will be fixed where the ROM says it's wrong\n");
+		if(edits.saveTiming)
+			printf(" - Save chip timing will be set to the %s profile for each cia's chip\n", saveTimingToString(edits.saveTiming));
+		if(edits.trimRom)
+			printf(" - ROM padding will be trimmed where it's safe\n");
 		
-		if(!setSleepButtons && !setLcdGhosting && !setVideoLUT) {
+		if(!edits.setSleepButtons && !edits.setLcdGhosting && !edits.setVideoLUT && !edits.fixSaveType && !edits.saveTiming && !edits.trimRom) {
 			printf(" - No changes made, nothing to do\n\n");
-			onlyInfo = 1;
+			edits.onlyInfo = 1;
 			return 0;	//change to 1 and it will analyze if you don't make any changes
 		} else {
 			result = prompt("\nCHANGES WILL BE MADE! DO YOU WANT TO PROCEED?", "Yy\0Nn\nQq\0");
@@ -5,7 +5,6 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <strings.h>
-#include <conio.h>	//XXX: Windows only. We use _getch; Linux uses getch from curses.
 #include "gbacia.h"
 
 //this just defines the size of the LUT graphs we print on the terminal
@@ -13,7 +12,8 @@
 #define LUT_H 25
 
 //function declarations
-void printVideoLUT(u8 lut[3*256], int ghosting);
+void drawVideoLUT(const u8 lut[3*256], char rows[LUT_H][LUT_W+1]);
+void printVideoLUT(FILE *out, u8 lut[3*256], int ghosting);
 int doQuestionnaire(void);
 
 #endif /* __CONSOLE_UI_H__ */
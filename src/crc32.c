@@ -0,0 +1,151 @@
+/* agb_edit CRC-32 implementation */
+
+#include <pthread.h>
+#include "crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+
+#define CRC32_POLY 0xedb88320
+
+static u32 table[8][256];	//slice-by-8: table[n][b] is the CRC of byte b followed by n zero bytes
+static pthread_once_t setUp = PTHREAD_ONCE_INIT;	//makes the table and checks the CPU once, whichever thread gets there first
+
+static void makeTable(void) {
+	u32 c;
+	int i, j;
+	for(i=0; i<256; i++) {
+		c = i;
+		for(j=0; j<8; j++)
+			c = (c >> 1) ^ (CRC32_POLY & -(c & 1));
+		table[0][i] = c;
+	}
+	for(i=0; i<256; i++)
+		for(j=1; j<8; j++)
+			table[j][i] = (table[j-1][i] >> 8) ^ table[0][table[j-1][i] & 0xff];
+}
+
+//crc here is the raw register, already inverted
+static u32 crc32Table(u32 crc, const u8 *p, size_t len) {
+	u32 lo, hi;
+	while(len >= 8) {
+		lo = crc ^ (p[0] | (p[1]<<8) | (p[2]<<16) | ((u32)p[3]<<24));
+		hi = p[4] | (p[5]<<8) | (p[6]<<16) | ((u32)p[7]<<24);
+		crc = table[7][lo & 0xff] ^ table[6][(lo>>8) & 0xff] ^ table[5][(lo>>16) & 0xff] ^ table[4][lo>>24]
+			^ table[3][hi & 0xff] ^ table[2][(hi>>8) & 0xff] ^ table[1][(hi>>16) & 0xff] ^ table[0][hi>>24];
+		p += 8;
+		len -= 8;
+	}
+	while(len--)
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+	return crc;
+}
+
+#ifdef CRC32_PCLMUL
+//fold 64 bytes at a time with carry-less multiplies, then Barrett reduce -- from Intel's
+//"Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", bit-reflected constants
+//len must be at least 64 and a multiple of 16; crc is the raw register, already inverted
+__attribute__((target("pclmul,sse4.1")))
+static u32 crc32Pclmul(u32 crc, const u8 *p, size_t len) {
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);	//mu, P(x)
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(p + 0x00)), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+	p += 64;
+	len -= 64;
+
+	//four lanes of 16 bytes, folded forward 64 bytes at a time
+	while(len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+		p += 64;
+		len -= 64;
+	}
+
+	//fold the four lanes into one
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	//then whatever 16 byte blocks are left
+	while(len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)p)), x5);
+		p += 16;
+		len -= 16;
+	}
+
+	//128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	//Barrett reduction down to 32
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_extract_epi32(x1, 1);
+}
+
+static int havePclmul;
+
+static void checkCpu(void) {
+	__builtin_cpu_init();
+	havePclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+static void crc32SetUp(void) {
+	makeTable();
+#ifdef CRC32_PCLMUL
+	checkCpu();
+#endif
+}
+
+u32 crc32Update(u32 crc, const void *data, size_t len) {
+	const u8 *p = data;
+	size_t n;
+
+	pthread_once(&setUp, crc32SetUp);
+	crc = ~crc;
+#ifdef CRC32_PCLMUL
+	if(len >= 64 && havePclmul) {
+		n = len & ~(size_t)15;
+		crc = crc32Pclmul(crc, p, n);
+		p += n;
+		len -= n;
+	}
+#endif
+	return ~crc32Table(crc, p, len);
+}
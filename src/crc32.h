@@ -0,0 +1,14 @@
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+/* CRC-32 (the zlib/PNG/DAT one, polynomial 0xedb88320 reflected)
+ * Uses carry-less multiply folding on x86 CPUs that have PCLMULQDQ, and a
+ * slice-by-8 table everywhere else.
+ */
+
+#include "gbacia.h"
+
+//crc is the result so far, 0 to start
+u32 crc32Update(u32 crc, const void *data, size_t len);
+
+#endif /* __CRC32_H__ */
@@ -0,0 +1,214 @@
+/* agb_edit DAT file index */
+
+#include "dat.h"
+#include "platform.h"
+
+//parse exactly nBytes bytes of hex
+static int parseHex(const char *s, size_t len, u8 *out, int nBytes) {
+	int i, hi, lo;
+	if(len != nBytes*2) return 0;
+	for(i=0; i<nBytes; i++) {
+		if(!isxdigit((unsigned char)s[i*2]) || !isxdigit((unsigned char)s[i*2+1])) return 0;
+		hi = isdigit((unsigned char)s[i*2]) ? s[i*2] - '0' : tolower((unsigned char)s[i*2]) - 'a' + 10;
+		lo = isdigit((unsigned char)s[i*2+1]) ? s[i*2+1] - '0' : tolower((unsigned char)s[i*2+1]) - 'a' + 10;
+		out[i] = (hi << 4) | lo;
+	}
+	return 1;
+}
+
+//find an attribute in a tag -- p is just past the tag name, end is the closing '>'
+static int getAttr(const char *p, const char *end, const char *name, const char **val, size_t *len) {
+	const char *attr, *q;
+	size_t attrLen;
+	char quote;
+
+	while(p < end) {
+		while(p < end && isspace((unsigned char)*p)) p++;
+		attr = p;
+		while(p < end && *p != '=' && !isspace((unsigned char)*p)) p++;
+		attrLen = p - attr;
+		while(p < end && isspace((unsigned char)*p)) p++;
+		if(p >= end || *p != '=') return 0;
+		p++;
+		while(p < end && isspace((unsigned char)*p)) p++;
+		if(p >= end || (*p != '"' && *p != '\'')) return 0;
+		quote = *p++;
+		q = memchr(p, quote, end - p);
+		if(!q) return 0;
+		if(attrLen == strlen(name) && 0 == memcmp(attr, name, attrLen)) {
+			*val = p;
+			*len = q - p;
+			return 1;
+		}
+		p = q + 1;
+	}
+	return 0;
+}
+
+//append a name to the pool, decoding XML entities -- returns its offset, or -1 if out of memory
+static s64 addName(struct datIndex *dat, u32 *cap, const char *s, size_t len) {
+	static const char *entities[5][2] = {{"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}};
+	u32 start = dat->namesSize, n;
+	char *p;
+	size_t i;
+	int e;
+
+	if(dat->namesSize + len + 1 > *cap) {
+		n = (*cap ? *cap : 4096);
+		while(n < dat->namesSize + len + 1) n *= 2;
+		p = realloc(dat->names, n);
+		if(!p) return -1;
+		dat->names = p;
+		*cap = n;
+	}
+	for(i=0; i<len; i++) {
+		if(s[i] == '&') {
+			for(e=0; e<5; e++) {
+				n = strlen(entities[e][0]);
+				if(i + n <= len && 0 == memcmp(s + i, entities[e][0], n)) {
+					dat->names[dat->namesSize++] = entities[e][1][0];
+					i += n - 1;
+					break;
+				}
+			}
+			if(e < 5) continue;
+		}
+		dat->names[dat->namesSize++] = s[i];
+	}
+	dat->names[dat->namesSize++] = '\0';
+	return start;
+}
+
+static int isTag(const char *p, const char *end, const char *name) {
+	size_t n = strlen(name);
+	return end - p > n && 0 == memcmp(p, name, n) && (isspace((unsigned char)p[n]) || p[n] == '>' || p[n] == '/');
+}
+
+const char* datLoad(struct datIndex *dat, const char *fname) {
+	struct fileMap map;
+	const char *p, *end, *tagEnd, *attrs, *val, *result = NULL;
+	struct datEntry entry, *grown;
+	u32 entriesCap = 0, namesCap = 0, slot, i;
+	s64 game = -1, name;
+	size_t len;
+	char num[32];
+	u8 crc[4];
+
+	memset(dat, 0, sizeof(struct datIndex));
+	result = mapFile(&map, fname);
+	if(result) return result;
+	p = (const char*)map.data;
+	end = p + map.size;
+
+	while(!result && (p = memchr(p, '<', end - p)) != NULL) {
+		p++;
+		if(end - p >= 3 && 0 == memcmp(p, "!--", 3)) {	//skip comments whole, they can hold anything
+			for(p += 3; p + 3 <= end && 0 != memcmp(p, "-->", 3); p++);
+			continue;
+		}
+		tagEnd = memchr(p, '>', end - p);
+		if(!tagEnd) break;
+		for(attrs = p; attrs < tagEnd && !isspace((unsigned char)*attrs); attrs++);
+
+		if(isTag(p, end, "game") || isTag(p, end, "machine")) {
+			game = -1;
+			if(getAttr(attrs, tagEnd, "name", &val, &len)) {
+				game = addName(dat, &namesCap, val, len);
+				if(game < 0) result = "can't allocate memory (DAT names)";
+			}
+		} else if(isTag(p, end, "rom")) {
+			memset(&entry, 0, sizeof(entry));
+			//CRC-32 is the key, so an entry without one is no use to us
+			if(getAttr(attrs, tagEnd, "crc", &val, &len) && parseHex(val, len, crc, 4)) {
+				entry.crc32 = ((u32)crc[0] << 24) | (crc[1] << 16) | (crc[2] << 8) | crc[3];
+				if(getAttr(attrs, tagEnd, "size", &val, &len) && len < sizeof(num)) {
+					memcpy(num, val, len);
+					num[len] = '\0';
+					entry.size = strtoull(num, NULL, 10);
+					entry.has |= DAT_HAS_SIZE;
+				}
+				if(getAttr(attrs, tagEnd, "md5", &val, &len) && parseHex(val, len, entry.md5, MD5_SIZE))
+					entry.has |= DAT_HAS_MD5;
+				if(getAttr(attrs, tagEnd, "sha1", &val, &len) && parseHex(val, len, entry.sha1, SHA1_SIZE))
+					entry.has |= DAT_HAS_SHA1;
+				if(getAttr(attrs, tagEnd, "sha256", &val, &len) && parseHex(val, len, entry.sha256, SHA256_SIZE))
+					entry.has |= DAT_HAS_SHA256;
+				//a rom outside any game goes by its own name
+				name = game;
+				if(name < 0 && getAttr(attrs, tagEnd, "name", &val, &len))
+					name = addName(dat, &namesCap, val, len);
+				if(name < 0)
+					name = addName(dat, &namesCap, "(no name)", 9);
+				if(name < 0) { result = "can't allocate memory (DAT names)"; break; }
+				entry.game = name;
+
+				if(dat->nEntries == entriesCap) {
+					entriesCap = entriesCap ? entriesCap*2 : 1024;
+					grown = realloc(dat->entries, entriesCap * sizeof(struct datEntry));
+					if(!grown) { result = "can't allocate memory (DAT entries)"; break; }
+					dat->entries = grown;
+				}
+				dat->entries[dat->nEntries++] = entry;
+			}
+		}
+		p = tagEnd + 1;
+	}
+	unmapFile(&map);
+	if(!result && dat->nEntries == 0) result = "no ROMs with a CRC-32 in DAT";
+
+	//hash table at most half full, so probes stay short
+	if(!result) {
+		for(dat->mask = 15; dat->mask < dat->nEntries*2; dat->mask = dat->mask*2 + 1);
+		dat->slots = calloc(dat->mask + 1, sizeof(u32));
+		if(!dat->slots) result = "can't allocate memory (DAT index)";
+	}
+	if(result) {
+		datFree(dat);
+		return result;
+	}
+	for(i=0; i<dat->nEntries; i++) {
+		for(slot = dat->entries[i].crc32 & dat->mask; dat->slots[slot]; slot = (slot + 1) & dat->mask);
+		dat->slots[slot] = i + 1;
+	}
+	return NULL;
+}
+
+void datFree(struct datIndex *dat) {
+	free(dat->entries);
+	free(dat->names);
+	free(dat->slots);
+	memset(dat, 0, sizeof(struct datIndex));
+}
+
+int datCheck(const struct datIndex *dat, const struct romHashes *hashes, u64 size, char *out, size_t outSize) {
+	const struct datEntry *e, *near = NULL;
+	const char *differs = NULL, *bad;
+	u32 slot;
+
+	for(slot = hashes->crc32 & dat->mask; dat->slots[slot]; slot = (slot + 1) & dat->mask) {
+		e = &dat->entries[dat->slots[slot] - 1];
+		if(e->crc32 != hashes->crc32)
+			continue;
+		if((e->has & DAT_HAS_SIZE) && e->size != size)
+			bad = "size";
+		else if((e->has & DAT_HAS_MD5) && 0 != memcmp(e->md5, hashes->md5, MD5_SIZE))
+			bad = "MD5";
+		else if((e->has & DAT_HAS_SHA1) && 0 != memcmp(e->sha1, hashes->sha1, SHA1_SIZE))
+			bad = "SHA-1";
+		else if((e->has & DAT_HAS_SHA256) && 0 != memcmp(e->sha256, hashes->sha256, SHA256_SIZE))
+			bad = "SHA-256";
+		else {
+			snprintf(out, outSize, "DAT match: %s", dat->names + e->game);
+			return 1;
+		}
+		if(!near) {
+			near = e;
+			differs = bad;
+		}
+	}
+	if(near)
+		snprintf(out, outSize, "DAT MISMATCH: CRC32 matches %s but %s doesn't", dat->names + near->game, differs);
+	else
+		snprintf(out, outSize, "DAT MISMATCH: not in DAT");
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef __DAT_H__
+#define __DAT_H__
+
+/* No-Intro style DAT files (Logiqx XML) for checking dumped ROMs
+ * The DAT is loaded once per batch into a table keyed on CRC-32, so checking
+ * a ROM is a single lookup no matter how big the DAT is. A ROM matches when
+ * its size, CRC-32 and every other hash the DAT lists for that entry agree.
+ */
+
+#include "gbacia.h"
+#include "romhash.h"
+
+#define DAT_HAS_MD5 0x01
+#define DAT_HAS_SHA1 0x02
+#define DAT_HAS_SHA256 0x04
+#define DAT_HAS_SIZE 0x08
+
+struct datEntry {
+	u32 game;	//offset of the game's name in names
+	u64 size;
+	u32 crc32;
+	u8 md5[MD5_SIZE];
+	u8 sha1[SHA1_SIZE];
+	u8 sha256[SHA256_SIZE];
+	u8 has;	//DAT_HAS_* for what the DAT gave besides CRC-32
+};
+
+struct datIndex {
+	struct datEntry *entries;
+	u32 nEntries;
+	char *names;	//every game name, NUL terminated, back to back
+	u32 namesSize;
+	u32 *slots;	//open addressing on crc32 -- entry index + 1, 0 for an empty slot
+	u32 mask;
+};
+
+//returns a string on failure, NULL on success; nothing needs freeing on failure
+const char* datLoad(struct datIndex *dat, const char *fname);
+void datFree(struct datIndex *dat);
+//writes a one line verdict to out -- returns 1 if the ROM matches an entry, 0 if not
+int datCheck(const struct datIndex *dat, const struct romHashes *hashes, u64 size, char *out, size_t outSize);
+
+#endif /* __DAT_H__ */
@@ -0,0 +1,104 @@
+/* agb_edit in-memory exefs unpacking and rebuilding */
+
+#include "exefs.h"
+#include "sha256.h"
+#include "platform.h"
+
+#define EXEFS_ALIGN 0x200	//each file's data starts on a 0x200 byte boundary
+
+const char* exefsParse(struct exefs *exefs, const u8 *data, u64 size) {
+	int i;
+
+	memset(exefs, 0, sizeof(struct exefs));
+	if(size < EXEFS_HEADER_SIZE) return "exefs too small for header";
+	memcpy(&exefs->header, data, sizeof(struct exefsHeader));
+	for(i=0; i<EXEFS_MAX_FILES; i++) {
+		const struct exefsFile *f = &exefs->header.files[i];
+		if(f->size == 0)
+			continue;
+		if((u64)EXEFS_HEADER_SIZE + f->offset + f->size > size) return "exefs file runs past end of exefs";
+		exefs->files[i] = data + EXEFS_HEADER_SIZE + f->offset;
+	}
+	return NULL;
+}
+
+void exefsFree(struct exefs *exefs) {
+	for(int i=0; i<EXEFS_MAX_FILES; i++) {
+		free(exefs->owned[i]);
+		exefs->owned[i] = NULL;
+	}
+}
+
+void exefsReplaceFile(struct exefs *exefs, int i, u8 *data, u32 size) {
+	if(exefs->owned[i] != data)
+		free(exefs->owned[i]);
+	exefs->owned[i] = data;
+	exefs->files[i] = data;
+	exefs->header.files[i].size = size;
+}
+
+u32 exefsBuildSize(const struct exefs *exefs) {
+	u32 size = EXEFS_HEADER_SIZE;
+	for(int i=0; i<EXEFS_MAX_FILES; i++)
+		size += (exefs->header.files[i].size + EXEFS_ALIGN - 1) & ~(EXEFS_ALIGN - 1);
+	return size;
+}
+
+//lay the files out back to back and redo the offsets and hashes in the header
+void exefsBuild(struct exefs *exefs, u8 *out) {
+	struct exefsHeader *hdr = &exefs->header;
+	u32 offset = 0, size, padded;
+
+	for(int i=0; i<EXEFS_MAX_FILES; i++) {
+		size = hdr->files[i].size;
+		if(size == 0) {
+			hdr->files[i].offset = 0;
+			memset(hdr->hashes[EXEFS_MAX_FILES-1-i], 0, sizeof(hdr->hashes[0]));
+			continue;
+		}
+		padded = (size + EXEFS_ALIGN - 1) & ~(EXEFS_ALIGN - 1);
+		hdr->files[i].offset = offset;
+		memmove(out + EXEFS_HEADER_SIZE + offset, exefs->files[i], size);
+		memset(out + EXEFS_HEADER_SIZE + offset + size, 0, padded - size);
+		sha256(exefs->files[i], size, hdr->hashes[EXEFS_MAX_FILES-1-i]);
+		offset += padded;
+	}
+	memcpy(out, hdr, sizeof(struct exefsHeader));
+}
+
+//write each file out loose into dir, with the same names 3dstool uses, and the header to headerName
+const char* exefsWriteFiles(const struct exefs *exefs, const char *dir, const char *headerName) {
+	char fname[4096], name[9];
+	size_t nwritten;
+	FILE *fp;
+
+	if(makeDir(dir)) return "can't create exefs dir";
+	snprintf(fname, sizeof(fname), "%s", headerName);
+	for(int i=-1; i<EXEFS_MAX_FILES; i++) {
+		if(i >= 0) {
+			const struct exefsFile *f = &exefs->header.files[i];
+			if(f->size == 0)
+				continue;
+			memcpy(name, f->name, 8);
+			name[8] = '\0';
+			if(0 == strcmp(name, ".code"))
+				snprintf(fname, sizeof(fname), "%s" PATH_SEP "code.bin", dir);
+			else if(0 == strcmp(name, "banner"))
+				snprintf(fname, sizeof(fname), "%s" PATH_SEP "banner.bnr", dir);
+			else if(0 == strcmp(name, "icon"))
+				snprintf(fname, sizeof(fname), "%s" PATH_SEP "icon.icn", dir);
+			else if(0 == strcmp(name, "logo"))
+				snprintf(fname, sizeof(fname), "%s" PATH_SEP "logo.darc.lz", dir);
+			else
+				snprintf(fname, sizeof(fname), "%s" PATH_SEP "%s.bin", dir, name);
+		}
+		fp = fopen(fname, "wb");
+		if(!fp) return "can't create exefs file";
+		if(i < 0)
+			nwritten = fwrite(&exefs->header, 1, sizeof(struct exefsHeader), fp) == sizeof(struct exefsHeader);
+		else
+			nwritten = fwrite(exefs->files[i], 1, exefs->header.files[i].size, fp) == exefs->header.files[i].size;
+		if(fclose(fp) != 0 || !nwritten) return "can't write exefs file";
+	}
+	return NULL;
+}
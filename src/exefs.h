@@ -0,0 +1,55 @@
+#ifndef __EXEFS_H__
+#define __EXEFS_H__
+
+/* ExeFS handling
+ * Parses an exefs into its header and per-file views, lets files be swapped
+ * out, and builds a new exefs with fresh offsets and hashes, all in memory.
+ */
+
+#include <stddef.h>
+#include "gbacia.h"
+
+#define EXEFS_MAX_FILES 10
+#define EXEFS_HEADER_SIZE 0x200	//file data starts right after the header
+
+//one entry in the exefs file table -- offsets are relative to the end of the header
+struct exefsFile {	//0x10 bytes
+	char name[8];	//not necessarily NUL terminated
+	u32 offset;
+	u32 size;
+} __attribute__((aligned(1)));
+
+//exefs header
+struct exefsHeader {	//0x200 bytes
+	struct exefsFile files[EXEFS_MAX_FILES];
+	u8 reserved[0x20];
+	u8 hashes[EXEFS_MAX_FILES][0x20];	//SHA-256 of each file, stored in REVERSE order: file 0's hash is the last one
+} __attribute__((aligned(1)));
+
+//find a file by name in the exefs header, returns its index or -1
+static inline int exefsFindFile(const struct exefsHeader *hdr, const char *name) {
+	for(int i=0; i<EXEFS_MAX_FILES; i++)
+		if(hdr->files[i].size && 0 == strncmp(hdr->files[i].name, name, sizeof(hdr->files[i].name)))
+			return i;
+	return -1;
+}
+
+//offset of file i's hash within the exefs header
+#define EXEFS_HASH_OFFSET(i) (offsetof(struct exefsHeader, hashes) + (EXEFS_MAX_FILES-1-(i)) * 0x20)
+
+//an exefs in memory
+struct exefs {
+	struct exefsHeader header;
+	const u8 *files[EXEFS_MAX_FILES];	//file data -- views into the source exefs, or buffers in owned
+	u8 *owned[EXEFS_MAX_FILES];	//buffers we allocated and free in exefsFree
+};
+
+//returns a string on failure, NULL on success
+const char* exefsParse(struct exefs *exefs, const u8 *data, u64 size);
+void exefsFree(struct exefs *exefs);
+void exefsReplaceFile(struct exefs *exefs, int i, u8 *data, u32 size);	//takes ownership of data (malloc'd)
+u32 exefsBuildSize(const struct exefs *exefs);
+void exefsBuild(struct exefs *exefs, u8 *out);	//out must hold exefsBuildSize bytes
+const char* exefsWriteFiles(const struct exefs *exefs, const char *dir, const char *headerName);
+
+#endif /* __EXEFS_H__ */
@@ -0,0 +1,150 @@
+/* agb_edit fast in-place config patching for decrypted cias */
+
+#include "fastpatch.h"
+#include "ncch.h"
+#include "exefs.h"
+#include "sha256.h"
+#include "platform.h"
+
+#define MAX_PATCHES (8 + TMD_INFO_COUNT)
+
+//a run of bytes that differs from the source cia
+struct patch {
+	u64 offset;	//from the start of the cia
+	u32 size;
+	const void *data;
+};
+
+//SHA-256 of a region of the source cia as it will look once the patches are applied
+static void hashPatched(const u8 *base, u64 offset, u64 size, const struct patch *patches, int nPatches, u8 out[SHA256_SIZE]) {
+	const struct patch *order[MAX_PATCHES], *tmp;
+	struct sha256 ctx;
+	u64 pos = offset, end = offset + size, from, to;
+	int i, j, n = 0;
+
+	//pick out the patches that touch this region, sorted by offset
+	for(i=0; i<nPatches; i++) {
+		if(patches[i].offset < end && patches[i].offset + patches[i].size > offset) {
+			order[n++] = &patches[i];
+			for(j=n-1; j>0 && order[j]->offset < order[j-1]->offset; j--) {
+				tmp = order[j];
+				order[j] = order[j-1];
+				order[j-1] = tmp;
+			}
+		}
+	}
+
+	sha256Init(&ctx);
+	for(i=0; i<n; i++) {
+		from = order[i]->offset > pos ? order[i]->offset : pos;
+		to = order[i]->offset + order[i]->size < end ? order[i]->offset + order[i]->size : end;
+		if(from > pos)
+			sha256Update(&ctx, base + pos, from - pos);
+		sha256Update(&ctx, (const u8*)order[i]->data + (from - order[i]->offset), to - from);
+		pos = to;
+	}
+	if(end > pos)
+		sha256Update(&ctx, base + pos, end - pos);
+	sha256Final(&ctx, out);
+}
+
+//find code.bin in the main content -- fails if anything is encrypted or compressed
+const char* ciaFindCode(const struct cia *cia, struct ciaCode *loc) {
+	const struct ciaContent *content = &cia->contents[cia->mainContent];
+	struct ncchHeader ncch;
+	struct exefsHeader exefs;
+	struct footer ftr;
+	u64 exefsSize;
+
+	if(content->type & CIA_CONTENT_ENCRYPTED) return "content is encrypted";
+	if(content->size < sizeof(struct ncchHeader)) return "content too small for an NCCH header";
+	memcpy(&ncch, content->data, sizeof(struct ncchHeader));
+	if(ncch.magic != NCCH_MAGIC) return "main content isn't an NCCH";
+	if(!(ncch.flags[7] & NCCH_FLAG7_NOCRYPTO)) return "NCCH is encrypted";
+
+	exefsSize = (u64)ncch.exefsSize * NCCH_MEDIA_UNIT;
+	loc->content = content;
+	loc->exefsOffset = content->offset + (u64)ncch.exefsOffset * NCCH_MEDIA_UNIT;
+	loc->exefsHashSize = ncch.exefsHashSize * NCCH_MEDIA_UNIT;
+	if(exefsSize < EXEFS_HEADER_SIZE || loc->exefsHashSize > exefsSize
+			|| loc->exefsOffset + exefsSize > content->offset + content->size)
+		return "exefs is outside the NCCH";
+	memcpy(&exefs, cia->map.data + loc->exefsOffset, sizeof(struct exefsHeader));
+
+	loc->codeIndex = exefsFindFile(&exefs, ".code");
+	if(loc->codeIndex < 0) return "no .code in exefs";
+	loc->codeOffset = loc->exefsOffset + EXEFS_HEADER_SIZE + exefs.files[loc->codeIndex].offset;
+	loc->codeSize = exefs.files[loc->codeIndex].size;
+	if(loc->codeOffset + loc->codeSize > loc->exefsOffset + exefsSize) return ".code runs past end of exefs";
+	loc->code = cia->map.data + loc->codeOffset;
+
+	//a compressed .code ends in the LZ footer rather than ours
+	if(loc->codeSize < sizeof(struct footer)) return ".code is too small";
+	memcpy(&ftr, loc->code + loc->codeSize - sizeof(struct footer), sizeof(struct footer));
+	if(ftr.magic != 0x4141432e) return ".code is compressed or not a GBA VC";
+
+	return NULL;
+}
+
+//patch the config and fix up every hash that covers it
+const char* ciaPatchConfig(const struct cia *cia, const struct ciaCode *loc, const char *ciaName,
+		const struct config *cfg, u32 cfgOffset, const char *outName) {
+	const u8 *base = cia->map.data;
+	struct patch patches[MAX_PATCHES];
+	u8 codeHash[SHA256_SIZE], exefsHash[SHA256_SIZE], contentHash[SHA256_SIZE], tmdInfoHash[SHA256_SIZE];
+	u8 infoHashes[TMD_INFO_COUNT][SHA256_SIZE];
+	u64 chunkRecords = cia->tmdHeaderOffset + TMD_CHUNK_RECORDS;
+	u64 infoRecords = cia->tmdHeaderOffset + TMD_INFO_RECORDS;
+	u32 chunkPos = (loc->content->chunkOffset - chunkRecords) / TMD_CHUNK_SIZE;
+	int nPatches = 0, i;
+	const char *result = NULL, *target = outName;
+	FILE *fp;
+
+	//1. the config itself
+	patches[nPatches++] = (struct patch){loc->codeOffset + cfgOffset, sizeof(struct config), cfg};
+
+	//2. exefs file hash of .code
+	hashPatched(base, loc->codeOffset, loc->codeSize, patches, nPatches, codeHash);
+	patches[nPatches++] = (struct patch){loc->exefsOffset + EXEFS_HASH_OFFSET(loc->codeIndex), SHA256_SIZE, codeHash};
+
+	//3. NCCH superblock hash over the exefs header
+	hashPatched(base, loc->exefsOffset, loc->exefsHashSize, patches, nPatches, exefsHash);
+	patches[nPatches++] = (struct patch){loc->content->offset + offsetof(struct ncchHeader, exefsHash), SHA256_SIZE, exefsHash};
+
+	//4. TMD content hash over the whole NCCH
+	hashPatched(base, loc->content->offset, loc->content->size, patches, nPatches, contentHash);
+	patches[nPatches++] = (struct patch){loc->content->chunkOffset + 0x10, SHA256_SIZE, contentHash};
+
+	//5. every content info record that covers this content's chunk record
+	for(i=0; i<TMD_INFO_COUNT; i++) {
+		const u8 *info = base + infoRecords + i*TMD_INFO_SIZE;
+		u32 first = getBE16(info), count = getBE16(info + 2);
+		if(count == 0 || chunkPos < first || chunkPos >= first + count)
+			continue;
+		hashPatched(base, chunkRecords + first*TMD_CHUNK_SIZE, count*TMD_CHUNK_SIZE, patches, nPatches, infoHashes[i]);
+		patches[nPatches++] = (struct patch){infoRecords + i*TMD_INFO_SIZE + 4, SHA256_SIZE, infoHashes[i]};
+	}
+
+	//6. TMD header hash over the content info records
+	hashPatched(base, infoRecords, TMD_INFO_COUNT*TMD_INFO_SIZE, patches, nPatches, tmdInfoHash);
+	patches[nPatches++] = (struct patch){cia->tmdHeaderOffset + TMD_INFO_HASH, SHA256_SIZE, tmdInfoHash};
+
+	//everything is computed from the source, so now it's safe to write
+	if(outName) {
+		if(copyFile(ciaName, outName)) return "can't copy cia";
+	} else {
+		target = ciaName;
+	}
+	fp = fopen(target, "rb+");
+	if(!fp) {
+		result = "can't open cia to patch";
+	} else {
+		for(i=0; i<nPatches && !result; i++) {
+			if(0 != fseek(fp, patches[i].offset, SEEK_SET)) result = "can't seek to patch cia";
+			else if(fwrite(patches[i].data, 1, patches[i].size, fp) != patches[i].size) result = "can't write patch to cia";
+		}
+		if(fclose(fp) != 0 && !result) result = "can't write patch to cia";
+	}
+	if(result && outName) remove(outName);	//don't leave a half patched copy behind
+	return result;
+}
@@ -0,0 +1,33 @@
+#ifndef __FASTPATCH_H__
+#define __FASTPATCH_H__
+
+/* Fast path for decrypted cias
+ * The only bytes an edit changes are the config inside code.bin, so rather
+ * than unpacking and rebuilding everything we find the config inside the cia
+ * and patch it directly, then redo just the hashes that cover it:
+ * the exefs file hash of .code, the NCCH exefs superblock hash, and the TMD
+ * content hash plus the TMD hashes that cover that.
+ */
+
+#include "gbacia.h"
+#include "cia.h"
+
+//where code.bin lives inside a decrypted cia -- all offsets are from the start of the cia
+struct ciaCode {
+	const struct ciaContent *content;	//the main content, an NCCH
+	u64 exefsOffset;
+	u32 exefsHashSize;	//bytes at the start of the exefs covered by the NCCH superblock hash
+	int codeIndex;	//index of .code in the exefs file table
+	u64 codeOffset;
+	u32 codeSize;
+	const u8 *code;	//view into the mapped cia
+};
+
+//returns a string on failure (meaning the fast path can't be used), NULL on success
+const char* ciaFindCode(const struct cia *cia, struct ciaCode *loc);
+//write cfg at cfgOffset within code.bin, fixing up the hash chain
+//outName is where to put the patched cia, or NULL to patch the input in place
+const char* ciaPatchConfig(const struct cia *cia, const struct ciaCode *loc, const char *ciaName,
+		const struct config *cfg, u32 cfgOffset, const char *outName);
+
+#endif /* __FASTPATCH_H__ */
@@ -1,15 +1,26 @@
 /* agb_edit GBA VC cia handling functions */
 
+#include <pthread.h>
 #include "gbacia.h"
 #include "console_ui.h"
+#include "cia.h"
+#include "platform.h"
+#include "fastpatch.h"
+#include "exefs.h"
+#include "lz.h"
+#include "ncch.h"
+#include "stage.h"
+#include "trace.h"
+#include "romhash.h"
+#include "dat.h"
+#include "cache.h"
+#include "sha256.h"
+#include "report.h"
+#include "savetype.h"
+#include "romedit.h"
 
 //values that we'll prompt for and set in the cia
-int onlyInfo = 0, dumpRom = 0, extractAll = 0, setSleepButtons = 0, setLcdGhosting = 0, setVideoLUT = 0;
-u16 sleepButtons = 0;
-u32 lcdGhosting = 0;
-u8 videoLUT[3 * 256] = {0};
-
-char tmpName[4096];	//where we construct the name of the temp dir for dumping
+struct editSettings edits = {0};
 
 //button names for button encoding and decoding functions
 //                                     0    1    2         3        4        5       6     7       8    9    10   11
@@ -55,6 +66,22 @@ const char* saveTypeToString(u32 saveType) {
 	}
 }
 
+//enum saveType by name, in order
+static const char *saveTypeNames[16] = {
+	"EEPROM_8K_SMALLROM", "EEPROM_8K_256MROM", "EEPROM_64K_SMALLROM", "EEPROM_64K_256MROM",
+	"FLASH_512K_ATMEL_RTC", "FLASH_512K_ATMEL", "FLASH_512K_SST_RTC", "FLASH_512K_SST",
+	"FLASH_512K_PANASONIC_RTC", "FLASH_512K_PANASONIC", "FLASM_1M_MACRONIX_RTC", "FLASM_1M_MACRONIX",
+	"FLASM_1M_SANYO_RTC", "FLASM_1M_SANYO", "SRAM_256K", "NO_SAVE"
+};
+
+//look up a save type by its enum name -- 0xffffffff if there's no such name
+u32 encodeSaveType(const char *name) {
+	for(u32 i=0; i<16; i++)
+		if(0 == strcasecmp(name, saveTypeNames[i]))
+			return i;
+	return 0xffffffff;
+}
+
 //lookup section type name
 const char* sectionTypeToString(u32 sectionType) {
 	switch(sectionType) {
@@ -66,7 +93,7 @@ const char* sectionTypeToString(u32 sectionType) {
 
 //decode sleep button list into a string like "L R Select"
 const char* decodeButtons(u16 mask) {
-	static char result[512];
+	static _Thread_local char result[512];	//per thread, since jobs can run in parallel
 
 	result[0] = '\0';	//clear any string that was there
 	for(int i=0; i<12; i++) {
@@ -113,328 +140,886 @@ u16 encodeButtons(const char *buttons) {
 	return btns;
 }
 
-//process this code.bin file -- later we will modify it but for now we just print info
+//write the ROM out to its own file
+//when code is a view into a mapped file the kernel copies it file to file, so the ROM never has to be
+//read into memory; otherwise it's already in memory and just gets written out
+static const char* dumpRom(const u8 *code, u32 romSize, const struct fileMap *codeMap, const char *romname) {
+	const char *result = NULL;
+	FILE *fp = fopen(romname, "wb");
+	if(!fp) return "can't create ROM file";
+	if(codeMap)
+		result = copyRange(codeMap, code - codeMap->data, romSize, fp);
+	else if(fwrite(code, 1, romSize, fp) != romSize)
+		result = "can't write ROM file";
+	if(fclose(fp) != 0 && !result) result = "can't write ROM file";
+	if(result) remove(romname);	//don't leave a truncated ROM behind
+	return result;
+}
+
+//make the changes an edit asks for to a config -- job says what processCodeBin found out about the title
+static void applyEdits(const struct editSettings *edit, const struct job *job, struct config *cfg) {
+	if(edit->setSaveType)
+		cfg->saveType = edit->saveType;
+	else if(edit->fixSaveType && job->fixedSaveType != SAVE_TYPE_UNFIXABLE)
+		cfg->saveType = job->fixedSaveType;
+	if(edit->saveTiming)	//after the save type, so it goes by the right chip
+		saveTimingApply(edit->saveTiming, cfg->saveType, &cfg->saveConfig);
+	if(edit->setSleepButtons)
+		cfg->sleepButtons = edit->sleepButtons;
+	if(edit->setLcdGhosting)
+		cfg->lcdGhosting = edit->lcdGhosting;
+	if(edit->setVideoLUT)
+		memcpy(cfg->videoLUT, edit->videoLUT, sizeof(cfg->videoLUT));
+}
+
+//say what a timing profile did to an edited config -- it's set by chip, so it can differ from title to title
+static void logSaveTiming(struct job *job, const struct editSettings *edit, const struct config *cfg) {
+	struct saveConfig check;
+	const char *result;
+
+	if(!edit->saveTiming)
+		return;
+	result = saveTimingApply(edit->saveTiming, cfg->saveType, &check);
+	fprintf(job->log, "==> Save timing%s%s: %s profile %s %s\n", edit->name[0] ? " for " : "", edit->name,
+			saveTimingToString(edit->saveTiming), result ? "not set," : "for", result ? result : saveTypeToString(cfg->saveType));
+}
+
+//process a code.bin that's already in memory (usually a view into a mapped file)
+//prints info, dumps the ROM if asked, and works out the modified config -- it never writes to code
+//on success, *newCfg and *cfgOffset say what to write where; the caller decides where code.bin lives
 //returns a string on failure, NULL on success
-//ciaName is just so we can dump the ROM to a suitable filename
-const char* processCodeBin(const char *codeBin, const char *ciaName) {
+//job is where the settings and output go, and its cia name is used to name the dumped ROM
+//codeMap is the mapped file code is a view into, or NULL if code is only in memory
+const char* processCodeBin(const u8 *code, u32 codeSize, const struct fileMap *codeMap, struct job *job,
+		struct config *newCfg, u32 *cfgOffset) {
+	const struct editSettings *edit = &job->settings;
 	struct footer ftr;
 	struct sectionDescriptor *sec;
 	struct config cfg;
-	long fpos;
-	u32 cfgOffset;
-	size_t nread;
-	int nCfg, nErr, i;
-	const char *result;
-	FILE *fp = fopen(codeBin, "rb+");
-	if(!fp) return "can't open code.bin";
+	struct romHasher hasher;
+	struct romHashes hashes;
+	struct traceSpan span;
+	struct saveScan scan;
+	struct romTrim trim;
+	int nCfg, nErr, i, romIndex = -1, check;
+	u32 fixed;
+	const char *result, *dumpResult = NULL;
 
+	job->fixedSaveType = SAVE_TYPE_UNFIXABLE;
+	job->romTrimmable = 0;
 	//footer is at the very end of the file
-	if(0 != fseek(fp, -(ssize_t)sizeof(struct footer), SEEK_END)) { fclose(fp); return "can't seek to footer"; }
-	fpos = ftell(fp);
-	if(fpos < 0) { fclose(fp); return "bad seek to footer"; }
-	nread = fread(&ftr, 1, sizeof(struct footer), fp);
-	if(nread != sizeof(struct footer)) { fclose(fp); return "can't read footer"; }
+	if(codeSize < sizeof(struct footer)) return "code.bin too small for footer";
+	memcpy(&ftr, code + codeSize - sizeof(struct footer), sizeof(struct footer));
 
 	//print data before checking, so user can see it even if there's a problem
-	printf("==== DUMPING INFO FROM FOOTER ====\n>> main footer >>\n");
+	fprintf(job->log, "==== DUMPING INFO FROM FOOTER ====\n>> main footer >>\n");
 	char magic[5];
 	*((u32*)magic) = ftr.magic;
 	magic[4] = '\0';
-	printf("Magic: 0x%08x ('%4s')\n", ftr.magic, magic);
+	fprintf(job->log, "Magic: 0x%08x ('%4s')\n", ftr.magic, magic);
 	if(ftr.magic != 0x4141432e) {
-		printf("BAD magic value!\n");
-		fclose(fp);
+		fprintf(job->log, "BAD magic value!\n");
 		return "bad footer magic value";
 	}
-	printf("Active: %d\n", ftr.active);
+	fprintf(job->log, "Active: %d\n", ftr.active);
 	if(ftr.active != 1) {
-		printf("Footer active isn't 1!\n");
-		fclose(fp);
+		fprintf(job->log, "Footer active isn't 1!\n");
 		return "bad footer active value";
 	}
-	printf("Offset to descriptors: 0x%x\n", ftr.offset);
-	printf("Number of descriptors: %d\n", ftr.nDesc>>4);
+	if(job->info) {
+		job->info->haveFooter = 1;
+		job->info->footer = ftr;
+	}
+	fprintf(job->log, "Offset to descriptors: 0x%x\n", ftr.offset);
+	fprintf(job->log, "Number of descriptors: %d\n", ftr.nDesc>>4);
 
 	//read the section descriptor array
-	if(0 != fseek(fp, ftr.offset, SEEK_SET)) { fclose(fp); return "can't seek to descriptors"; }
-	fpos = ftell(fp);
-	if(fpos != ftr.offset) { fclose(fp); return "bad seek to descriptors"; }
-	sec = alloca((ftr.nDesc>>4) * sizeof(struct sectionDescriptor));
-	if(!sec) { fclose(fp); return "can't allocate memory (sec)"; }
-	nread = fread(sec, sizeof(struct sectionDescriptor), ftr.nDesc>>4, fp);
-	if(nread != ftr.nDesc>>4) { fclose(fp); return "can't read section table"; }
+	if(ftr.offset > codeSize || (ftr.nDesc>>4) > (codeSize - ftr.offset) / sizeof(struct sectionDescriptor))
+		return "section table runs past end of code.bin";
+	sec = malloc((ftr.nDesc>>4) * sizeof(struct sectionDescriptor) + 1);	//+1 so no descriptors isn't a failure
+	if(!sec) return "can't allocate memory (sec)";
+	memcpy(sec, code + ftr.offset, (ftr.nDesc>>4) * sizeof(struct sectionDescriptor));
+	if(job->info) {
+		job->info->nSections = ftr.nDesc>>4;
+		memcpy(job->info->sections, sec, (ftr.nDesc>>4 < REPORT_MAX_SECTIONS ? ftr.nDesc>>4 : REPORT_MAX_SECTIONS) * sizeof(struct sectionDescriptor));
+	}
 
 	//print sections, read and print configs
 	nCfg = 0;
 	nErr = 0;
-	cfgOffset = 0xffffffff;
+	*cfgOffset = 0xffffffff;
 	for(i=0; i<ftr.nDesc>>4; i++) {
-		printf(" >> section %d/%d >>\n", i+1, ftr.nDesc>>4);
-		printf(" Type: %s (%d)\n", sectionTypeToString(sec[i].type), sec[i].type);
-		printf(" Offset to data: 0x%x\n", sec[i].offset);
-		printf(" Size of data: 0x%x\n", sec[i].size);
-		printf(" Padding value: 0x%08x\n", sec[i].padding);
+		fprintf(job->log, " >> section %d/%d >>\n", i+1, ftr.nDesc>>4);
+		fprintf(job->log, " Type: %s (%d)\n", sectionTypeToString(sec[i].type), sec[i].type);
+		fprintf(job->log, " Offset to data: 0x%x\n", sec[i].offset);
+		fprintf(job->log, " Size of data: 0x%x\n", sec[i].size);
+		fprintf(job->log, " Padding value: 0x%08x\n", sec[i].padding);
 		//further processing only if this is a config
 		if(sec[i].type == 1) {
 			if(sec[i].size == sizeof(struct config) && sec[i].offset != 0 && sec[i].offset != 0xffffffff) {
 				//read the config
-				if(0 != fseek(fp, sec[i].offset, SEEK_SET)) { fclose(fp); return "can't seek to config"; }
-				fpos = ftell(fp);
-				if(fpos != sec[i].offset) { fclose(fp); return "bad seek to config"; }
-				nread = fread(&cfg, 1, sizeof(struct config), fp);
-				if(nread != sizeof(struct config)) { fclose(fp); return "can't read config"; }
+				if(codeSize < sizeof(struct config) || sec[i].offset > codeSize - sizeof(struct config)) {
+					free(sec);
+					return "config runs past end of code.bin";
+				}
+				memcpy(&cfg, code + sec[i].offset, sizeof(struct config));
 				//print its info
-				printf("  >> config data >>\n");
-				printf("  Padding value: 0x%08x\n", cfg.padding0);
-				printf("  ROM size: 0x%x\n", cfg.romSize);
-				printf("  Save type: %s (0x%x)\n", saveTypeToString(cfg.saveType), cfg.saveType);
-				printf("  Padding value: 0x%04x\n", cfg.padding1);
-				printf("  Sleep buttons: 0x%04x => %s\n", cfg.sleepButtons, decodeButtons(cfg.sleepButtons));
-				printf("   >> save chip config >>\n");
-				printf("   Flash: bus cycles to erase the whole chip: %d\n", cfg.saveConfig.flashChipEraseCycles);
-				printf("   Flash: bus cycles to erase a sector: %d\n", cfg.saveConfig.flashSectorEraseCycles);
-				printf("   Flash: bus cycles to program a sector: %d\n", cfg.saveConfig.flashProgramCycles);
-				printf("   EEPROM: bus cycles to perform a write: %d\n", cfg.saveConfig.eepromWriteCycles);
-				printf("  LCD ghosting (01=lots; ff=none): %02x\n", cfg.lcdGhosting);
-				printf("  Video LUT:\n");
-				printVideoLUT(cfg.videoLUT, cfg.lcdGhosting);
-				cfgOffset = sec[i].offset;
+				fprintf(job->log, "  >> config data >>\n");
+				fprintf(job->log, "  Padding value: 0x%08x\n", cfg.padding0);
+				fprintf(job->log, "  ROM size: 0x%x\n", cfg.romSize);
+				fprintf(job->log, "  Save type: %s (0x%x)\n", saveTypeToString(cfg.saveType), cfg.saveType);
+				fprintf(job->log, "  Padding value: 0x%04x\n", cfg.padding1);
+				fprintf(job->log, "  Sleep buttons: 0x%04x => %s\n", cfg.sleepButtons, decodeButtons(cfg.sleepButtons));
+				fprintf(job->log, "   >> save chip config >>\n");
+				fprintf(job->log, "   Flash: bus cycles to erase the whole chip: %d\n", cfg.saveConfig.flashChipEraseCycles);
+				fprintf(job->log, "   Flash: bus cycles to erase a sector: %d\n", cfg.saveConfig.flashSectorEraseCycles);
+				fprintf(job->log, "   Flash: bus cycles to program a sector: %d\n", cfg.saveConfig.flashProgramCycles);
+				fprintf(job->log, "   EEPROM: bus cycles to perform a write: %d\n", cfg.saveConfig.eepromWriteCycles);
+				fprintf(job->log, "  LCD ghosting (01=lots; ff=none): %02x\n", cfg.lcdGhosting);
+				if(job->info) {	//the report has the LUT, so don't spend time drawing it for a log nobody reads
+					job->info->cfgOffset = sec[i].offset;
+					job->info->config = cfg;
+				} else {
+					fprintf(job->log, "  Video LUT:\n");
+					printVideoLUT(job->log, cfg.videoLUT, cfg.lcdGhosting);
+				}
+				*cfgOffset = sec[i].offset;
 				++nCfg;
 			} else if(sec[i].size != sizeof(struct config)) {
-				printf("  !! Config section with WRONG size! Should be 0x324!\n");
+				fprintf(job->log, "  !! Config section with WRONG size! Should be 0x324!\n");
 				++nErr;
 			} else {
-				printf("  !! Config section with WRONG offset! Should not be 0 or 0xffffffff!\n");
+				fprintf(job->log, "  !! Config section with WRONG offset! Should not be 0 or 0xffffffff!\n");
 				++nErr;
 			}
 		} else if(sec[i].type == 0) {
 			if(sec[i].offset == 0) {
-				if(dumpRom) {
-					int romok=1;
-					if(0 != fseek(fp, sec[i].offset, SEEK_SET)) romok=0;
-					fpos = ftell(fp);
-					if(fpos != sec[i].offset) romok=0;
-					if(romok) {
-						u8 *romdata = malloc(sec[i].size);
-						if(romdata == NULL) romok=0;
-						if(romok) {
-							nread = fread(romdata, 1, sec[i].size, fp);
-							if(nread != sec[i].size) romok=0;
-							if(romok) {
-								char romname[4096];
-								strncpy(romname, ciaName, sizeof(romname));
-								int ind=strlen(romname)-4;	//should put us at ".cia"
-								if(0 == strcasecmp(&romname[ind], ".cia"))
-									romname[ind] = '\0';	//lop off ".cia"
-								strncat(romname, ".gba", sizeof(romname));
-								FILE *romfp = fopen(romname, "wb");
-								nread = fwrite(romdata, 1, sec[i].size, romfp);
-								if(nread != sec[i].size) romok=0;
-								fclose(romfp);
-								if(romok)
-									printf("  (raw GBA ROM data - dumped to '%s')\n", romname);
-								else
-									printf("  (raw GBA ROM data - failed to dump to '%s')\n", romname);
-							}
-							free(romdata);
+				if(sec[i].size <= codeSize)
+					romIndex = i;
+				if(edit->dumpRom) {
+					char romname[4096];
+					int ind = strlen(job->fname) - 4;	//should put us at ".cia"
+					if(ind >= 0 && 0 == strcasecmp(&job->fname[ind], ".cia"))
+						snprintf(romname, sizeof(romname), "%.*s.gba", ind, job->fname);	//lop off ".cia"
+					else
+						snprintf(romname, sizeof(romname), "%s.gba", job->fname);
+					if(sec[i].size > codeSize) {
+						dumpResult = "ROM runs past end of code.bin";
+					} else {
+						//hash it for the DAT check while it's being written, rather than reading the .gba back
+						traceBegin(&span, "dump ROM");
+						romHashStart(&hasher, code, sec[i].size);
+						dumpResult = dumpRom(code, sec[i].size, codeMap, romname);
+						romHashFinish(&hasher, &hashes);
+						traceEnd(&span, job, sec[i].size, dumpResult ? 0 : sec[i].size, TRACE_NO_EXIT_CODE);
+					}
+					if(!dumpResult) {
+						fprintf(job->log, "  (raw GBA ROM data - dumped to '%s')\n", romname);
+						romHashPrint(job->log, &hashes, "  ");
+						if(job->info) {
+							job->info->dumped = 1;
+							job->info->romSize = sec[i].size;
+							job->info->hashes = hashes;
+						}
+						if(job->dat) {
+							datCheck(job->dat, &hashes, sec[i].size, job->datStatus, sizeof(job->datStatus));
+							fprintf(job->log, "  %s\n", job->datStatus);
 						}
+					} else {
+						fprintf(job->log, "  (raw GBA ROM data - failed to dump to '%s': %s)\n", romname, dumpResult);
 					}
 				} else {
-					printf("  (raw GBA ROM data)\n");
+					fprintf(job->log, "  (raw GBA ROM data)\n");
 				}
 			} else {
-				printf("  !! ROM section with nonzero offset!\n  !! THIS WILL MAKE AGB_FIRM ERROR OUT!");
+				fprintf(job->log, "  !! ROM section with nonzero offset!\n  !! THIS WILL MAKE AGB_FIRM ERROR OUT!");
 				++nErr;
 			}
 		} else {
-			printf("  !! BAD SECTION TYPE %d!\n", sec[i].type);
+			fprintf(job->log, "  !! BAD SECTION TYPE %d!\n", sec[i].type);
 			++nErr;
 		}
 	}
-	printf("Number of config blocks: %d\n\n", nCfg);
+	fprintf(job->log, "Number of config blocks: %d\n\n", nCfg);
+	if(job->info)
+		job->info->nConfigs = nCfg;
+
+	//check the save type against the save library the game was built with
+	if(nCfg == 1 && romIndex >= 0) {
+		traceBegin(&span, "save type check");
+		saveScanRom(code, sec[romIndex].size, &scan);
+		check = saveCheck(&scan, sec[romIndex].size, cfg.saveType, &fixed);
+		traceEnd(&span, job, sec[romIndex].size, 0, TRACE_NO_EXIT_CODE);
+		fprintf(job->log, "Save library:");
+		for(i=0; i<scan.nLibs; i++)
+			fprintf(job->log, " %s", scan.libs[i]);
+		if(scan.nLibs)
+			fprintf(job->log, " (%s%s)\n", saveKindToString(scan.kinds), (scan.kinds & SAVE_KIND_RTC) ? " with RTC" : "");
+		else
+			fprintf(job->log, " none found\n");
+		if(check == SAVE_CHECK_MATCH) {
+			fprintf(job->log, "Save type matches the ROM\n\n");
+		} else if(check == SAVE_CHECK_UNKNOWN) {
+			fprintf(job->log, "Can't tell from the ROM whether the save type is right\n\n");
+		} else if(fixed == SAVE_TYPE_UNFIXABLE) {
+			fprintf(job->log, "!! Save type is %s, but the ROM uses %s!\n"
+					"!! Its size can't be told from the ROM, so set it by hand with save_type in a recipe\n\n",
+					saveTypeToString(cfg.saveType), saveKindToString(scan.kinds));
+		} else {
+			fprintf(job->log, "!! Save type is %s, but the ROM wants %s!\n%s\n", saveTypeToString(cfg.saveType),
+					saveTypeToString(fixed), edit->fixSaveType ? "" : "!! Use the preset or fix_save_type to correct it\n");
+			job->fixedSaveType = fixed;
+		}
+		if(job->info) {
+			job->info->saveChecked = 1;
+			job->info->saveCheck = check;
+			job->info->saveScan = scan;
+			job->info->fixedSaveType = fixed;
+		}
+	}
+
+	//how much of the ROM is padding that could go
+	if(romIndex >= 0) {
+		traceBegin(&span, "trim scan");
+		romTrimScan(code, sec[romIndex].size, &trim);
+		traceEnd(&span, job, sec[romIndex].size, 0, TRACE_NO_EXIT_CODE);
+		romTrimPrint(job->log, &trim, sec[romIndex].size);
+		fputc('\n', job->log);
+		job->romTrimmable = trim.trimmedSize < sec[romIndex].size;
+		if(job->info) {
+			job->info->trimChecked = 1;
+			job->info->trimRomSize = sec[romIndex].size;
+			job->info->trim = trim;
+		}
+	}
 
 	if(nErr == 0 && nCfg == 1) {
 		//modify the config as requested
-		if(setSleepButtons)
-			cfg.sleepButtons = sleepButtons;
-		if(setLcdGhosting)
-			cfg.lcdGhosting = lcdGhosting;
-		if(setVideoLUT)
-			memcpy(cfg.videoLUT, videoLUT, sizeof(videoLUT));
-		//write it back to code.bin if we changed it
-		if(!onlyInfo) {
-			if(0 != fseek(fp, cfgOffset, SEEK_SET)) { fclose(fp); return "can't seek to write config"; }
-			fpos = ftell(fp);
-			if(fpos != cfgOffset) { fclose(fp); return "bad seek to write config"; }
-			nread = fwrite(&cfg, 1, sizeof(struct config), fp);
-			if(nread != sizeof(struct config)) { fclose(fp); return "can't write config"; }
-		}
+		applyEdits(edit, job, &cfg);
+		*newCfg = cfg;
 		result = NULL;
 	} else {
-		if(!onlyInfo)
-			printf("Cannot modify file with above problems!\n");
+		if(!edit->onlyInfo)
+			fprintf(job->log, "Cannot modify file with above problems!\n");
 		result = "errors in config section";
 	}
 
-	fclose(fp);
-	putchar('\n');
+	free(sec);
+	fputc('\n', job->log);
+	return dumpResult ? dumpResult : result;
+}
+
+//write a buffer out as a whole file
+static const char* writeBuffer(const char *fname, const u8 *data, u32 size) {
+	size_t nwritten;
+	FILE *fp = fopen(fname, "wb");
+	if(!fp) return "can't create file";
+	nwritten = fwrite(data, 1, size, fp);
+	if(fclose(fp) != 0 || nwritten != size) return "can't write file";
+	return NULL;
+}
+
+//code.bin pulled out of an exefs, ready to have each output's config written into a copy of it
+struct codeBin {
+	struct exefs exefs;	//.code in here is the decompressed copy below
+	int codeIndex, compressed;
+	u8 *code;	//owned by exefs
+	u32 codeSize;
+	struct config cfg;	//the config with job->settings applied
+	u32 cfgOffset;
+};
+
+//unpack the exefs from a cxi and process code.bin, decompressing it if need be
+//the exefs keeps pointing into exefsData, so that has to stay put until the outputs are built
+static const char* unpackExefs(struct job *job, const u8 *exheader, u64 exheaderSize, const u8 *exefsData, u64 exefsSize,
+		struct codeBin *cb) {
+	char fname[4096], dirName[4096];
+	const char *result;
+	struct traceSpan span;
+
+	//the exheader says whether .code is compressed
+	cb->compressed = exheaderSize > EXHEADER_FLAGS && (exheader[EXHEADER_FLAGS] & EXHEADER_FLAG_COMPRESSED);
+
+	result = exefsParse(&cb->exefs, exefsData, exefsSize);
+	if(result) return result;
+	cb->codeIndex = exefsFindFile(&cb->exefs.header, ".code");
+	if(cb->codeIndex < 0) return "no .code in exefs";
+
+	//get a copy of code.bin we can look at in one piece
+	if(cb->compressed) {
+		fprintf(job->log, "==> Decompressing .code\n");
+		traceBegin(&span, "decompress .code");
+		result = lzDecompress(cb->exefs.files[cb->codeIndex], cb->exefs.header.files[cb->codeIndex].size, &cb->code, &cb->codeSize);
+		traceEnd(&span, job, cb->exefs.header.files[cb->codeIndex].size, result ? 0 : cb->codeSize, TRACE_NO_EXIT_CODE);
+		if(result) return result;
+	} else {
+		cb->codeSize = cb->exefs.header.files[cb->codeIndex].size;
+		cb->code = malloc(cb->codeSize);
+		if(!cb->code) return "can't allocate memory (code.bin)";
+		memcpy(cb->code, cb->exefs.files[cb->codeIndex], cb->codeSize);
+	}
+	exefsReplaceFile(&cb->exefs, cb->codeIndex, cb->code, cb->codeSize);
+
+	traceBegin(&span, "processCodeBin");
+	result = processCodeBin(cb->code, cb->codeSize, NULL, job, &cb->cfg, &cb->cfgOffset);
+	traceEnd(&span, job, cb->codeSize, 0, TRACE_NO_EXIT_CODE);
+	if(result) return result;
+
+	//loose files for extract mode get the decompressed code.bin
+	if(job->settings.extractAll) {
+		snprintf(dirName, sizeof(dirName), "%s" PATH_SEP "exefs", job->tmpName);
+		snprintf(fname, sizeof(fname), "%s" PATH_SEP "exefsheader.bin", job->tmpName);
+		result = exefsWriteFiles(&cb->exefs, dirName, fname);
+	}
 	return result;
 }
 
-//unpack and repack, calling processCodeBin with the path to the code.bin
-const char* process(char *fname) {
-	char cmd[8192];	//buffer to build command lines in
-	char mainCxi[4096];	//name of main dumped cxi - official GBA VCs contain a second with a manual which we want to preserve but otherwise don't care about
-	char dumpFile[4096];	//for enumerating dumped cxi's when rebuilding a cia
-	char cmdPart[4096];	//additional buffer to build pieces of a command line in
-	char fileNum[32], indNum[32];	//"file" and "index" numbers from the cxi name
-	char newCiaName[4096];
-	int i, j, nDumps;
-	const char *resultStr = NULL;
-	FILE *fp;
-	printf("\n==> Processing %s\n", fname);
-
-	//temp dir name stuff
-	if(extractAll) {
-		strncpy(tmpName, fname, sizeof(tmpName));
-		i = strlen(tmpName) - 4;
-		if(0 == strcasecmp(&tmpName[i], ".cia"))
-			tmpName[i] = '\0';
-		strncat(tmpName, ".dump", sizeof(tmpName));
+//whether an output changes the ROM -- trim_rom on its own only does if the ROM has padding it can cut
+static int editsRom(const struct job *job, const struct editSettings *edit) {
+	if(edit->trimRom && !edit->romPatch[0] && !edit->romFile[0])
+		return job->romTrimmable;
+	return romEditWanted(edit);
+}
+
+//build a new exefs from the unpacked one with cfg written into code.bin, recompressing it if need be
+//*newExefs is malloc'd. cb is only read, so several of these can run at once.
+//edits to the ROM itself get a whole new code.bin, since the ROM can change size
+static const char* buildExefs(struct job *job, const struct codeBin *cb, const struct editSettings *edit,
+		const struct config *cfg, u8 **newExefs, u32 *newExefsSize) {
+	struct exefs exefs = cb->exefs;	//a shallow copy -- the other files are still views into the original
+	u8 *code, *out;
+	u32 codeSize = cb->codeSize, outSize;
+	const char *result = NULL;
+	struct traceSpan span;
+
+	memset(exefs.owned, 0, sizeof(exefs.owned));
+	if(editsRom(job, edit)) {
+		traceBegin(&span, "edit ROM");
+		result = romEditBuild(job->log, edit, cb->code, cb->codeSize, cfg, cb->cfgOffset, &code, &codeSize);
+		traceEnd(&span, job, cb->codeSize, result ? 0 : codeSize, TRACE_NO_EXIT_CODE);
+		if(result) return result;
 	} else {
-		strcpy(tmpName, "UNPACKTMP");
-	}
-
-	//clean & make the temp dir
-	snprintf(cmd, sizeof(cmd), "rd /s /q \"%s\" 2>NUL", tmpName);
-	system(cmd);
-	snprintf(cmd, sizeof(cmd), "mkdir \"%s\"", tmpName);
-	system(cmd);
-
-	//dump cia contents
-	snprintf(cmd, sizeof(cmd), "progfiles\\ctrtool.exe --contents \"%s\\file\" \"%s\"", tmpName, fname);
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "ctrtool --contents failed";
-
-	//find the main file -- NSUI uses a single cxi at 0:0, while Nintendo VCs have 0:2 and then a manual at 1:3
-	//we can't assume a name, but it's probably safe to assume the largest file is the game
-	//this dir command prints just the filenames of files, sorted largest to smallest, so we can just read line 1
-	snprintf(cmd, sizeof(cmd), "dir \"%s\" /b /o-s", tmpName);
-	fp = popen(cmd, "r");
-	if(!fgets(mainCxi, sizeof(mainCxi), fp)) return "couldn't find cxi";
-	pclose(fp);
-	for(i=strlen(mainCxi)-1; i>=0 && isspace(mainCxi[i]); i--) mainCxi[i]='\0';	//trim newline/spaces from end
-
-	//unpack the cxi
-	snprintf(cmd, sizeof(cmd), "progfiles\\3dstool.exe -xtf cxi \"%s\\%s\" --header \"%s\\ncchheader.bin\" --exh \"%s\\exheader.bin\" --exefs \"%s\\exefs.bin\" --romfs \"%s\\romfs.bin\"",
-			tmpName, mainCxi, tmpName, tmpName, tmpName, tmpName);
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "3dstool -xtf cxi failed";
-
-	//unpack exefs
-	snprintf(cmd, sizeof(cmd), "progfiles\\3dstool.exe -xtf exefs \"%s\\exefs.bin\" --exefs-dir \"%s\\exefs\" --header \"%s\\exefsheader.bin\"", tmpName, tmpName, tmpName);
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "3dstool -xtf exefs failed";
-	//printf(" ^^^ NOTICE: \"ERROR: uncompress error\" and \"ERROR: extract file failed\" ARE NORMAL HERE. IGNORE THEM. ^^^\n\n\n");
-
-	//process the extracted code.bin
-	snprintf(cmd, sizeof(cmd), "%s\\exefs\\code.bin", tmpName);
-	resultStr = processCodeBin(cmd, fname);
-	if(resultStr) return resultStr;
+		code = malloc(codeSize);
+		if(!code) return "can't allocate memory (code.bin)";
+		memcpy(code, cb->code, codeSize);
+		memcpy(code + cb->cfgOffset, cfg, sizeof(struct config));
+	}
+	exefsReplaceFile(&exefs, cb->codeIndex, code, codeSize);
 
-	//we can stop here if we're just giving info; otherwise we need to rebuild a modified cia
-	if(onlyInfo)
-		return "Success!";
-
-	//now we reverse the steps above to make a modified cia
-	//loose files => exefs
-	snprintf(cmd, sizeof(cmd), "progfiles\\3dstool.exe -ctf exefs \"%s\\newExefs.bin\" --exefs-dir \"%s\\exefs\" --header \"%s\\exefsheader.bin\"", tmpName, tmpName, tmpName);
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "3dstool -ctf exefs failed";
-
-	//exefs etc => cxi
-	snprintf(cmd, sizeof(cmd), "progfiles\\3dstool.exe -ctf cxi \"%s\\modified.cxi\" --header \"%s\\ncchheader.bin\" --exh \"%s\\exheader.bin\" --exefs \"%s\\newExefs.bin\" --romfs \"%s\\romfs.bin\"",
-			tmpName, tmpName, tmpName, tmpName, tmpName);
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "3dstool -ctf cxi failed";
-
-	//now we need to reassemble one or more cxi's into a cia
-	//enumerate dumped contents in name order and parse the numbers out
-	snprintf(cmd, sizeof(cmd), "dir \"%s\\file.*\" /b /on", tmpName);
-	fp = popen(cmd, "r");
-	strcpy(cmd, "progfiles\\makerom.exe -f cia");
-	nDumps = 0;
-	while(fgets(dumpFile, sizeof(dumpFile), fp)) {
-		for(i=strlen(dumpFile)-1; i>=0 && isspace(dumpFile[i]); i--) dumpFile[i]='\0';	//trim newline/spaces from end
-
-		//extract file and index numbers
-		//locate first non-0 digit in the file number (5 jumps past "file.")
-		for(i=5; dumpFile[i]=='0'; i++);
-		if(dumpFile[i] == '\0') {
-			fclose(fp);
-			return "irregular dump file name";
-		} else if(dumpFile[i] == '.') {
-			//we reached the ending . before seeing a non-0 digit, number is 0
-			strcpy(fileNum, "0");
-		} else if(isxdigit(dumpFile[i])) {
-			//found one or more digits, copy them
-			for(j=0; j<sizeof(fileNum)-1 && isxdigit(dumpFile[i]); i++)
-				fileNum[j++] = dumpFile[i];
-			fileNum[j] = '\0';
+	if(cb->compressed) {
+		fprintf(job->log, "==> Compressing .code\n");
+		traceBegin(&span, "compress .code");
+		result = lzCompress(code, codeSize, &out, &outSize);
+		traceEnd(&span, job, codeSize, result ? 0 : outSize, TRACE_NO_EXIT_CODE);
+		if(result) goto done;
+		exefsReplaceFile(&exefs, cb->codeIndex, out, outSize);
+	}
+	outSize = exefsBuildSize(&exefs);
+	out = malloc(outSize);
+	if(!out) { result = "can't allocate memory (exefs)"; goto done; }
+	exefsBuild(&exefs, out);
+	*newExefs = out;
+	*newExefsSize = outSize;
+
+done:
+	exefsFree(&exefs);
+	return result;
+}
+
+//generate a name for the modified cia, noting what we changed
+static void makeEditName(char *name, size_t nameSize, const char *fname, const struct editSettings *edit) {
+	int i;
+
+	strncpy(name, fname, nameSize);
+	//remove extension
+	for(i=strlen(name)-1; i>=0 && name[i]!='.'; i--) name[i]='\0';
+	name[i]='\0';
+	//add note as to what's changed
+	strncat(name, " (edit", nameSize);
+	if(edit->setSleepButtons)
+		strncat(name, "-sleepbtns", nameSize);
+	if(edit->setLcdGhosting)
+		strncat(name, "-lcdghost", nameSize);
+	if(edit->setVideoLUT)
+		strncat(name, "-filter", nameSize);
+	if(edit->romPatch[0])
+		strncat(name, "-patched", nameSize);
+	if(edit->romFile[0])
+		strncat(name, "-newrom", nameSize);
+	if(edit->trimRom)
+		strncat(name, "-trimmed", nameSize);
+	if(edit->name[0]) {
+		strncat(name, "-", nameSize);
+		strncat(name, edit->name, nameSize);
+	}
+	strncat(name, ").cia", nameSize);
+}
+
+//builds the output for one edit -- variant is its index in job->variants, or -1 for job->settings
+typedef const char* (*buildFunc)(void *ctx, const struct editSettings *edit, int variant);
+
+//fan-out: the variants of one cia, shared out between threads
+struct fanOut {
+	struct job *job;
+	buildFunc build;
+	void *ctx;
+	const char **results;
+	int next;	//next variant a thread should pick up
+	pthread_mutex_t lock;
+};
+
+static void* fanOutWorker(void *arg) {
+	struct fanOut *f = arg;
+	int i;
+
+	while(1) {
+		pthread_mutex_lock(&f->lock);
+		i = f->next++;
+		pthread_mutex_unlock(&f->lock);
+		if(i >= f->job->nVariants)
+			break;
+		f->results[i] = f->build(f->ctx, &f->job->variants[i], i);
+	}
+	return NULL;
+}
+
+//build the output for every variant at once, or just the one for job->settings if there aren't any
+static const char* buildOutputs(struct job *job, buildFunc build, void *ctx) {
+	struct fanOut f;
+	pthread_t *threads;
+	int i, nThreads;
+	const char *result = NULL;
+
+	if(job->nVariants == 0)
+		return build(ctx, &job->settings, -1);
+
+	nThreads = cpuCount();
+	if(nThreads > job->nVariants) nThreads = job->nVariants;
+	if(nThreads < 1) nThreads = 1;
+	f.job = job;
+	f.build = build;
+	f.ctx = ctx;
+	f.next = 0;
+	f.results = calloc(job->nVariants, sizeof(const char*));
+	threads = calloc(nThreads, sizeof(pthread_t));
+	if(!f.results || !threads) {
+		free(f.results);
+		free(threads);
+		return "can't allocate memory (variants)";
+	}
+	fprintf(job->log, "==> Building %d variant%s\n", job->nVariants, job->nVariants==1?"":"s");
+	pthread_mutex_init(&f.lock, NULL);
+
+	for(i=0; i<nThreads; i++) {
+		if(0 != pthread_create(&threads[i], NULL, fanOutWorker, &f))
+			break;
+	}
+	if(i == 0)	//couldn't start any threads, so do them all on this one
+		fanOutWorker(&f);
+	while(i-- > 0)
+		pthread_join(threads[i], NULL);
+	pthread_mutex_destroy(&f.lock);
+
+	//one failure fails the job, but every variant gets its say
+	for(i=0; i<job->nVariants; i++) {
+		fprintf(job->log, "==> Variant %s: %s\n", job->variants[i].name, f.results[i] ? f.results[i] : "Success!");
+		if(f.results[i] && !result)
+			result = "a variant failed, see above";
+	}
+	free(f.results);
+	free(threads);
+	return result;
+}
+
+//run one of the external tools, sending its output wherever this job's output goes
+//argv[0] is the tool's name, and gets replaced with where it is; returns the tool's exit code, or -1 if it didn't run
+static int runTool(struct job *job, const char *name, const char *argv[]) {
+	char tool[4096], shown[16384];
+	struct traceSpan span;
+	size_t used = 0;
+	int exitCode, i;
+
+	toolPath(tool, sizeof(tool), argv[0]);
+	argv[0] = tool;
+	for(i=0; argv[i] && used < sizeof(shown); i++)
+		used += snprintf(shown + used, sizeof(shown) - used, strchr(argv[i], ' ') ? "%s\"%s\"" : "%s%s", i ? " " : "", argv[i]);
+	fprintf(job->log, "==> %s\n", shown);
+	fflush(job->log);
+	traceBegin(&span, name);
+	exitCode = runProgram(argv, job->logName);
+	traceEnd(&span, job, 0, 0, exitCode);
+	return exitCode;
+}
+
+//path to one of the files the tools unpack
+static void unpackedPath(char *path, size_t size, const char *dir, const char *name) {
+	snprintf(path, size, "%s" PATH_SEP "%s", dir, name);
+}
+
+//map one of the files the tools unpacked
+static const char* mapUnpacked(struct fileMap *map, const char *dir, const char *name) {
+	char path[8192];
+	unpackedPath(path, sizeof(path), dir, name);
+	return mapFile(map, path);
+}
+
+//everything the outputs of an unpack are built from -- only read once the builds start
+struct rebuild {
+	struct job *job;
+	const struct cia *cia;
+	struct codeBin code;
+	const struct fileMap *src;	//where the main cxi is, and where in there
+	u64 srcOffset, srcSize;
+	const char *ncchResult;	//NULL if we can rebuild the cxi natively
+	struct ncchHeader ncch;
+	struct stage *stage;
+	const char *unpackDir;	//where the tools unpacked to
+	const struct fileMap *dumps;	//decrypted dumps of the other contents of an encrypted cia, or NULL
+};
+
+//exefs => cxi => cia for one edit
+static const char* rebuildOutput(void *ctx, const struct editSettings *edit, int variant) {
+	const struct rebuild *r = ctx;
+	struct job *job = r->job;
+	const struct cia *cia = r->cia;
+	char exefsName[4096], newCiaName[4096], tag[16] = "", name[64];
+	const char *resultStr;
+	struct config cfg = r->code.cfg;
+	struct stageFile modified;
+	const struct fileMap **replacements = NULL;
+	u8 *newExefs = NULL;
+	u32 newExefsSize;
+	struct traceSpan span;
+	int i;
+
+	memset(&modified, 0, sizeof(modified));
+	if(variant >= 0)
+		snprintf(tag, sizeof(tag), ".%d", variant);	//variants are built side by side, so keep their files apart
+	applyEdits(edit, job, &cfg);
+	logSaveTiming(job, edit, &cfg);
+	resultStr = buildExefs(job, &r->code, edit, &cfg, &newExefs, &newExefsSize);
+	if(resultStr) goto done;
+
+	//exefs etc => cxi -- everything but the exefs is copied straight from the original, unless the NCCH is encrypted
+	if(!r->ncchResult) {
+		fprintf(job->log, "==> Rebuilding cxi%s\n", tag);
+		traceBegin(&span, "rebuild cxi");
+		snprintf(name, sizeof(name), "modified%s.cxi", tag);
+		resultStr = stageCreate(r->stage, &modified, name);
+		if(!resultStr) resultStr = ncchRebuild(r->src, r->srcOffset, r->srcSize, newExefs, newExefsSize, modified.fp);
+		if(!resultStr) resultStr = stageFinish(&modified);
+		traceEnd(&span, job, r->srcSize - (u64)r->ncch.exefsSize * NCCH_MEDIA_UNIT, resultStr ? 0 : modified.map.size, TRACE_NO_EXIT_CODE);
+	} else {
+		char cxi[4096], header[4096], exh[4096], romfs[4096];
+		const char *argv[] = {"3dstool", "-ctf", "cxi", cxi, "--header", header, "--exh", exh, "--exefs", exefsName, "--romfs", romfs, NULL};
+		snprintf(exefsName, sizeof(exefsName), "%s" PATH_SEP "newExefs%s.bin", job->tmpName, tag);
+		resultStr = writeBuffer(exefsName, newExefs, newExefsSize);
+		if(resultStr) goto done;
+		snprintf(cxi, sizeof(cxi), "%s" PATH_SEP "modified%s.cxi", job->tmpName, tag);
+		unpackedPath(header, sizeof(header), r->unpackDir, "ncchheader.bin");
+		unpackedPath(exh, sizeof(exh), r->unpackDir, "exheader.bin");
+		unpackedPath(romfs, sizeof(romfs), r->unpackDir, "romfs.bin");
+		if(runTool(job, "3dstool -ctf cxi", argv)) { resultStr = "3dstool -ctf cxi failed"; goto done; }
+		resultStr = mapFile(&modified.map, cxi);
+	}
+	if(resultStr) goto done;
+
+	//now reassemble the cia around the modified cxi -- other contents (like a manual) pass straight through,
+	//except for encrypted cias where we use the decrypted dumps instead
+	replacements = calloc(cia->nContents, sizeof(*replacements));
+	if(!replacements) { resultStr = "can't allocate memory (content list)"; goto done; }
+	for(i=0; i<cia->nContents; i++) {
+		if(i == cia->mainContent)
+			replacements[i] = &modified.map;
+		else if(r->dumps)
+			replacements[i] = &r->dumps[i];
+	}
+	makeEditName(newCiaName, sizeof(newCiaName), job->fname, edit);
+	fprintf(job->log, "==> Building %s\n", newCiaName);
+	traceBegin(&span, "rebuild cia");
+	resultStr = ciaRebuild(cia, replacements, newCiaName);
+	traceEnd(&span, job, cia->map.size, cia->map.size - cia->contents[cia->mainContent].size + modified.map.size, TRACE_NO_EXIT_CODE);	//near enough
+
+done:
+	free(replacements);
+	stageClose(&modified);
+	free(newExefs);
+	return resultStr;
+}
+
+//unpack the main cxi and its exefs, process code.bin, then put it all back together into a new cia
+static const char* unpackAndRebuild(struct job *job, const struct cia *cia, const char *mainCxi) {
+	const struct editSettings *edit = &job->settings;
+	const struct ciaContent *mainContent = &cia->contents[cia->mainContent];
+	const char *fname = job->fname;
+	char cmd[8192];	//buffer to build paths in
+	char cmdPart[4096];	//prefix of the files the contents go to
+	const char *resultStr = NULL;
+	int i, encrypted = ciaIsEncrypted(cia), native;
+	struct stage stage;
+	struct rebuild r;
+	struct fileMap cxiMap, exhMap, exefsMap;
+	struct fileMap *dumps = NULL;	//decrypted dumps of the other contents of an encrypted cia
+	struct traceSpan span;
+	struct cacheEntry entry;
+	u8 key[SHA256_SIZE];
+
+	memset(&r, 0, sizeof(r));
+	memset(&cxiMap, 0, sizeof(cxiMap));
+	memset(&exhMap, 0, sizeof(exhMap));
+	memset(&exefsMap, 0, sizeof(exefsMap));
+	memset(&entry, 0, sizeof(entry));
+	r.job = job;
+	r.cia = cia;
+	r.stage = &stage;
+	r.unpackDir = job->tmpName;	//where the tools unpack to: the temp dir or a cache entry
+
+	//a decrypted cxi gets split up natively unless the pieces are being extracted; otherwise 3dstool does it on disk
+	//an encrypted cia can't tell us until ctrtool has dumped it
+	r.src = &cia->map;
+	r.srcOffset = mainContent->offset;
+	r.srcSize = mainContent->size;
+	r.ncchResult = encrypted ? "cia is encrypted" : ncchParse(r.src->data + r.srcOffset, r.srcSize, &r.ncch);
+	native = !r.ncchResult && !edit->extractAll;
+
+	//what the external tools unpack only depends on the cia, so it can come from the cache
+	if(job->cache && !native && !edit->extractAll) {
+		traceBegin(&span, "hash cia");
+		sha256(cia->map.data, cia->map.size, key);
+		traceEnd(&span, job, cia->map.size, 0, TRACE_NO_EXIT_CODE);
+		resultStr = cacheOpen(job->cache, key, &entry);
+		if(resultStr) {
+			fprintf(job->log, "WARNING: not using the cache: %s\n", resultStr);
+			resultStr = NULL;
+		} else {
+			r.unpackDir = entry.dir;
+			fprintf(job->log, "==> %s %s\n", entry.hit ? "Using cached unpack in" : "Unpacking into cache at", entry.dir);
 		}
-		if(dumpFile[i] != '.') {
-			fclose(fp);
-			return "irregular dump file name";
+	}
+
+	//small titles that never need to be seen by an external tool or the user are staged in memory
+	stageInit(&stage, job->tmpName, native && r.srcSize <= job->ramLimit);
+	stageReset(&stage);
+
+	//contents go to disk for ctrtool and 3dstool, or the user -- unless the cache already has them
+	snprintf(cmdPart, sizeof(cmdPart), "%s" PATH_SEP "file", r.unpackDir);
+	if(!entry.hit) {
+		if(encrypted) {
+			const char *argv[] = {"ctrtool", "--contents", cmdPart, fname, NULL};
+			if(runTool(job, "ctrtool --contents", argv)) { resultStr = "ctrtool --contents failed"; goto done; }
+		} else {
+			traceBegin(&span, "dump contents");
+			if(edit->extractAll) {
+				fprintf(job->log, "==> Writing %d content%s to %s\n", cia->nContents, cia->nContents==1?"":"s", r.unpackDir);
+				resultStr = ciaWriteContents(cia, cmdPart);
+				traceEnd(&span, job, cia->contentSize, cia->contentSize, TRACE_NO_EXIT_CODE);
+			} else if(!native) {
+				fprintf(job->log, "==> Writing main content to %s\n", r.unpackDir);
+				resultStr = ciaWriteContent(cia, mainContent, cmdPart);
+				traceEnd(&span, job, mainContent->size, mainContent->size, TRACE_NO_EXIT_CODE);
+			}
+			if(resultStr) goto done;
 		}
+	}
 
-		//we're now at the . between the file and index numbers, do index number the same way
-		for(i++; dumpFile[i]=='0'; i++);
-		if(dumpFile[i] == '\0' || dumpFile[i] == '.' || isspace(dumpFile[i])) {
-			//we reached the ending . before seeing a non-0 digit, number is 0
-			strcpy(indNum, "0");
-		} else if(isxdigit(dumpFile[i])) {
-			//found one or more digits, copy them
-			for(j=0; j<sizeof(indNum)-1 && isxdigit(dumpFile[i]); i++)
-				indNum[j++] = dumpFile[i];
-			indNum[j] = '\0';
+	//the main cxi is read straight out of the cia, unless it's encrypted and was dumped with ctrtool
+	if(encrypted) {
+		resultStr = mapUnpacked(&cxiMap, r.unpackDir, mainCxi);
+		if(resultStr) goto done;
+		r.src = &cxiMap;
+		r.srcOffset = 0;
+		r.srcSize = cxiMap.size;
+		r.ncchResult = ncchParse(r.src->data, r.srcSize, &r.ncch);
+		native = !r.ncchResult && !edit->extractAll;
+	}
+	if(!native && !entry.hit) {
+		char header[4096], exh[4096], exefs[4096], romfs[4096];
+		const char *argv[] = {"3dstool", "-xtf", "cxi", cmd, "--header", header, "--exh", exh, "--exefs", exefs, "--romfs", romfs, NULL};
+		unpackedPath(cmd, sizeof(cmd), r.unpackDir, mainCxi);
+		unpackedPath(header, sizeof(header), r.unpackDir, "ncchheader.bin");
+		unpackedPath(exh, sizeof(exh), r.unpackDir, "exheader.bin");
+		unpackedPath(exefs, sizeof(exefs), r.unpackDir, "exefs.bin");
+		unpackedPath(romfs, sizeof(romfs), r.unpackDir, "romfs.bin");
+		if(runTool(job, "3dstool -xtf cxi", argv)) { resultStr = "3dstool -xtf cxi failed"; goto done; }
+	}
+
+	//everything the tools unpack is there now -- keep it for next time
+	if(entry.cache && !entry.hit) {
+		if(cxiMap.data)
+			unmapFile(&cxiMap);	//Windows won't move a dir with a file in it mapped
+		traceBegin(&span, "fill cache");
+		resultStr = cacheCommit(&entry);
+		traceEnd(&span, job, 0, 0, TRACE_NO_EXIT_CODE);
+		if(resultStr) goto done;
+		r.unpackDir = entry.dir;
+		if(encrypted) {
+			resultStr = mapUnpacked(&cxiMap, r.unpackDir, mainCxi);
+			if(resultStr) goto done;
+			r.src = &cxiMap;
 		}
+	}
+	fprintf(job->log, "==> Staging in %s\n", stage.inMemory ? "memory" : job->tmpName);
 
-		//construct -content part of command for this file
-		snprintf(cmdPart, sizeof(cmdPart), " -content \"%s\\%s\":%s:%s",
-				tmpName, 0==strcmp(dumpFile, mainCxi)?"modified.cxi":dumpFile, fileNum, indNum);
-		strncat(cmd, cmdPart, sizeof(cmd));
+	//process code.bin from the exefs -- it stays unpacked for building the outputs from
+	if(native) {
+		resultStr = unpackExefs(job, r.src->data + r.srcOffset + sizeof(struct ncchHeader), r.ncch.exheaderSize,
+				r.src->data + r.srcOffset + (u64)r.ncch.exefsOffset * NCCH_MEDIA_UNIT, (u64)r.ncch.exefsSize * NCCH_MEDIA_UNIT,
+				&r.code);
+	} else {
+		if(mapUnpacked(&exhMap, r.unpackDir, "exheader.bin")) { resultStr = "can't open exheader.bin"; goto done; }
+		if(mapUnpacked(&exefsMap, r.unpackDir, "exefs.bin")) { resultStr = "can't open exefs.bin"; goto done; }
+		resultStr = unpackExefs(job, exhMap.data, exhMap.size, exefsMap.data, exefsMap.size, &r.code);
 	}
-	fclose(fp);
+	if(resultStr) goto done;
 
-	//generate a name for the modified cia
-	strncpy(newCiaName, fname, sizeof(newCiaName));
-	//remove extension
-	for(i=strlen(newCiaName)-1; i>=0 && newCiaName[i]!='.'; i--) newCiaName[i]='\0';
-	newCiaName[i]='\0';
-	//add note as to what's changed
-	strncat(newCiaName, " (edit", sizeof(newCiaName));
-	if(setSleepButtons)
-		strncat(newCiaName, "-sleepbtns", sizeof(newCiaName));
-	if(setLcdGhosting)
-		strncat(newCiaName, "-lcdghost", sizeof(newCiaName));
-	if(setVideoLUT)
-		strncat(newCiaName, "-filter", sizeof(newCiaName));
-	strncat(newCiaName, ").cia", sizeof(newCiaName));
-
-	//finish and run the makerom command
-	snprintf(cmdPart, sizeof(cmdPart), " -o \"%s\"", newCiaName);
-	strncat(cmd, cmdPart, sizeof(cmd));
-	printf("==> %s\n", cmd);
-	if(system(cmd)) return "makerom failed";
-
-	return "Success!";
+	//we can stop here if we're just giving info; otherwise we need to rebuild a modified cia
+	if(edit->onlyInfo) {
+		resultStr = "Success!";
+		goto done;
+	}
+
+	//the other contents of an encrypted cia come from ctrtool's decrypted dumps
+	if(encrypted) {
+		dumps = calloc(cia->nContents, sizeof(*dumps));
+		if(!dumps) { resultStr = "can't allocate memory (content list)"; goto done; }
+		for(i=0; i<cia->nContents; i++) {
+			if(i == cia->mainContent)
+				continue;
+			ciaContentFileName(cmd, sizeof(cmd), cmdPart, &cia->contents[i]);
+			resultStr = mapFile(&dumps[i], cmd);
+			if(resultStr) goto done;
+		}
+		r.dumps = dumps;
+	}
+
+	resultStr = buildOutputs(job, rebuildOutput, &r);
+	if(!resultStr)
+		resultStr = "Success!";
+
+done:
+	if(dumps) {
+		for(i=0; i<cia->nContents; i++)
+			if(dumps[i].data)
+				unmapFile(&dumps[i]);
+	}
+	free(dumps);
+	exefsFree(&r.code.exefs);
+	if(exhMap.data)
+		unmapFile(&exhMap);
+	if(exefsMap.data)
+		unmapFile(&exefsMap);
+	if(cxiMap.data)
+		unmapFile(&cxiMap);
+	cacheClose(&entry);
+	return resultStr;
 }
 
-//delete the temp dir if we aren't extracting files
-void cleanup(void) {
-	if(!extractAll) {
-		char cmd[8192];
-		snprintf(cmd, sizeof(cmd), "rd /s /q \"%s\" 2>NUL", tmpName);
-		system(cmd);
+//what the fast path needs to patch one output
+struct patchContext {
+	struct job *job;
+	const struct cia *cia;
+	const struct ciaCode *code;
+	const struct config *cfg;
+	u32 cfgOffset;
+};
+
+//patch the config for one edit into a copy of the cia
+static const char* patchOutput(void *ctx, const struct editSettings *edit, int variant) {
+	const struct patchContext *p = ctx;
+	char newCiaName[4096];
+	struct config cfg = *p->cfg;
+	struct traceSpan span;
+	const char *result;
+	(void)variant;	//only there to match buildFunc -- the edit is all that says where the output goes
+
+	applyEdits(edit, p->job, &cfg);
+	logSaveTiming(p->job, edit, &cfg);
+	makeEditName(newCiaName, sizeof(newCiaName), p->job->fname, edit);
+	traceBegin(&span, "patch config");
+	result = ciaPatchConfig(p->cia, p->code, p->job->fname, &cfg, p->cfgOffset, newCiaName);
+	traceEnd(&span, p->job, p->code->content->size, p->cia->map.size, TRACE_NO_EXIT_CODE);
+	if(!result)
+		fprintf(p->job->log, "==> Patched config and hashes into '%s'\n", newCiaName);
+	return result;
+}
+
+//whether any output of a job edits the ROM, which the fast path can't do
+//trimming only counts once the ROM has been scanned for padding
+static int jobEditsRom(const struct job *job) {
+	int i;
+	if(editsRom(job, &job->settings))
+		return 1;
+	for(i=0; i<job->nVariants; i++)
+		if(editsRom(job, &job->variants[i]))
+			return 1;
+	return 0;
+}
+
+//process one cia -- patched in place when possible, otherwise unpacked and rebuilt
+const char* process(struct job *job) {
+	const struct editSettings *edit = &job->settings;
+	const char *fname = job->fname;
+	char mainCxi[4096];	//name of main dumped cxi - official GBA VCs contain a second with a manual which we want to preserve but otherwise don't care about
+	int i;
+	const char *resultStr = NULL;
+	struct cia cia;
+	struct traceSpan span;
+	fprintf(job->log, "\n==> Processing %s\n", fname);
+
+	//temp dir name stuff -- otherwise we use the workspace the batch gave us
+	if(edit->extractAll) {
+		strncpy(job->tmpName, fname, sizeof(job->tmpName));
+		i = strlen(job->tmpName) - 4;
+		if(0 == strcasecmp(&job->tmpName[i], ".cia"))
+			job->tmpName[i] = '\0';
+		strncat(job->tmpName, ".dump", sizeof(job->tmpName));
+	}
+
+	//parse the cia natively -- this also tells us which content is the game from the TMD
+	//NSUI uses a single cxi at 0:0, while Nintendo VCs have 0:2 and then a manual at 1:3
+	traceBegin(&span, "open cia");
+	resultStr = ciaOpen(&cia, fname);
+	traceEnd(&span, job, 0, 0, TRACE_NO_EXIT_CODE);
+	if(resultStr) return resultStr;
+	if(job->info)
+		job->info->titleId = cia.titleId;
+	ciaPrintInfo(&cia, job->log);
+	ciaContentFileName(mainCxi, sizeof(mainCxi), "file", &cia.contents[cia.mainContent]);
+
+	//fast path: decrypted cias get read and patched right where they are, no unpacking at all
+	job->romTrimmable = 0;
+	if(!edit->extractAll && !(jobEditsRom(job) && !edit->onlyInfo)) {
+		struct ciaCode code;
+		struct config cfg;
+		struct patchContext ctx = {job, &cia, &code, &cfg, 0};
+		resultStr = ciaFindCode(&cia, &code);
+		if(!resultStr) {
+			//trim_rom needs a rebuild only if there's padding to cut, so look before printing anything
+			if(!edit->onlyInfo)
+				job->romTrimmable = romTrimmable(code.code, code.codeSize);
+			if(!edit->onlyInfo && jobEditsRom(job)) {
+				fprintf(job->log, "==> ROM has padding to trim, unpacking to rebuild it\n");
+			} else {
+				traceBegin(&span, "processCodeBin");
+				resultStr = processCodeBin(code.code, code.codeSize, &cia.map, job, &cfg, &ctx.cfgOffset);
+				traceEnd(&span, job, code.codeSize, 0, TRACE_NO_EXIT_CODE);
+				if(!resultStr && !edit->onlyInfo)
+					resultStr = buildOutputs(job, patchOutput, &ctx);
+				ciaClose(&cia);
+				return resultStr ? resultStr : "Success!";
+			}
+		} else {
+			fprintf(job->log, "==> Can't patch in place (%s), unpacking instead\n", resultStr);
+		}
 	}
+
+	resultStr = unpackAndRebuild(job, &cia, mainCxi);
+	ciaClose(&cia);
+	return resultStr;
+}
+
+//delete the temp dir if we aren't extracting files
+void cleanup(struct job *job) {
+	if(!job->settings.extractAll)
+		removeTree(job->tmpName);
 }
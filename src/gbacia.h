@@ -3,9 +3,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <strings.h>
-#include <malloc.h>	//XXX: Windows only. Linux uses alloca.h.
+#ifdef _WIN32
+#include <malloc.h>	//alloca
+#else
+#include <alloca.h>
+#endif
 
 //define signed/unsigned data types by size if we don't already have them
 #ifndef u8
@@ -15,6 +20,8 @@ typedef unsigned short u16;
 typedef signed short s16;
 typedef unsigned int u32;
 typedef signed int s32;
+typedef unsigned long long u64;
+typedef signed long long s64;
 #endif
 
 //Save type enum
@@ -93,20 +100,59 @@ struct footer {	//0x10 bytes
 
 
 
+//what to do to each cia -- the questionnaire fills one in, and every job gets its own copy
+struct editSettings {
+	int onlyInfo, dumpRom, extractAll, setSleepButtons, setLcdGhosting, setVideoLUT, setSaveType;
+	int saveTiming;	//enum saveTiming profile to set the save chip timings to, by chip; 0 to leave them
+	int trimRom;	//cut the padding off the end of the ROM, when that looks safe
+	int fixSaveType;	//set the save type to what the ROM's save library says, when it's wrong and that's enough to go on
+	u16 sleepButtons;
+	u32 saveType;
+	u32 lcdGhosting;
+	u8 videoLUT[3 * 256];
+	char romPatch[4096];	//IPS, UPS or BPS patch to apply to the ROM; empty for none
+	char romFile[4096];	//ROM to put in place of the one there; empty for none
+	char name[64];	//fan-out variant name, added to the output name; empty for none
+};
+
+//one cia being worked on
+struct job {
+	const char *fname;	//input cia
+	struct editSettings settings;	//copied in before the job starts and never changed after that
+	const struct editSettings *variants;	//fan-out: one output per variant, and settings only does info and dumping
+	int nVariants;	//0 for the usual single output from settings
+	char tmpName[4096];	//this job's own temp dir for dumping
+	u64 ramLimit;	//the main content gets staged in memory rather than tmpName if it's no bigger than this
+	char logName[4096];	//where its output goes when jobs run in parallel; empty means stdout
+	FILE *log;
+	int worker;	//which worker thread is running it, for tracing
+	struct cache *cache;	//where to keep what the external tools unpack, shared by the whole batch; NULL for none
+	const struct datIndex *dat;	//DAT to check dumped ROMs against, shared by the whole batch; NULL for none
+	char datStatus[256];	//DAT verdict for the report at the end, empty if there wasn't one
+	struct report *report;	//JSON report the job goes into instead of the text log; NULL for none
+	struct titleInfo *info;	//what processCodeBin found, for the JSON report; NULL for none
+	u32 fixedSaveType;	//what the save type should be, from the ROM's save library; 0xffffffff if it's right or we can't tell
+	int romTrimmable;	//processCodeBin found padding that trim_rom can cut off the ROM
+	const char *status;	//result for the report at the end
+};
+
 //values that we'll prompt for and set in the cia (defined in gbacia.c)
-extern int onlyInfo, dumpRom, extractAll, setSleepButtons, setLcdGhosting, setVideoLUT;
-extern u16 sleepButtons;
-extern u32 lcdGhosting;
-extern u8 videoLUT[3 * 256];
-extern char tmpName[4096];	//where we construct the name of the temp dir for dumping
+extern struct editSettings edits;
 
 //function declarations
 const char* saveTypeToString(u32 saveType);
+u32 encodeSaveType(const char *name);
 const char* sectionTypeToString(u32 sectionType);
 const char* decodeButtons(u16 mask);
 u16 encodeButtons(const char *buttons);
-const char* processCodeBin(const char *codeBin, const char *ciaName);
-const char* process(char *fname);
-void cleanup(void);
+struct fileMap;
+struct datIndex;
+struct cache;
+struct report;
+struct titleInfo;
+const char* processCodeBin(const u8 *code, u32 codeSize, const struct fileMap *codeMap, struct job *job,
+		struct config *newCfg, u32 *cfgOffset);
+const char* process(struct job *job);
+void cleanup(struct job *job);
 
 #endif /* __GBACIA_H__ */
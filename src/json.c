@@ -0,0 +1,193 @@
+/* agb_edit buffered JSON writer */
+
+#include "json.h"
+
+const char* jsonOpen(struct jsonWriter *w, const char *fname) {
+	memset(w, 0, sizeof(struct jsonWriter));
+	w->buf = malloc(JSON_BUFFER_SIZE);
+	if(!w->buf) return "can't allocate memory (JSON buffer)";
+	w->out = fopen(fname, "wb");
+	if(!w->out) {
+		free(w->buf);
+		w->buf = NULL;
+		return "can't create file";
+	}
+	return NULL;
+}
+
+static void flush(struct jsonWriter *w) {
+	if(w->used && fwrite(w->buf, 1, w->used, w->out) != w->used && !w->err)
+		w->err = "can't write file";
+	w->used = 0;
+}
+
+const char* jsonClose(struct jsonWriter *w) {
+	flush(w);
+	if(fclose(w->out) != 0 && !w->err)
+		w->err = "can't write file";
+	free(w->buf);
+	w->buf = NULL;
+	return w->err;
+}
+
+//make room for size more bytes -- size must be less than JSON_BUFFER_SIZE
+static char* reserve(struct jsonWriter *w, size_t size) {
+	if(w->used + size > JSON_BUFFER_SIZE)
+		flush(w);
+	return w->buf + w->used;
+}
+
+static void put(struct jsonWriter *w, const char *s, size_t size) {
+	memcpy(reserve(w, size), s, size);
+	w->used += size;
+}
+
+static void putChar(struct jsonWriter *w, char c) {
+	*reserve(w, 1) = c;
+	w->used++;
+}
+
+//start a value, after a comma if need be
+static void beginValue(struct jsonWriter *w) {
+	if(w->needComma)
+		putChar(w, ',');
+	w->needComma = 1;
+}
+
+void jsonBeginObject(struct jsonWriter *w) {
+	beginValue(w);
+	putChar(w, '{');
+	w->needComma = 0;
+}
+
+void jsonEndObject(struct jsonWriter *w) {
+	putChar(w, '}');
+	w->needComma = 1;
+}
+
+void jsonBeginArray(struct jsonWriter *w) {
+	beginValue(w);
+	putChar(w, '[');
+	w->needComma = 0;
+}
+
+void jsonEndArray(struct jsonWriter *w) {
+	putChar(w, ']');
+	w->needComma = 1;
+}
+
+void jsonKey(struct jsonWriter *w, const char *key) {
+	jsonString(w, key);
+	putChar(w, ':');
+	w->needComma = 0;
+}
+
+//length of the well formed UTF-8 sequence at s, or 0 if it isn't one (overlong, surrogate, past U+10FFFF, cut short)
+int utf8Length(const u8 *s) {
+	int n, i;
+	u32 cp;
+	if(s[0] < 0x80) return 1;
+	else if(s[0] >= 0xc2 && s[0] < 0xe0) { n = 2; cp = s[0] & 0x1f; }
+	else if(s[0] >= 0xe0 && s[0] < 0xf0) { n = 3; cp = s[0] & 0x0f; }
+	else if(s[0] >= 0xf0 && s[0] < 0xf5) { n = 4; cp = s[0] & 0x07; }
+	else return 0;
+	for(i=1; i<n; i++) {
+		if((s[i] & 0xc0) != 0x80) return 0;	//this catches the terminator too
+		cp = (cp << 6) | (s[i] & 0x3f);
+	}
+	if((n == 3 && cp < 0x800) || (n == 4 && (cp < 0x10000 || cp > 0x10ffff)) || (cp >= 0xd800 && cp < 0xe000))
+		return 0;
+	return n;
+}
+
+//file names come from the disk as raw bytes, so anything that isn't UTF-8 becomes U+FFFD
+void jsonString(struct jsonWriter *w, const char *s) {
+	static const char hex[] = "0123456789abcdef";
+	char *p;
+	int n;
+
+	beginValue(w);
+	putChar(w, '"');
+	for(; *s; s++) {
+		u8 c = *s;
+		p = reserve(w, 6);
+		if(c == '"' || c == '\\') {
+			p[0] = '\\';
+			p[1] = c;
+			w->used += 2;
+		} else if(c < 0x20) {
+			memcpy(p, "\\u00", 4);
+			p[4] = hex[c >> 4];
+			p[5] = hex[c & 0xf];
+			w->used += 6;
+		} else if(c < 0x80) {
+			p[0] = c;
+			w->used++;
+		} else if((n = utf8Length((const u8*)s)) != 0) {
+			memcpy(p, s, n);
+			w->used += n;
+			s += n - 1;
+		} else {
+			memcpy(p, "\\ufffd", 6);
+			w->used += 6;
+		}
+	}
+	putChar(w, '"');
+}
+
+void jsonU64(struct jsonWriter *w, u64 n) {
+	char tmp[24];
+	int len;
+	beginValue(w);
+	len = snprintf(tmp, sizeof(tmp), "%llu", n);
+	put(w, tmp, len);
+}
+
+void jsonBool(struct jsonWriter *w, int b) {
+	beginValue(w);
+	if(b)
+		put(w, "true", 4);
+	else
+		put(w, "false", 5);
+}
+
+void jsonHex(struct jsonWriter *w, const u8 *data, size_t size) {
+	static const char hex[] = "0123456789abcdef";
+	char *p;
+
+	beginValue(w);
+	putChar(w, '"');
+	for(size_t i=0; i<size; i++) {
+		p = reserve(w, 2);
+		p[0] = hex[data[i] >> 4];
+		p[1] = hex[data[i] & 0xf];
+		w->used += 2;
+	}
+	putChar(w, '"');
+}
+
+void jsonBase64(struct jsonWriter *w, const u8 *data, size_t size) {
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *p;
+	u32 v;
+
+	beginValue(w);
+	putChar(w, '"');
+	for(size_t i=0; i<size; i+=3) {
+		v = data[i] << 16;
+		if(i+1 < size) v |= data[i+1] << 8;
+		if(i+2 < size) v |= data[i+2];
+		p = reserve(w, 4);
+		p[0] = digits[v >> 18];
+		p[1] = digits[(v >> 12) & 0x3f];
+		p[2] = i+1 < size ? digits[(v >> 6) & 0x3f] : '=';
+		p[3] = i+2 < size ? digits[v & 0x3f] : '=';
+		w->used += 4;
+	}
+	putChar(w, '"');
+}
+
+void jsonEndLine(struct jsonWriter *w) {
+	putChar(w, '\n');
+	w->needComma = 0;
+}
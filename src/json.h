@@ -0,0 +1,41 @@
+#ifndef __JSON_H__
+#define __JSON_H__
+
+/* Minimal buffered JSON writer
+ * Output collects in one big buffer and goes out in large writes, so
+ * writing a record for every title of a big library costs next to nothing.
+ * Commas are put in automatically; the caller just has to nest things right.
+ * Write errors are remembered and reported by jsonClose.
+ */
+
+#include "gbacia.h"
+
+#define JSON_BUFFER_SIZE (1 << 20)
+
+struct jsonWriter {
+	FILE *out;
+	char *buf;
+	size_t used;
+	int needComma;	//something was just written at this level, so the next value needs a comma first
+	const char *err;
+};
+
+//both return a string on failure, NULL on success
+const char* jsonOpen(struct jsonWriter *w, const char *fname);
+const char* jsonClose(struct jsonWriter *w);
+void jsonBeginObject(struct jsonWriter *w);
+void jsonEndObject(struct jsonWriter *w);
+void jsonBeginArray(struct jsonWriter *w);
+void jsonEndArray(struct jsonWriter *w);
+void jsonKey(struct jsonWriter *w, const char *key);	//the next value goes with this key
+void jsonString(struct jsonWriter *w, const char *s);	//bytes that aren't valid UTF-8 come out as U+FFFD
+void jsonU64(struct jsonWriter *w, u64 n);
+void jsonBool(struct jsonWriter *w, int b);
+void jsonHex(struct jsonWriter *w, const u8 *data, size_t size);	//as a string of hex digits
+void jsonBase64(struct jsonWriter *w, const u8 *data, size_t size);	//as a base64 string
+void jsonEndLine(struct jsonWriter *w);	//end one NDJSON record
+
+//length of the well formed UTF-8 sequence at s, or 0 if it isn't one -- for other JSON writers, like the trace
+int utf8Length(const u8 *s);
+
+#endif /* __JSON_H__ */
@@ -0,0 +1,181 @@
+/* agb_edit backward LZ77 compression and decompression for exefs .code */
+
+#include "lz.h"
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (0xf + LZ_MIN_MATCH)
+#define LZ_MIN_DIST 3	//the format can't express a distance of 1 or 2
+#define LZ_MAX_DIST (0xfff + LZ_MIN_DIST)
+#define LZ_FOOTER_SIZE 8
+#define LZ_MAX_TOP 0xffffff	//the compressed part's size only gets 24 bits in the footer
+#define LZ_HASH_BITS 15
+#define LZ_CHAIN_LIMIT 128	//how many earlier positions to try per match -- trades speed for size
+
+static u32 getLE32(const u8 *p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((u32)p[3]<<24);
+}
+
+static void putLE32(u8 *p, u32 v) {
+	p[0] = v; p[1] = v>>8; p[2] = v>>16; p[3] = v>>24;
+}
+
+const char* lzDecompress(const u8 *in, u32 inSize, u8 **out, u32 *outSize) {
+	u32 top, bottom, size, src, end, dst, dist, len, j;
+	u8 flags, hi, *buf;
+	int i;
+
+	if(inSize < LZ_FOOTER_SIZE) return "compressed data too small";
+	top = getLE32(in + inSize - 8) & 0xffffff;
+	bottom = in[inSize - 5];
+	if(bottom < LZ_FOOTER_SIZE || bottom > LZ_FOOTER_SIZE + 3 || top < bottom || top > inSize)
+		return "bad compression footer";
+	size = inSize + getLE32(in + inSize - 4);
+	if(size < inSize) return "bad compression footer";
+	buf = malloc(size);
+	if(!buf) return "can't allocate memory (decompress)";
+
+	//everything in front of the compressed part is stored as-is
+	end = inSize - top;
+	memcpy(buf, in, end);
+
+	//walk the compressed part backwards, filling the output from the end
+	src = inSize - bottom;
+	dst = size;
+	while(src > end) {
+		flags = in[--src];
+		for(i=0; i<8 && src > end; i++) {
+			if(!(flags & (0x80 >> i))) {
+				if(dst <= end) { free(buf); return "compressed data overruns output"; }
+				buf[--dst] = in[--src];
+			} else {
+				if(src - end < 2) { free(buf); return "truncated compressed data"; }
+				hi = in[--src];
+				dist = (((hi & 0xf) << 8) | in[--src]) + LZ_MIN_DIST;
+				len = (hi >> 4) + LZ_MIN_MATCH;
+				if(len > dst - end || dist > size - dst) { free(buf); return "bad match in compressed data"; }
+				for(j=0; j<len; j++, dst--)
+					buf[dst-1] = buf[dst-1+dist];
+			}
+		}
+	}
+	if(dst != end) { free(buf); return "compressed data doesn't fill output"; }
+
+	*out = buf;
+	*outSize = size;
+	return NULL;
+}
+
+//work on the input reversed, since the format runs from the end of the buffer towards the start
+#define REV(i) in[inSize - 1 - (i)]
+
+static u32 hash3(const u8 *in, u32 inSize, u32 q) {
+	return ((REV(q) << 10) ^ (REV(q+1) << 5) ^ REV(q+2)) & ((1 << LZ_HASH_BITS) - 1);
+}
+
+//greedy LZ with hash chains -- the token stream is built in the order the decompressor reads it,
+//and tracks how far it can be cut off while staying safe to decompress in place
+const char* lzCompress(const u8 *in, u32 inSize, u8 **out, u32 *outSize) {
+	s32 *head, *prev;
+	u8 *stream, *buf;
+	u32 q, produced, consumed, bestProduced, bestConsumed, flagPos, raw, pad, total, j;
+	u32 bestLen, bestDist, len, chain;
+	s32 cand;
+	s64 diff, maxDiff;
+	int bit;
+
+	if(inSize < 0x10) return "data too small to compress";
+	head = malloc((1 << LZ_HASH_BITS) * sizeof(s32));
+	prev = malloc((size_t)inSize * sizeof(s32));
+	stream = malloc((size_t)inSize + inSize/8 + 16);
+	if(!head || !prev || !stream) {
+		free(head); free(prev); free(stream);
+		return "can't allocate memory (compress)";
+	}
+	memset(head, 0xff, (1 << LZ_HASH_BITS) * sizeof(s32));
+
+	produced = consumed = 0;
+	bestProduced = bestConsumed = 0;
+	maxDiff = 0;
+	flagPos = 0;
+	bit = 8;
+	q = 0;
+	while(q < inSize) {
+		//start a new flag byte every 8 tokens
+		if(bit == 8) {
+			flagPos = consumed++;
+			stream[flagPos] = 0;
+			bit = 0;
+		}
+
+		//look for the longest match at least LZ_MIN_DIST back
+		bestLen = 0;
+		bestDist = 0;
+		if(q + LZ_MIN_MATCH <= inSize) {
+			cand = head[hash3(in, inSize, q)];
+			for(chain=0; cand >= 0 && chain < LZ_CHAIN_LIMIT; cand = prev[cand], chain++) {
+				if(q - cand < LZ_MIN_DIST) continue;
+				if(q - cand > LZ_MAX_DIST) break;
+				for(len=0; len < LZ_MAX_MATCH && q+len < inSize && REV(cand+len) == REV(q+len); len++);
+				if(len > bestLen) {
+					bestLen = len;
+					bestDist = q - cand;
+					if(len == LZ_MAX_MATCH) break;
+				}
+			}
+		}
+
+		if(bestLen >= LZ_MIN_MATCH) {
+			stream[flagPos] |= 0x80 >> bit;
+			stream[consumed++] = ((bestLen - LZ_MIN_MATCH) << 4) | ((bestDist - LZ_MIN_DIST) >> 8);
+			stream[consumed++] = (bestDist - LZ_MIN_DIST) & 0xff;
+		} else {
+			bestLen = 1;
+			stream[consumed++] = REV(q);
+		}
+		bit++;
+
+		//add the positions we just covered to the hash chains
+		for(j=0; j<bestLen; j++, q++) {
+			if(q + LZ_MIN_MATCH <= inSize) {
+				u32 h = hash3(in, inSize, q);
+				prev[q] = head[h];
+				head[h] = q;
+			}
+		}
+		produced = q;
+
+		//we can stop after this token if the decompressor never gets ahead of its input up to here
+		if(consumed + LZ_FOOTER_SIZE + 3 > LZ_MAX_TOP)
+			break;
+		diff = (s64)produced - consumed;
+		if(diff >= maxDiff) {
+			maxDiff = diff;
+			bestProduced = produced;
+			bestConsumed = consumed;
+		}
+	}
+	free(head);
+	free(prev);
+
+	//raw prefix, then the compressed part reversed, then padding and footer
+	raw = inSize - bestProduced;
+	pad = (4 - ((raw + bestConsumed) & 3)) & 3;
+	total = raw + bestConsumed + pad + LZ_FOOTER_SIZE;
+	if(bestProduced == 0 || total >= inSize) {
+		free(stream);
+		return "data doesn't compress";
+	}
+	buf = malloc(total);
+	if(!buf) { free(stream); return "can't allocate memory (compress)"; }
+	memcpy(buf, in, raw);
+	for(j=0; j<bestConsumed; j++)
+		buf[raw + j] = stream[bestConsumed - 1 - j];
+	memset(buf + raw + bestConsumed, 0xff, pad);
+	putLE32(buf + total - 8, ((pad + LZ_FOOTER_SIZE) << 24) | (bestConsumed + pad + LZ_FOOTER_SIZE));
+	putLE32(buf + total - 4, inSize - total);
+	free(stream);
+
+	*out = buf;
+	*outSize = total;
+	return NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+/* Backward LZ77, the compression used for .code in an exefs
+ * The data is decompressed in place from the end of the buffer towards the
+ * start, so the last 8 bytes of a compressed file are a footer:
+ *  u32 bufferTopAndBottom: bits 0-23 = size of the compressed part including
+ *      the footer, bits 24-31 = size of footer plus padding
+ *  u32 originalBottom: how much bigger the file gets when decompressed
+ * Anything in front of the compressed part is stored as-is.
+ */
+
+#include "gbacia.h"
+
+//both return a string on failure, NULL on success; *out is malloc'd and the caller frees it
+const char* lzDecompress(const u8 *in, u32 inSize, u8 **out, u32 *outSize);
+const char* lzCompress(const u8 *in, u32 inSize, u8 **out, u32 *outSize);
+
+#endif /* __LZ_H__ */
@@ -9,15 +9,235 @@
 
 #include "gbacia.h"
 #include "console_ui.h"
+#include "batch.h"
+#include "platform.h"
+#include "stage.h"
+#include "trace.h"
+#include "recipe.h"
+#include "dat.h"
+#include "cache.h"
+#include "catalog.h"
+#include "query.h"
+#include "report.h"
+#include "romedit.h"
 
-//just a table for remembering the status for each file, to print a report at the end
-struct entry {
-	const char *name;
-	const char *status;
-};
+static int headless;	//running from a recipe -- never prompt or wait for a key
+
+static void waitForKey(void) {
+	if(!headless) {
+		printf("Press any key to continue . . . ");
+		fflush(stdout);
+		readKey();
+		printf("\n");
+	}
+}
+
+//a variant without a name is named after its recipe file, minus the path and extension
+static void nameVariant(struct editSettings *variant, const char *fname) {
+	const char *base = fname, *dot;
+	for(const char *p=fname; *p; p++)
+		if(*p == '/' || *p == '\\')
+			base = p + 1;
+	dot = strrchr(base, '.');
+	snprintf(variant->name, sizeof(variant->name), "%.*s", dot ? (int)(dot - base) : (int)strlen(base), base);
+}
+
+//load every -variant recipe -- returns a string on failure, NULL on success, with *bad the file it's about
+static const char* loadVariants(struct editSettings *variants, char **names, int nVariants, const char **bad, int *line) {
+	const char *result;
+	for(int i=0; i<nVariants; i++) {
+		*bad = names[i];
+		result = recipeLoad(names[i], &variants[i], line);
+		if(result) return result;
+		if(variants[i].onlyInfo) return "a variant has to be operation = edit or preset";
+		if(!variants[i].name[0])
+			nameVariant(&variants[i], names[i]);
+		for(int j=0; j<i; j++)
+			if(0 == strcasecmp(variants[i].name, variants[j].name))
+				return "two variants have the same name -- give one a name = line";
+	}
+	return NULL;
+}
 
 int main(int argc, char **argv) {
-	int nFiles = argc-1;
+	int nFiles = 0, nWorkers = cpuCount();
+	u64 ramLimit = STAGE_RAM_LIMIT_DEFAULT;
+	const char *traceName = NULL, *recipeName = NULL, *datName = NULL, *cacheName = NULL, *scanName = NULL, *result;
+	const char *queryName = NULL, *queryText = NULL, *jsonName = NULL;
+	int jsonLut = REPORT_LUT_BASE64, jsonGraph = 0;
+	struct report report;
+	struct titleInfo *infos = NULL;
+	struct catalog catalog;
+	char **queried = NULL;	//fnames plus the titles the query matched
+	u64 cacheSize = CACHE_SIZE_DEFAULT;
+	struct datIndex dat;
+	struct cache cache;
+	int line, nFailed = 0, nVariants = 0;
+	char **fnames = alloca(argc * sizeof(char*));
+	char **variantNames = alloca(argc * sizeof(char*));
+	struct editSettings *variants = NULL;
+
+	//know up front whether there's anyone to wait for
+	for(int i=1; i<argc; i++)
+		if(0 == strcmp(argv[i], "-recipe") || 0 == strcmp(argv[i], "-variant") || 0 == strcmp(argv[i], "-scan")
+				|| 0 == strcmp(argv[i], "-query") || 0 == strcmp(argv[i], "-json"))
+			headless = 1;
+
+	//pull options out, everything else is a cia
+	for(int i=1; i<argc; i++) {
+		if(0 == strncmp(argv[i], "-j", 2) && (argv[i][2] == '\0' || isdigit(argv[i][2]))) {
+			const char *n = argv[i][2] ? &argv[i][2] : (i+1 < argc ? argv[++i] : "");
+			nWorkers = atoi(n);
+			if(nWorkers < 1) {
+				printf("ERROR: -j needs the number of files to process at once\n");
+				waitForKey();
+				return 1;
+			}
+		} else if(0 == strcmp(argv[i], "-ram")) {
+			if(i+1 >= argc || !isdigit(argv[i+1][0])) {
+				printf("ERROR: -ram needs a size in MB\n");
+				waitForKey();
+				return 1;
+			}
+			ramLimit = (u64)atoi(argv[++i]) << 20;
+		} else if(0 == strcmp(argv[i], "-trace")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -trace needs a file name to write the trace to\n");
+				waitForKey();
+				return 1;
+			}
+			traceName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-recipe")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -recipe needs the recipe file to read\n");
+				return 1;
+			}
+			recipeName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-variant")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -variant needs the recipe file for the variant\n");
+				return 1;
+			}
+			variantNames[nVariants++] = argv[++i];
+		} else if(0 == strcmp(argv[i], "-dat")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -dat needs the DAT file to check dumped ROMs against\n");
+				waitForKey();
+				return 1;
+			}
+			datName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-cache")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -cache needs the directory to keep unpacked titles in\n");
+				waitForKey();
+				return 1;
+			}
+			cacheName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-cachesize")) {
+			if(i+1 >= argc || !isdigit(argv[i+1][0])) {
+				printf("ERROR: -cachesize needs a size in MB\n");
+				waitForKey();
+				return 1;
+			}
+			cacheSize = (u64)atoi(argv[++i]) << 20;
+		} else if(0 == strcmp(argv[i], "-scan")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -scan needs the index file to write\n");
+				return 1;
+			}
+			scanName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-query")) {
+			if(i+2 >= argc) {
+				printf("ERROR: -query needs the index file and the query\n");
+				return 1;
+			}
+			queryName = argv[++i];
+			queryText = argv[++i];
+		} else if(0 == strcmp(argv[i], "-json")) {
+			if(i+1 >= argc) {
+				printf("ERROR: -json needs the file to write the report to\n");
+				return 1;
+			}
+			jsonName = argv[++i];
+		} else if(0 == strcmp(argv[i], "-jsonlut")) {
+			if(i+1 < argc && 0 == strcasecmp(argv[i+1], "base64")) {
+				jsonLut = REPORT_LUT_BASE64;
+			} else if(i+1 < argc && 0 == strcasecmp(argv[i+1], "array")) {
+				jsonLut = REPORT_LUT_ARRAY;
+			} else {
+				printf("ERROR: -jsonlut needs base64 or array\n");
+				return 1;
+			}
+			++i;
+		} else if(0 == strcmp(argv[i], "-graph")) {
+			jsonGraph = 1;
+		} else {
+			fnames[nFiles++] = argv[i];
+		}
+	}
+
+	//catalog mode: the files are directories to index, and there's nothing else to do
+	if(scanName) {
+		struct catalogStats stats;
+		u64 start = timeMicros();
+		if(nFiles < 1) {
+			printf("ERROR: -scan needs at least one directory to scan\n");
+			return 1;
+		}
+		result = catalogScan(scanName, fnames, nFiles, stdout, &stats);
+		if(result) {
+			printf("ERROR: %s: %s\n", scanName, result);
+			return 1;
+		}
+		printf("Indexed %u cias in %.2f s: %u read (%u not fully), %u unchanged, %u dropped\n",
+				stats.nRead + stats.nUnchanged, (timeMicros() - start) / 1e6, stats.nRead, stats.nBad, stats.nUnchanged, stats.nDropped);
+		return 0;
+	}
+
+	//query mode: list the titles in an index that match, or hand them to the batch along with any cias given
+	if(queryName) {
+		struct query query;
+		u8 *match;
+		u32 nMatched;
+		int errPos;
+		result = catalogLoad(&catalog, queryName);
+		if(result) {
+			printf("ERROR: %s: %s\n", queryName, result);
+			return 1;
+		}
+		result = queryParse(&query, queryText, &errPos);
+		match = malloc(catalog.n ? catalog.n : 1);
+		if(!result && !match)
+			result = "can't allocate memory for query results";
+		if(result) {
+			printf("ERROR: %s\n  %s\n  %*s^\n", result, queryText, errPos, "");
+			free(match);
+			catalogFree(&catalog);
+			return 1;
+		}
+		nMatched = queryRun(&query, &catalog, match);
+		queried = malloc((nFiles + nMatched + 1) * sizeof(char*));
+		if(!queried) { perror("Can't allocate memory!"); free(match); catalogFree(&catalog); return 1; }
+		memcpy(queried, fnames, nFiles * sizeof(char*));
+		for(u32 i=0; i<catalog.n; i++) {
+			if(!match[i])
+				continue;
+			struct catalogEntry entry;
+			catalogGetEntry(&catalog, i, &entry);
+			queried[nFiles++] = (char*)entry.path;
+		}
+		free(match);
+		fnames = queried;
+		if(!recipeName && !nVariants) {
+			for(int i=0; i<nFiles; i++)
+				printf("%s\n", fnames[i]);
+			fprintf(stderr, "%u of %u titles match\n", nMatched, catalog.n);
+			catalogFree(&catalog);
+			free(queried);
+			return 0;
+		}
+	}
+
 	if(nFiles < 1) {
 		printf(
 "Drag one or more GBA VC .cia files to this program's icon or pass them on the\n"
@@ -28,31 +248,167 @@ int main(int argc, char **argv) {
 "    proper working GBA sleep mode.\n\n"
 " - Change video ghosting effect.\n\n"
 " - Change video darken effect.\n\n"
+"Options:\n"
+" -j N    Process N files at once (default: one per CPU core)\n"
+" -ram N  Unpack titles up to N MB in memory instead of a temp dir (default: 64,\n"
+"          0 to always use the temp dir)\n"
+" -trace FILE  Write a timeline of every step of every file to FILE, for\n"
+"          chrome://tracing or ui.perfetto.dev\n"
+" -recipe FILE  Take what to do from FILE instead of asking, and never wait for\n"
+"          a key -- see the README for the format\n"
+" -variant FILE  Build one more edited cia from each input, with the edits in\n"
+"          recipe FILE. Give it several times to unpack once and build them all.\n"
+" -dat FILE  Check dumped ROMs against a No-Intro style XML DAT file\n"
+" -cache DIR  Keep what ctrtool and 3dstool unpack in DIR, so editing the same\n"
+"          cia again skips straight to rebuilding it\n"
+" -cachesize N  Limit the cache to N MB, dropping the least recently used titles\n"
+"          (default: 1024)\n"
+" -scan INDEX DIR...  Index the config of every cia under the DIRs into INDEX,\n"
+"          only reading cias that changed since the last scan\n"
+" -query INDEX QUERY  List the cias in INDEX that match QUERY, e.g.\n"
+"          \"lcdGhosting < 0xff and sleepButtons == none\", or with -recipe or\n"
+"          -variant, process them -- see the README for what you can ask\n"
+" -json FILE  Write what's in each cia to FILE as one JSON object per line\n"
+"          instead of printing it; analyzes unless there's a -recipe or -variant\n"
+" -jsonlut base64|array  How -json writes the video LUT (default: base64)\n"
+" -graph  Have -json draw the video LUT graph too\n\n"
 );
-		system("pause");
+		waitForKey();
 		return 1;
 	}
 
-	struct entry *files = alloca(nFiles * sizeof(struct entry));
-	if(!files) { perror("Can't allocate memory!"); system("pause"); return 1; }
+	//one job per file -- too many of these to go on the stack
+	struct job *jobs = calloc(nFiles, sizeof(struct job));
+	if(!jobs) { perror("Can't allocate memory!"); waitForKey(); return 1; }
 
 	printf("%d input file%s given.\n\n", nFiles, nFiles==1?" was":"s were");
-	if(!doQuestionnaire()) {
-		system("pause");
+
+	//the DAT is loaded once and shared by every job
+	if(datName) {
+		result = datLoad(&dat, datName);
+		if(result) {
+			printf("ERROR: %s: %s\n", datName, result);
+			if(queryName) { catalogFree(&catalog); free(queried); }
+			free(jobs);
+			waitForKey();
+			return 1;
+		}
+		printf("Loaded %u ROMs from %s\n\n", dat.nEntries, datName);
+	}
+	if(cacheName) {
+		result = cacheInit(&cache, cacheName, cacheSize);
+		if(result) {
+			printf("WARNING: %s: %s, carrying on without it\n\n", cacheName, result);
+			cacheName = NULL;
+		}
+	}
+	if(recipeName) {
+		result = recipeLoad(recipeName, &edits, &line);
+		if(result) {
+			if(line)
+				printf("ERROR: %s line %d: %s\n", recipeName, line, result);
+			else
+				printf("ERROR: %s: %s\n", recipeName, result);
+			if(datName) datFree(&dat);
+			if(cacheName) cacheFree(&cache);
+			if(queryName) { catalogFree(&catalog); free(queried); }
+			free(jobs);
+			return 1;
+		}
+	} else if(jsonName && !nVariants) {
+		edits.onlyInfo = 1;	//nothing to ask about: a report is an analysis
+	} else if(!nVariants && !doQuestionnaire()) {
+		if(datName) datFree(&dat);
+		if(cacheName) cacheFree(&cache);
+		if(queryName) { catalogFree(&catalog); free(queried); }
+		free(jobs);
+		waitForKey();
 		return 0;
 	}
 
+	//fan-out: the variants are the edits, and the recipe if any just says whether to dump too
+	if(nVariants) {
+		const char *bad = recipeName;
+		line = 0;
+		variants = calloc(nVariants, sizeof(struct editSettings));
+		if(!variants)
+			result = "can't allocate memory for variants";
+		else if(edits.extractAll || edits.setSleepButtons || edits.setLcdGhosting || edits.setVideoLUT
+				|| edits.setSaveType || edits.fixSaveType || edits.saveTiming || romEditWanted(&edits))
+			result = "with -variant, the recipe can only analyze or dump";
+		else
+			result = loadVariants(variants, variantNames, nVariants, &bad, &line);
+		if(result) {
+			if(line)
+				printf("ERROR: %s line %d: %s\n", bad, line, result);
+			else
+				printf("ERROR: %s: %s\n", bad ? bad : "-variant", result);
+			if(datName) datFree(&dat);
+			if(cacheName) cacheFree(&cache);
+			free(variants);
+			if(queryName) { catalogFree(&catalog); free(queried); }
+			free(jobs);
+			return 1;
+		}
+		edits.onlyInfo = 0;
+		printf("Building %d variant%s of each file.\n\n", nVariants, nVariants==1?"":"s");
+	}
+
+	//every job gets its own copy of the settings, so nothing can change under it
 	for(int i=0; i<nFiles; i++) {
-		files[i].name = argv[i+1];
-		files[i].status = process(argv[i+1]);
-		cleanup();
+		jobs[i].fname = fnames[i];
+		jobs[i].settings = edits;
+		jobs[i].ramLimit = ramLimit;
+		jobs[i].dat = datName ? &dat : NULL;
+		jobs[i].cache = cacheName ? &cache : NULL;
+		jobs[i].variants = variants;
+		jobs[i].nVariants = nVariants;
+	}
+
+	//JSON report: every job gets somewhere to put what it finds, and the batch writes them out in order
+	if(jsonName) {
+		infos = calloc(nFiles, sizeof(struct titleInfo));
+		result = infos ? reportOpen(&report, jsonName, jsonLut, jsonGraph) : "can't allocate memory for the report";
+		if(result) {
+			printf("ERROR: %s: %s\n", jsonName, result);
+			if(datName) datFree(&dat);
+			if(cacheName) cacheFree(&cache);
+			free(infos);
+			free(variants);
+			if(queryName) { catalogFree(&catalog); free(queried); }
+			free(jobs);
+			return 1;
+		}
+		for(int i=0; i<nFiles; i++) {
+			jobs[i].report = &report;
+			jobs[i].info = &infos[i];
+		}
 	}
+	if(traceName && traceOpen(traceName))
+		printf("WARNING: can't create trace file %s, carrying on without it\n", traceName);
+	runBatch(jobs, nFiles, nWorkers);
+	if(traceName && traceClose())
+		printf("WARNING: couldn't write trace file %s\n", traceName);
+	if(jsonName && (result = reportClose(&report)))
+		printf("WARNING: %s: %s, the report is incomplete\n", jsonName, result);
 
 	printf("\n\n\n ==== FINISHED! STATUS REPORT ====\n");
-	for(int i=0; i<nFiles; i++)
-		printf("%40s => %s\n", files[i].name, files[i].status);
+	for(int i=0; i<nFiles; i++) {
+		if(jobs[i].datStatus[0])
+			printf("%40s => %s (%s)\n", jobs[i].fname, jobs[i].status, jobs[i].datStatus);
+		else
+			printf("%40s => %s\n", jobs[i].fname, jobs[i].status);
+		if(0 != strcmp(jobs[i].status, "Success!"))
+			++nFailed;
+	}
 	printf(" ==== DONE ====\n");
+	if(datName) datFree(&dat);
+	if(cacheName) cacheFree(&cache);
+	free(variants);
+	free(infos);
+	if(queryName) { catalogFree(&catalog); free(queried); }
+	free(jobs);
 
-	system("pause");
-	return 0;
+	waitForKey();
+	return (headless && nFailed) ? 2 : 0;	//a job queue needs to know if anything went wrong
 }
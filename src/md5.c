@@ -0,0 +1,116 @@
+/* agb_edit MD5 implementation (RFC 1321) */
+
+#include "md5.h"
+
+static const u32 k[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const u8 shifts[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+//compress one or more whole 64 byte blocks
+static void md5Blocks(u32 state[4], const u8 *p, size_t nBlocks) {
+	u32 m[16], a, b, c, d, f, tmp;
+	int i, g;
+
+	while(nBlocks--) {
+		for(i=0; i<16; i++)
+			m[i] = p[i*4] | ((u32)p[i*4+1]<<8) | ((u32)p[i*4+2]<<16) | ((u32)p[i*4+3]<<24);
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		for(i=0; i<64; i++) {
+			if(i < 16) {
+				f = (b & c) | (~b & d);
+				g = i;
+			} else if(i < 32) {
+				f = (d & b) | (~d & c);
+				g = (5*i + 1) & 15;
+			} else if(i < 48) {
+				f = b ^ c ^ d;
+				g = (3*i + 5) & 15;
+			} else {
+				f = c ^ (b | ~d);
+				g = (7*i) & 15;
+			}
+			tmp = d;
+			d = c;
+			c = b;
+			b = b + ROL(a + f + k[i] + m[g], shifts[i]);
+			a = tmp;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		p += 64;
+	}
+}
+
+void md5Init(struct md5 *ctx) {
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xefcdab89;
+	ctx->state[2] = 0x98badcfe;
+	ctx->state[3] = 0x10325476;
+	ctx->length = 0;
+	ctx->bufLen = 0;
+}
+
+void md5Update(struct md5 *ctx, const void *data, size_t len) {
+	const u8 *p = data;
+	size_t n;
+
+	ctx->length += len;
+	//top up a partial block first
+	if(ctx->bufLen) {
+		n = 64 - ctx->bufLen;
+		if(n > len) n = len;
+		memcpy(ctx->buf + ctx->bufLen, p, n);
+		ctx->bufLen += n;
+		p += n;
+		len -= n;
+		if(ctx->bufLen < 64) return;
+		md5Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	//whole blocks straight from the caller's buffer
+	if(len >= 64) {
+		md5Blocks(ctx->state, p, len/64);
+		p += len & ~(size_t)63;
+		len &= 63;
+	}
+	memcpy(ctx->buf, p, len);
+	ctx->bufLen = len;
+}
+
+void md5Final(struct md5 *ctx, u8 out[MD5_SIZE]) {
+	u64 bits = ctx->length * 8;
+	int i;
+
+	ctx->buf[ctx->bufLen++] = 0x80;
+	if(ctx->bufLen > 56) {
+		memset(ctx->buf + ctx->bufLen, 0, 64 - ctx->bufLen);
+		md5Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	memset(ctx->buf + ctx->bufLen, 0, 56 - ctx->bufLen);
+	for(i=0; i<8; i++)	//MD5 is little endian throughout
+		ctx->buf[56+i] = bits >> (i*8);
+	md5Blocks(ctx->state, ctx->buf, 1);
+	for(i=0; i<4; i++) {
+		out[i*4] = ctx->state[i];
+		out[i*4+1] = ctx->state[i] >> 8;
+		out[i*4+2] = ctx->state[i] >> 16;
+		out[i*4+3] = ctx->state[i] >> 24;
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef __MD5_H__
+#define __MD5_H__
+
+/* Plain C MD5, for checking dumped ROMs against DAT files */
+
+#include "gbacia.h"
+
+#define MD5_SIZE 16
+
+struct md5 {
+	u32 state[4];
+	u64 length;	//total bytes hashed so far
+	u8 buf[64];
+	u32 bufLen;
+};
+
+void md5Init(struct md5 *ctx);
+void md5Update(struct md5 *ctx, const void *data, size_t len);
+void md5Final(struct md5 *ctx, u8 out[MD5_SIZE]);
+
+#endif /* __MD5_H__ */
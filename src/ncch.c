@@ -0,0 +1,86 @@
+/* agb_edit native NCCH (cxi) rebuilding */
+
+#include "ncch.h"
+#include "sha256.h"
+#include "platform.h"
+
+#define NCCH_ROMFS_ALIGN 0x1000	//where we put the romfs if the new exefs doesn't leave room for it in its old spot
+
+static const u8 zeros[NCCH_MEDIA_UNIT * 8];
+
+static u64 alignUp64(u64 value, u64 alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//check an NCCH header and that its regions are all there -- anything encrypted has to go through 3dstool
+const char* ncchParse(const u8 *data, u64 size, struct ncchHeader *hdr) {
+	if(size < sizeof(struct ncchHeader)) return "content too small for an NCCH header";
+	memcpy(hdr, data, sizeof(struct ncchHeader));
+	if(hdr->magic != NCCH_MAGIC) return "main content isn't an NCCH";
+	if(!(hdr->flags[7] & NCCH_FLAG7_NOCRYPTO)) return "NCCH is encrypted";
+	if(sizeof(struct ncchHeader) + (u64)hdr->exheaderSize > size
+			|| (u64)hdr->exefsOffset * NCCH_MEDIA_UNIT < sizeof(struct ncchHeader)
+			|| ((u64)hdr->exefsOffset + hdr->exefsSize) * NCCH_MEDIA_UNIT > size
+			|| ((u64)hdr->romfsOffset + hdr->romfsSize) * NCCH_MEDIA_UNIT > size)
+		return "NCCH regions run past end of content";
+	return NULL;
+}
+
+//write zeros to out
+static const char* writeZeros(u64 size, FILE *out) {
+	size_t n;
+	while(size > 0) {
+		n = size < sizeof(zeros) ? size : sizeof(zeros);
+		if(fwrite(zeros, 1, n, out) != n) return "can't write padding";
+		size -= n;
+	}
+	return NULL;
+}
+
+//rebuild the NCCH at srcOffset in src with a new exefs, writing it to out
+//everything in front of the exefs (exheader, logo, plain region) and the romfs is copied across untouched,
+//and the only header fields that change are the exefs size and hash and, if it had to move, the romfs offset
+const char* ncchRebuild(const struct fileMap *src, u64 srcOffset, u64 srcSize, const u8 *exefs, u32 exefsSize, FILE *out) {
+	struct ncchHeader hdr;
+	struct sha256 ctx;
+	u64 exefsOffset, exefsEnd, romfsOffset, romfsSize, srcRomfsOffset, hashSize, n;
+	const char *result;
+
+	if(srcOffset + srcSize > src->size) return "NCCH runs past end of file";
+	result = ncchParse(src->data + srcOffset, srcSize, &hdr);
+	if(result) return result;
+	exefsOffset = (u64)hdr.exefsOffset * NCCH_MEDIA_UNIT;
+	srcRomfsOffset = (u64)hdr.romfsOffset * NCCH_MEDIA_UNIT;
+	romfsSize = (u64)hdr.romfsSize * NCCH_MEDIA_UNIT;
+
+	//the new exefs goes where the old one was; the romfs stays put unless the exefs grew into it,
+	//or shrank enough (like when the ROM was trimmed) that it can move down and make the cxi smaller
+	exefsEnd = exefsOffset + alignUp64(exefsSize, NCCH_MEDIA_UNIT);
+	romfsOffset = srcRomfsOffset;
+	if(romfsSize && (exefsEnd > romfsOffset || alignUp64(exefsEnd, NCCH_ROMFS_ALIGN) < exefsOffset + (u64)hdr.exefsSize * NCCH_MEDIA_UNIT))
+		romfsOffset = alignUp64(exefsEnd, NCCH_ROMFS_ALIGN);
+	hdr.exefsSize = (exefsEnd - exefsOffset) / NCCH_MEDIA_UNIT;
+	if(hdr.exefsHashSize > hdr.exefsSize)
+		hdr.exefsHashSize = hdr.exefsSize;
+	if(romfsSize) {
+		hdr.romfsOffset = romfsOffset / NCCH_MEDIA_UNIT;
+		hdr.contentSize = (romfsOffset + romfsSize) / NCCH_MEDIA_UNIT;
+	} else {
+		hdr.contentSize = exefsEnd / NCCH_MEDIA_UNIT;
+	}
+
+	//superblock hash over the start of the exefs, counting the padding
+	hashSize = (u64)hdr.exefsHashSize * NCCH_MEDIA_UNIT;
+	sha256Init(&ctx);
+	sha256Update(&ctx, exefs, hashSize < exefsSize ? hashSize : exefsSize);
+	for(n=exefsSize; n<hashSize; n+=sizeof(zeros))
+		sha256Update(&ctx, zeros, hashSize-n < sizeof(zeros) ? hashSize-n : sizeof(zeros));
+	sha256Final(&ctx, hdr.exefsHash);
+
+	if(fwrite(&hdr, 1, sizeof(hdr), out) != sizeof(hdr)) return "can't write NCCH header";
+	result = copyRange(src, srcOffset + sizeof(struct ncchHeader), exefsOffset - sizeof(struct ncchHeader), out);
+	if(!result && fwrite(exefs, 1, exefsSize, out) != exefsSize) result = "can't write exefs";
+	if(!result) result = writeZeros((romfsSize ? romfsOffset : exefsEnd) - (exefsOffset + exefsSize), out);
+	if(!result && romfsSize) result = copyRange(src, srcOffset + srcRomfsOffset, romfsSize, out);
+	return result;
+}
@@ -0,0 +1,52 @@
+#ifndef __NCCH_H__
+#define __NCCH_H__
+
+/* NCCH (cxi) container layout
+ * For a GBA VC only the exefs ever changes, so rebuilding a cxi just means
+ * swapping in the new exefs and fixing its size and hash in the header.
+ */
+
+#include "gbacia.h"
+#include "platform.h"
+
+#define NCCH_MEDIA_UNIT 0x200	//offsets and sizes in the NCCH header are in these units
+#define NCCH_MAGIC 0x4843434e	//'NCCH'
+#define NCCH_FLAG7_NOCRYPTO 0x04	//flags[7]: content is not encrypted
+
+#define EXHEADER_FLAGS 0x0d	//system control info flags byte in the exheader
+#define EXHEADER_FLAG_COMPRESSED 0x01	//.code in the exefs is LZ compressed
+
+//NCCH header
+struct ncchHeader {	//0x200 bytes
+	u8 signature[0x100];
+	u32 magic;	//'NCCH'
+	u32 contentSize;	//media units
+	u64 partitionId;
+	u16 makerCode;
+	u16 version;
+	u32 seedCheck;
+	u64 programId;
+	u8 reserved0[0x10];
+	u8 logoHash[0x20];
+	char productCode[0x10];
+	u8 exheaderHash[0x20];	//SHA-256 of the first exheaderSize bytes of the exheader
+	u32 exheaderSize;
+	u32 reserved1;
+	u8 flags[8];
+	u32 plainOffset, plainSize;	//media units, as are all the offsets and sizes below
+	u32 logoOffset, logoSize;
+	u32 exefsOffset, exefsSize;
+	u32 exefsHashSize;	//how much of the start of the exefs exefsHash covers
+	u32 reserved2;
+	u32 romfsOffset, romfsSize;
+	u32 romfsHashSize;
+	u32 reserved3;
+	u8 exefsHash[0x20];	//SHA-256 "superblock" hash of the first exefsHashSize of the exefs
+	u8 romfsHash[0x20];
+} __attribute__((aligned(1)));
+
+//both return a string on failure, NULL on success
+const char* ncchParse(const u8 *data, u64 size, struct ncchHeader *hdr);
+const char* ncchRebuild(const struct fileMap *src, u64 srcOffset, u64 srcSize, const u8 *exefs, u32 exefsSize, FILE *out);
+
+#endif /* __NCCH_H__ */
@@ -0,0 +1,237 @@
+/* agb_edit IPS, UPS and BPS ROM patching */
+
+#include "patch.h"
+#include "crc32.h"
+
+static u32 getLE32(const u8 *p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((u32)p[3]<<24);
+}
+
+//UPS and BPS variable length numbers -- 0 if it runs off the end or is too big
+static int readVarint(const u8 **p, const u8 *end, u64 *out) {
+	u64 data = 0, shift = 1;
+	while(*p < end) {
+		u8 x = *(*p)++;
+		data += (x & 0x7f) * shift;
+		if(x & 0x80) {
+			*out = data;
+			return 1;
+		}
+		shift <<= 7;
+		data += shift;
+		if(shift > (1ULL << 49)) return 0;
+	}
+	return 0;
+}
+
+//walk the IPS records once to find how big the patched ROM is
+static const char* scanIps(struct romPatch *patch) {
+	const u8 *p = patch->map.data + 5, *end = patch->map.data + patch->map.size;
+	u32 offset, size;
+
+	while(1) {
+		if(end - p < 3) return "IPS patch has no EOF marker";
+		if(0 == memcmp(p, "EOF", 3)) {
+			p += 3;
+			break;
+		}
+		if(end - p < 5) return "IPS patch is truncated";
+		offset = (p[0] << 16) | (p[1] << 8) | p[2];
+		size = (p[3] << 8) | p[4];
+		p += 5;
+		if(size == 0) {	//run of one byte
+			if(end - p < 3) return "IPS patch is truncated";
+			size = (p[0] << 8) | p[1];
+			p += 3;
+		} else {
+			if(end - p < size) return "IPS patch is truncated";
+			p += size;
+		}
+		if(offset + size > patch->ipsEnd)
+			patch->ipsEnd = offset + size;
+	}
+	patch->bodyEnd = p;
+	if(end - p >= 3)	//optional size to cut the ROM to
+		patch->ipsTruncate = (p[0] << 16) | (p[1] << 8) | p[2];
+	return NULL;
+}
+
+const char* patchOpen(struct romPatch *patch, const char *fname) {
+	const u8 *data, *p, *end;
+	u64 metadataSize;
+	const char *result;
+
+	memset(patch, 0, sizeof(struct romPatch));
+	result = mapFile(&patch->map, fname);
+	if(result) return result;
+	data = patch->map.data;
+
+	if(patch->map.size >= 8 && 0 == memcmp(data, "PATCH", 5)) {
+		patch->format = PATCH_IPS;
+		patch->body = data + 5;
+		result = scanIps(patch);
+	} else if(patch->map.size >= 4 + 12 && (0 == memcmp(data, "UPS1", 4) || 0 == memcmp(data, "BPS1", 4))) {
+		patch->format = data[0] == 'U' ? PATCH_UPS : PATCH_BPS;
+		end = data + patch->map.size - 12;
+		p = data + 4;
+		if(!readVarint(&p, end, &patch->sourceSize) || !readVarint(&p, end, &patch->targetSize))
+			result = "patch header is bad";
+		else if(patch->format == PATCH_BPS && (!readVarint(&p, end, &metadataSize) || metadataSize > end - p))
+			result = "patch header is bad";
+		else if(crc32Update(0, data, patch->map.size - 4) != getLE32(end + 8))
+			result = "patch is damaged (its CRC doesn't match)";
+		else if(patch->targetSize > PATCH_MAX_TARGET)
+			result = "patched ROM would be bigger than 32 MB";
+		if(!result) {
+			if(patch->format == PATCH_BPS)
+				p += metadataSize;
+			patch->body = p;
+			patch->bodyEnd = end;
+			patch->sourceCrc = getLE32(end);
+			patch->targetCrc = getLE32(end + 4);
+		}
+	} else {
+		result = "not an IPS, UPS or BPS patch";
+	}
+	if(result) patchClose(patch);
+	return result;
+}
+
+void patchClose(struct romPatch *patch) {
+	if(patch->map.data)
+		unmapFile(&patch->map);
+}
+
+const char* patchTargetSize(const struct romPatch *patch, u32 sourceSize, u32 *targetSize) {
+	u64 size;
+	if(patch->format == PATCH_IPS) {
+		size = patch->ipsTruncate ? patch->ipsTruncate : (patch->ipsEnd > sourceSize ? patch->ipsEnd : sourceSize);
+	} else {
+		if(patch->sourceSize != sourceSize) return "the ROM isn't the size the patch is for";
+		size = patch->targetSize;
+	}
+	if(size == 0 || size > PATCH_MAX_TARGET) return "patched ROM would be bigger than 32 MB";
+	*targetSize = size;
+	return NULL;
+}
+
+static const char* applyIps(const struct romPatch *patch, u8 *target, u32 targetSize) {
+	const u8 *p = patch->body;
+	u32 offset, size, i;
+
+	while(p < patch->bodyEnd - 3) {
+		offset = (p[0] << 16) | (p[1] << 8) | p[2];
+		size = (p[3] << 8) | p[4];
+		p += 5;
+		if(size == 0) {
+			size = (p[0] << 8) | p[1];
+			for(i=0; i<size && offset+i < targetSize; i++)	//anything past a truncated end just goes
+				target[offset + i] = p[2];
+			p += 3;
+		} else {
+			for(i=0; i<size && offset+i < targetSize; i++)
+				target[offset + i] = p[i];
+			p += size;
+		}
+	}
+	return NULL;
+}
+
+static const char* applyUps(const struct romPatch *patch, const u8 *source, u32 sourceSize, u8 *target, u32 targetSize) {
+	const u8 *p = patch->body;
+	u64 offset = 0, skip;
+	u8 x;
+
+	//each hunk is a skip, then bytes XOR'd with the source up to a 0
+	while(p < patch->bodyEnd) {
+		if(!readVarint(&p, patch->bodyEnd, &skip)) return "patch is bad";
+		offset += skip;
+		while(1) {
+			if(p >= patch->bodyEnd) return "patch is bad";
+			x = *p++;
+			if(x == 0)
+				break;
+			if(offset >= targetSize) return "patch runs past the end of the ROM";
+			target[offset] = (offset < sourceSize ? source[offset] : 0) ^ x;
+			offset++;
+		}
+		offset++;
+	}
+	return NULL;
+}
+
+static const char* applyBps(const struct romPatch *patch, const u8 *source, u32 sourceSize, u8 *target, u32 targetSize) {
+	const u8 *p = patch->body;
+	u64 out = 0, data, length, sourceRel = 0, targetRel = 0, d;
+	s64 delta;
+
+	while(p < patch->bodyEnd) {
+		if(!readVarint(&p, patch->bodyEnd, &data)) return "patch is bad";
+		length = (data >> 2) + 1;
+		if(out + length > targetSize) return "patch runs past the end of the ROM";
+		switch(data & 3) {
+			case 0:	//source read: same place in the source
+				if(out + length > sourceSize) return "patch reads past the end of the ROM";
+				memcpy(target + out, source + out, length);
+				break;
+			case 1:	//target read: bytes from the patch
+				if(length > patch->bodyEnd - p) return "patch is bad";
+				memcpy(target + out, p, length);
+				p += length;
+				break;
+			case 2:	//source copy
+			case 3:	//target copy -- can overlap what it's writing, so byte by byte
+				if(!readVarint(&p, patch->bodyEnd, &d)) return "patch is bad";
+				delta = (d & 1) ? -(s64)(d >> 1) : (s64)(d >> 1);
+				if((data & 3) == 2) {
+					sourceRel += delta;
+					if(sourceRel > sourceSize || length > sourceSize - sourceRel) return "patch reads past the end of the ROM";
+					memcpy(target + out, source + sourceRel, length);
+					sourceRel += length;
+				} else {
+					targetRel += delta;
+					if(targetRel >= out) return "patch is bad";
+					for(u64 i=0; i<length; i++)
+						target[out + i] = target[targetRel++];
+				}
+				break;
+		}
+		out += length;
+	}
+	if(out != targetSize) return "patch doesn't fill the whole ROM";
+	return NULL;
+}
+
+const char* patchApply(const struct romPatch *patch, const u8 *source, u32 sourceSize, u8 *target, u32 targetSize) {
+	const char *result;
+
+	if(patch->format != PATCH_IPS && crc32Update(0, source, sourceSize) != patch->sourceCrc)
+		return "the ROM isn't the one the patch is for (CRC doesn't match)";
+
+	//IPS and UPS only say what changes, so start from the ROM; BPS writes every byte itself
+	if(patch->format != PATCH_BPS) {
+		memcpy(target, source, sourceSize < targetSize ? sourceSize : targetSize);
+		if(targetSize > sourceSize)
+			memset(target + sourceSize, 0, targetSize - sourceSize);
+	}
+	if(patch->format == PATCH_IPS)
+		result = applyIps(patch, target, targetSize);
+	else if(patch->format == PATCH_UPS)
+		result = applyUps(patch, source, sourceSize, target, targetSize);
+	else
+		result = applyBps(patch, source, sourceSize, target, targetSize);
+	if(result) return result;
+
+	if(patch->format != PATCH_IPS && crc32Update(0, target, targetSize) != patch->targetCrc)
+		return "patched ROM came out wrong (CRC doesn't match)";
+	return NULL;
+}
+
+const char* patchFormatToString(int format) {
+	switch(format) {
+		case PATCH_IPS: return "IPS";
+		case PATCH_UPS: return "UPS";
+		case PATCH_BPS: return "BPS";
+		default: return "unknown";
+	}
+}
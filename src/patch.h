@@ -0,0 +1,40 @@
+#ifndef __PATCH_H__
+#define __PATCH_H__
+
+/* ROM patches: IPS, UPS and BPS
+ * The patch file is mapped rather than read, and applying it writes the
+ * patched ROM straight into wherever the caller wants it (the new code.bin),
+ * so there's never a patched .gba on disk or a second copy of it in memory.
+ * UPS and BPS carry CRC-32s of the ROM they're for, the patched ROM and the
+ * patch itself, and all three get checked. IPS has none.
+ */
+
+#include "gbacia.h"
+#include "platform.h"
+
+#define PATCH_MAX_TARGET (32 << 20)	//the biggest GBA ROM
+
+enum patchFormat {
+	PATCH_IPS,
+	PATCH_UPS,
+	PATCH_BPS
+};
+
+struct romPatch {
+	struct fileMap map;
+	int format;	//enum patchFormat
+	u64 sourceSize, targetSize;	//from the header, for UPS and BPS
+	u32 sourceCrc, targetCrc;	//UPS and BPS only
+	const u8 *body, *bodyEnd;	//the records or actions
+	u32 ipsEnd, ipsTruncate;	//IPS: where the last record ends, and the size to cut it to (0 if none)
+};
+
+//all return a string on failure, NULL on success
+const char* patchOpen(struct romPatch *patch, const char *fname);	//maps it, works out its format and checks it
+void patchClose(struct romPatch *patch);
+const char* patchTargetSize(const struct romPatch *patch, u32 sourceSize, u32 *targetSize);
+//target is patchTargetSize bytes, and mustn't overlap source
+const char* patchApply(const struct romPatch *patch, const u8 *source, u32 sourceSize, u8 *target, u32 targetSize);
+const char* patchFormatToString(int format);
+
+#endif /* __PATCH_H__ */
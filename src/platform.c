@@ -0,0 +1,407 @@
+/* agb_edit platform specific functions */
+
+#ifndef _WIN32
+#define _GNU_SOURCE	//copy_file_range, memfd_create
+#endif
+#include "platform.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#include <process.h>
+#include <conio.h>
+#include <sys/utime.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <utime.h>
+#include <spawn.h>
+#include <termios.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>	//FICLONE
+#endif
+#include <errno.h>
+#include <time.h>
+
+#ifdef _WIN32
+
+const char* mapFile(struct fileMap *map, const char *fname) {
+	LARGE_INTEGER size;
+	map->data = NULL;
+	map->hMap = NULL;
+	map->hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(map->hFile == INVALID_HANDLE_VALUE) return "can't open file";
+	if(!GetFileSizeEx(map->hFile, &size)) { CloseHandle(map->hFile); return "can't get file size"; }
+	if(size.QuadPart == 0) { CloseHandle(map->hFile); return "file is empty"; }
+	map->size = size.QuadPart;
+	map->hMap = CreateFileMappingA(map->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!map->hMap) { CloseHandle(map->hFile); return "can't create file mapping"; }
+	map->data = MapViewOfFile(map->hMap, FILE_MAP_READ, 0, 0, 0);
+	if(!map->data) { CloseHandle(map->hMap); CloseHandle(map->hFile); return "can't map file"; }
+	return NULL;
+}
+
+void unmapFile(struct fileMap *map) {
+	if(map->data) UnmapViewOfFile((void*)map->data);
+	if(map->hMap) CloseHandle(map->hMap);
+	if(map->hFile && map->hFile != INVALID_HANDLE_VALUE) CloseHandle(map->hFile);
+	map->data = NULL;
+	map->hMap = map->hFile = NULL;
+}
+
+//map everything written so far to a file we have open
+const char* mapStream(struct fileMap *map, FILE *fp) {
+	HANDLE h = (HANDLE)_get_osfhandle(_fileno(fp));
+	LARGE_INTEGER size;
+	map->data = NULL;
+	map->hMap = map->hFile = NULL;
+	if(0 != fflush(fp)) return "can't write file";
+	if(!DuplicateHandle(GetCurrentProcess(), h, GetCurrentProcess(), &map->hFile, 0, FALSE, DUPLICATE_SAME_ACCESS)) return "can't open file";
+	if(!GetFileSizeEx(map->hFile, &size)) { unmapFile(map); return "can't get file size"; }
+	if(size.QuadPart == 0) { unmapFile(map); return "file is empty"; }
+	map->size = size.QuadPart;
+	map->hMap = CreateFileMappingA(map->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!map->hMap) { unmapFile(map); return "can't create file mapping"; }
+	map->data = MapViewOfFile(map->hMap, FILE_MAP_READ, 0, 0, 0);
+	if(!map->data) { unmapFile(map); return "can't map file"; }
+	return NULL;
+}
+
+//a scratch file that's kept in the cache where possible and deleted once it's closed
+FILE* memFile(const char *name) {
+	char dir[MAX_PATH], fname[MAX_PATH];
+	HANDLE h;
+	int fd;
+	if(!GetTempPathA(sizeof(dir), dir) || !GetTempFileNameA(dir, "agb", 0, fname)) return NULL;
+	h = CreateFileA(fname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if(h == INVALID_HANDLE_VALUE) return NULL;
+	fd = _open_osfhandle((intptr_t)h, _O_RDWR | _O_BINARY);
+	if(fd < 0) { CloseHandle(h); return NULL; }
+	return _fdopen(fd, "w+b");
+}
+
+#else
+
+const char* mapFile(struct fileMap *map, const char *fname) {
+	struct stat st;
+	void *p;
+	map->data = NULL;
+	map->fd = open(fname, O_RDONLY);
+	if(map->fd < 0) return "can't open file";
+	if(0 != fstat(map->fd, &st)) { close(map->fd); map->fd = -1; return "can't get file size"; }
+	if(st.st_size == 0) { close(map->fd); map->fd = -1; return "file is empty"; }
+	map->size = st.st_size;
+	p = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	if(p == MAP_FAILED) { close(map->fd); map->fd = -1; return "can't map file"; }
+	map->data = p;
+	return NULL;
+}
+
+void unmapFile(struct fileMap *map) {
+	if(map->data) munmap((void*)map->data, map->size);
+	if(map->fd >= 0) close(map->fd);
+	map->data = NULL;
+	map->fd = -1;
+}
+
+//map everything written so far to a file we have open
+const char* mapStream(struct fileMap *map, FILE *fp) {
+	struct stat st;
+	void *p;
+	map->data = NULL;
+	map->fd = -1;
+	if(0 != fflush(fp)) return "can't write file";
+	map->fd = dup(fileno(fp));
+	if(map->fd < 0) return "can't open file";
+	if(0 != fstat(map->fd, &st)) { unmapFile(map); return "can't get file size"; }
+	if(st.st_size == 0) { unmapFile(map); return "file is empty"; }
+	map->size = st.st_size;
+	p = mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0);
+	if(p == MAP_FAILED) { unmapFile(map); return "can't map file"; }
+	map->data = p;
+	return NULL;
+}
+
+//a scratch file that lives in RAM and is gone once it's closed
+FILE* memFile(const char *name) {
+	FILE *fp;
+#ifdef __linux__
+	int fd = memfd_create(name, MFD_CLOEXEC);
+	if(fd < 0) return NULL;
+	fp = fdopen(fd, "w+b");
+	if(!fp) close(fd);
+#else
+	fp = tmpfile();	//no anonymous files here, but it's unlinked already so it never gets written back unless memory runs short
+#endif
+	return fp;
+}
+
+#endif
+
+//copy a whole file
+//where the filesystem can (btrfs, XFS, ReFS...) the copy shares the source's blocks until they're written to,
+//so patching a few KB of the copy only costs a few KB of new data
+const char* copyFile(const char *src, const char *dst) {
+#ifdef _WIN32
+	//CopyFile clones blocks by itself where the volume supports it
+	if(!CopyFileA(src, dst, FALSE)) return "can't copy file";
+	return NULL;
+#else
+	struct fileMap in;
+	const char *result;
+	FILE *out;
+
+	result = mapFile(&in, src);
+	if(result) return result;
+	out = fopen(dst, "wb");
+	if(!out) { unmapFile(&in); return "can't create copy"; }
+#ifdef FICLONE
+	if(0 == ioctl(fileno(out), FICLONE, in.fd)) {
+		unmapFile(&in);
+		return fclose(out) == 0 ? NULL : "can't copy file";
+	}
+#endif
+	result = copyRange(&in, 0, in.size, out);
+	if(fclose(out) != 0 && !result) result = "can't copy file";
+	unmapFile(&in);
+	if(result) remove(dst);
+	return result;
+#endif
+}
+
+//append size bytes from offset in a mapped file to out
+//on linux the kernel moves the data file to file, otherwise we write it from the mapping
+const char* copyRange(const struct fileMap *src, u64 offset, u64 size, FILE *out) {
+	if(offset + size > src->size) return "copy runs past end of source";
+#ifdef __linux__
+	{
+		loff_t from = offset;
+		off_t sendFrom;
+		ssize_t n = 0;
+		int fd = fileno(out);
+
+		if(0 != fflush(out)) return "can't write file";
+		while(size > 0 && (n = copy_file_range(src->fd, &from, fd, NULL, size, 0)) > 0)
+			size -= n;
+		//older kernels and some filesystems can't copy_file_range between these two, so try sendfile
+		if(size > 0 && n < 0) {
+			sendFrom = from;
+			while(size > 0 && (n = sendfile(fd, src->fd, &sendFrom, size)) > 0)
+				size -= n;
+			from = sendFrom;
+		}
+		if(size == 0) return NULL;
+		offset = from;	//whatever's left goes the slow way
+	}
+#endif
+	if(fwrite(src->data + offset, 1, size, out) != size) return "can't write file";
+	return NULL;
+}
+
+//number of CPU cores we can run jobs on
+int cpuCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#endif
+}
+
+//monotonic clock for timing things, in microseconds
+u64 timeMicros(void) {
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+	return now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+//make a directory, which is fine if it's already there
+int makeDir(const char *path) {
+#ifdef _WIN32
+	if(0 == _mkdir(path)) return 0;
+#else
+	if(0 == mkdir(path, 0777)) return 0;
+#endif
+	return errno == EEXIST ? 0 : -1;
+}
+
+#ifdef _WIN32
+
+int listDir(const char *path, int (*fn)(void *ctx, const struct dirEntry *entry), void *ctx) {
+	WIN32_FIND_DATAA find;
+	struct dirEntry entry;
+	char pattern[MAX_PATH];
+	HANDLE h;
+
+	snprintf(pattern, sizeof(pattern), "%s\\*", path);
+	h = FindFirstFileA(pattern, &find);
+	if(h == INVALID_HANDLE_VALUE) return -1;
+	do {
+		if(0 == strcmp(find.cFileName, ".") || 0 == strcmp(find.cFileName, ".."))
+			continue;
+		entry.name = find.cFileName;
+		entry.isDir = !!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY);
+		entry.size = ((u64)find.nFileSizeHigh << 32) | find.nFileSizeLow;
+		//FILETIME counts 100ns ticks from 1601
+		entry.mtime = (s64)((((u64)find.ftLastWriteTime.dwHighDateTime << 32) | find.ftLastWriteTime.dwLowDateTime) / 10000000) - 11644473600LL;
+		if(fn(ctx, &entry))
+			break;
+	} while(FindNextFileA(h, &find));
+	FindClose(h);
+	return 0;
+}
+
+static int removeEntry(void *ctx, const struct dirEntry *entry) {
+	char path[MAX_PATH];
+	snprintf(path, sizeof(path), "%s\\%s", (const char*)ctx, entry->name);
+	if(entry->isDir)
+		removeTree(path);
+	else
+		DeleteFileA(path);
+	return 0;
+}
+
+int removeTree(const char *path) {
+	listDir(path, removeEntry, (void*)path);
+	return RemoveDirectoryA(path) ? 0 : -1;
+}
+
+int processId(void) {
+	return _getpid();
+}
+
+void toolPath(char *path, size_t size, const char *name) {
+	snprintf(path, size, "progfiles\\%s.exe", name);
+}
+
+//cmd.exe is the only way to get the output redirected without a pile of handle juggling, so it still goes through system()
+int runProgram(const char *const argv[], const char *logName) {
+	char cmd[16384];
+	size_t used = 0;
+	int i;
+
+	used += snprintf(cmd, sizeof(cmd), "\"");	//the whole thing gets quoted again, or cmd.exe strips the first program's quotes
+	for(i=0; argv[i] && used < sizeof(cmd); i++)
+		used += snprintf(cmd + used, sizeof(cmd) - used, "%s\"%s\"", i ? " " : "", argv[i]);
+	if(logName && logName[0] && used < sizeof(cmd))
+		used += snprintf(cmd + used, sizeof(cmd) - used, " >>\"%s\" 2>&1", logName);
+	if(used >= sizeof(cmd) - 1) return -1;
+	strcat(cmd, "\"");
+	return system(cmd);
+}
+
+int readKey(void) {
+	return _getch();
+}
+
+#else
+
+int listDir(const char *path, int (*fn)(void *ctx, const struct dirEntry *entry), void *ctx) {
+	struct dirEntry entry;
+	struct dirent *d;
+	struct stat st;
+	DIR *dir = opendir(path);
+
+	if(!dir) return -1;
+	while((d = readdir(dir)) != NULL) {
+		if(0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+			continue;
+		if(0 != fstatat(dirfd(dir), d->d_name, &st, AT_SYMLINK_NOFOLLOW))
+			continue;	//gone already
+		entry.name = d->d_name;
+		entry.isDir = S_ISDIR(st.st_mode);
+		entry.size = st.st_size;
+		entry.mtime = st.st_mtime;
+		if(fn(ctx, &entry))
+			break;
+	}
+	closedir(dir);
+	return 0;
+}
+
+static int removeEntry(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+	return remove(path);
+}
+
+int removeTree(const char *path) {
+	//depth first so directories are empty by the time we get to them
+	return nftw(path, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int processId(void) {
+	return getpid();
+}
+
+//the tools are native builds here, without the .exe
+void toolPath(char *path, size_t size, const char *name) {
+	snprintf(path, size, "progfiles/%s", name);
+	if(0 != access(path, X_OK))
+		snprintf(path, size, "%s", name);	//posix_spawnp looks for it on the PATH
+}
+
+int runProgram(const char *const argv[], const char *logName) {
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+	int status, err;
+
+	posix_spawn_file_actions_init(&actions);
+	if(logName && logName[0]) {
+		posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, logName, O_WRONLY | O_CREAT | O_APPEND, 0666);
+		posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+	}
+	err = posix_spawnp(&pid, argv[0], &actions, NULL, (char *const*)argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	if(err) return -1;
+	while(waitpid(pid, &status, 0) < 0)
+		if(errno != EINTR) return -1;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+//raw mode just for the one key, so it's back to normal if we're killed between prompts
+int readKey(void) {
+	struct termios old, raw;
+	int ch;
+
+	if(0 != tcgetattr(STDIN_FILENO, &old)) {	//not a terminal, so take what's piped in
+		ch = getchar();
+		return ch == EOF ? 4 : ch;
+	}
+	raw = old;
+	raw.c_lflag &= ~(ICANON | ECHO);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+	tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	ch = getchar();
+	tcsetattr(STDIN_FILENO, TCSANOW, &old);
+	return ch == EOF ? 4 : ch;
+}
+
+#endif
+
+int touchFile(const char *path) {
+	FILE *fp = fopen(path, "ab");
+	if(!fp) return -1;
+	fclose(fp);
+	return utime(path, NULL);
+}
@@ -0,0 +1,62 @@
+#ifndef __PLATFORM_H__
+#define __PLATFORM_H__
+
+/* Thin layer over the few OS-specific things we need that the C runtime
+ * doesn't cover. Windows (mingw) and POSIX implementations live side by side
+ * in platform.c. On POSIX nothing goes through a shell: tools are started
+ * with posix_spawn, and directories are listed and removed with the native
+ * calls rather than by running dir and rd.
+ */
+
+#include "gbacia.h"
+
+#ifdef _WIN32
+#define PATH_SEP "\\"
+#define NULL_DEVICE "NUL"
+#else
+#define PATH_SEP "/"
+#define NULL_DEVICE "/dev/null"
+#endif
+
+//a whole file mapped read-only into memory
+struct fileMap {
+	const u8 *data;
+	u64 size;
+#ifdef _WIN32
+	void *hFile, *hMap;	//HANDLEs, kept as void* so we don't drag windows.h into every file
+#else
+	int fd;
+#endif
+};
+
+//one entry in a directory listing
+struct dirEntry {
+	const char *name;
+	int isDir;
+	u64 size;
+	s64 mtime;	//seconds since 1970
+};
+
+//returns a string on failure, NULL on success
+const char* mapFile(struct fileMap *map, const char *fname);
+void unmapFile(struct fileMap *map);
+const char* mapStream(struct fileMap *map, FILE *fp);	//flushes fp and maps its contents, which must not change while mapped
+FILE* memFile(const char *name);	//NULL on failure
+const char* copyFile(const char *src, const char *dst);
+const char* copyRange(const struct fileMap *src, u64 offset, u64 size, FILE *out);
+int cpuCount(void);
+u64 timeMicros(void);
+int makeDir(const char *path);	//0 on success or if it already exists
+//calls fn for everything in a directory except . and .., until fn returns nonzero -- returns -1 if it can't be read
+int listDir(const char *path, int (*fn)(void *ctx, const struct dirEntry *entry), void *ctx);
+int removeTree(const char *path);	//delete a directory and everything in it; 0 on success
+int touchFile(const char *path);	//create it if need be and set its modified time to now; 0 on success
+int processId(void);
+//where one of the external tools (3dstool, ctrtool) is: progfiles, or on POSIX the PATH if it isn't there
+void toolPath(char *path, size_t size, const char *name);
+//run a program with argv (NULL terminated, argv[0] being the program) and wait for it, without a shell
+//its output is appended to logName, or goes to ours if that's NULL or empty; returns its exit code, or -1 if it couldn't run
+int runProgram(const char *const argv[], const char *logName);
+int readKey(void);	//one key from the console without waiting for enter; ^D (4) at end of input
+
+#endif /* __PLATFORM_H__ */
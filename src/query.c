@@ -0,0 +1,322 @@
+/* agb_edit catalog index queries */
+
+#include "query.h"
+#include "videolut.h"
+
+#define QUERY_BLOCK 1024	//titles per pass, so a comparison's results are still in cache for the next one
+
+enum { QUERY_COMPARE, QUERY_AND, QUERY_OR, QUERY_NOT };
+enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE };
+enum { TOK_END, TOK_WORD, TOK_OP, TOK_AND, TOK_OR, TOK_NOT, TOK_OPEN, TOK_CLOSE, TOK_BAD };
+enum { VALUE_NUMBER, VALUE_SAVE_TYPE, VALUE_BUTTONS, VALUE_LUT, VALUE_STATUS, VALUE_FLAG };
+
+struct field {
+	const char *name;
+	int column;
+	u64 mask;
+	int valueKind;
+	int configOnly;
+};
+
+static const struct field fields[] = {
+	{"titleId", CATALOG_TITLE_ID, ~0ULL, VALUE_NUMBER, 0},
+	{"fileSize", CATALOG_FILE_SIZE, ~0ULL, VALUE_NUMBER, 0},
+	{"romSize", CATALOG_ROM_SIZE, ~0ULL, VALUE_NUMBER, 1},
+	{"saveType", CATALOG_SAVE_TYPE, ~0ULL, VALUE_SAVE_TYPE, 1},
+	{"sleepButtons", CATALOG_SLEEP_BUTTONS, ~0ULL, VALUE_BUTTONS, 1},
+	{"lcdGhosting", CATALOG_LCD_GHOSTING, ~0ULL, VALUE_NUMBER, 1},
+	{"lut", CATALOG_LUT_HASH, ~0ULL, VALUE_LUT, 1},
+	{"status", CATALOG_STATUS, ~0ULL, VALUE_STATUS, 0},
+	{"compressed", CATALOG_FLAGS, CATALOG_FLAG_COMPRESSED, VALUE_FLAG, 0},
+	{"manual", CATALOG_FLAGS, CATALOG_FLAG_MANUAL, VALUE_FLAG, 0},
+};
+
+static const char *statusNames[4] = {"ok", "unreadable", "encrypted", "no_config"};	//enum catalogStatus
+
+struct parser {
+	struct query *q;
+	const char *text, *pos;
+	const char *tokStart;	//where the current token starts, for errors
+	int tok, op;
+	char word[128];
+	const char *err;
+};
+
+//read the next token into p
+static void next(struct parser *p) {
+	const char *s = p->pos;
+	int n = 0;
+
+	while(isspace((unsigned char)*s)) s++;
+	p->tokStart = s;
+	if(*s == '\0') {
+		p->tok = TOK_END;
+	} else if(isalnum((unsigned char)*s) || *s == '_') {
+		while(isalnum((unsigned char)*s) || *s == '_' || *s == '+' || *s == '-' || *s == '.') {
+			if(n < sizeof(p->word)-1) p->word[n++] = *s;
+			s++;
+		}
+		p->word[n] = '\0';
+		if(0 == strcasecmp(p->word, "and")) p->tok = TOK_AND;
+		else if(0 == strcasecmp(p->word, "or")) p->tok = TOK_OR;
+		else if(0 == strcasecmp(p->word, "not")) p->tok = TOK_NOT;
+		else p->tok = TOK_WORD;
+	} else if(s[0] == '&' && s[1] == '&') { p->tok = TOK_AND; s += 2;
+	} else if(s[0] == '|' && s[1] == '|') { p->tok = TOK_OR; s += 2;
+	} else if(s[0] == '=' && s[1] == '=') { p->tok = TOK_OP; p->op = OP_EQ; s += 2;
+	} else if(s[0] == '!' && s[1] == '=') { p->tok = TOK_OP; p->op = OP_NE; s += 2;
+	} else if(s[0] == '<' && s[1] == '=') { p->tok = TOK_OP; p->op = OP_LE; s += 2;
+	} else if(s[0] == '>' && s[1] == '=') { p->tok = TOK_OP; p->op = OP_GE; s += 2;
+	} else if(s[0] == '<') { p->tok = TOK_OP; p->op = OP_LT; s++;
+	} else if(s[0] == '>') { p->tok = TOK_OP; p->op = OP_GT; s++;
+	} else if(s[0] == '!') { p->tok = TOK_NOT; s++;
+	} else if(s[0] == '(') { p->tok = TOK_OPEN; s++;
+	} else if(s[0] == ')') { p->tok = TOK_CLOSE; s++;
+	} else {
+		p->tok = TOK_BAD;
+	}
+	p->pos = s;
+}
+
+static int addNode(struct parser *p, int kind, int left, int right) {
+	struct queryNode *node;
+	if(p->err) return -1;	//an error further down
+	if(p->q->nNodes == QUERY_MAX_NODES) {
+		if(!p->err) p->err = "query is too long";
+		return -1;
+	}
+	node = &p->q->nodes[p->q->nNodes];
+	memset(node, 0, sizeof(struct queryNode));
+	node->kind = kind;
+	node->left = left;
+	node->right = right;
+	return p->q->nNodes++;
+}
+
+static int fail(struct parser *p, const char *err) {
+	if(!p->err) p->err = err;
+	return -1;
+}
+
+static int getNumber(const char *word, u64 *out) {
+	char *end;
+	if(!isdigit((unsigned char)word[0])) return 0;
+	*out = strtoull(word, &end, 0);
+	return *end == '\0';
+}
+
+//fingerprint of the LUT the video parameter editor would make
+static u64 lutFingerprint(int gammaCorrected, int darkFilter) {
+	u8 lut[3*256];
+	lutResetParams(gammaCorrected);
+	if(darkFilter)
+		lutSetContrast(1.0 - darkFilter / 255.0);
+	makeVideoLUT(lut);
+	return catalogLutHash(lut);
+}
+
+//turn the word after a comparison into a value for this field
+static const char* parseValue(const struct field *f, const char *word, u64 *value) {
+	u64 n;
+	int i;
+
+	switch(f->valueKind) {
+		case VALUE_NUMBER:
+			if(!getNumber(word, value)) return "expected a number";
+			return NULL;
+		case VALUE_SAVE_TYPE:
+			if(getNumber(word, value)) return NULL;
+			if((*value = encodeSaveType(word)) != 0xffffffff) return NULL;
+			return "expected a save type like SRAM_256K";
+		case VALUE_BUTTONS:
+			if(getNumber(word, value)) return NULL;
+			if(0 == strcasecmp(word, "none")) {
+				*value = 0;
+				return NULL;
+			}
+			*value = encodeButtons(word);
+			return *value == 0xffff ? "expected buttons like L+R+Select" : NULL;
+		case VALUE_LUT:
+			if(0 == strcasecmp(word, "linear")) {
+				*value = lutFingerprint(0, 0);
+			} else if(0 == strcasecmp(word, "gamma")) {
+				*value = lutFingerprint(1, 0);
+			} else if(0 == strncasecmp(word, "darken-", 7) && getNumber(word + 7, &n) && n <= 255) {
+				*value = lutFingerprint(0, n);
+			} else if(!getNumber(word, value)) {
+				return "expected linear, gamma, darken-N or a LUT fingerprint";
+			}
+			return NULL;
+		case VALUE_STATUS:
+			for(i=0; i<4; i++) {
+				if(0 == strcasecmp(word, statusNames[i])) {
+					*value = i;
+					return NULL;
+				}
+			}
+			return "expected ok, unreadable, encrypted or no_config";
+		case VALUE_FLAG:
+			if(0 == strcasecmp(word, "true") || 0 == strcmp(word, "1")) *value = f->mask;
+			else if(0 == strcasecmp(word, "false") || 0 == strcmp(word, "0")) *value = 0;
+			else return "expected true or false";
+			return NULL;
+	}
+	return "bad field";
+}
+
+//field op value, or a flag on its own
+static int parseCompare(struct parser *p) {
+	const struct field *f = NULL;
+	struct queryNode *node;
+	const char *err;
+	int n, i;
+
+	if(p->tok != TOK_WORD) return fail(p, "expected a field name");
+	for(i=0; i<sizeof(fields)/sizeof(fields[0]); i++)
+		if(0 == strcasecmp(p->word, fields[i].name))
+			f = &fields[i];
+	if(!f) return fail(p, "unknown field -- try titleId, fileSize, romSize, saveType, sleepButtons, lcdGhosting, lut, status, compressed or manual");
+	n = addNode(p, QUERY_COMPARE, 0, -1);
+	if(n < 0) return -1;
+	node = &p->q->nodes[n];
+	node->column = f->column;
+	node->mask = f->mask;
+	node->configOnly = f->configOnly;
+	next(p);
+
+	if(p->tok != TOK_OP) {
+		if(f->valueKind != VALUE_FLAG) return fail(p, "expected ==, !=, <, <=, > or >=");
+		node->op = OP_NE;
+		node->value = 0;
+		return n;
+	}
+	node->op = p->op;
+	if(node->op != OP_EQ && node->op != OP_NE && (f->valueKind == VALUE_LUT || f->valueKind == VALUE_STATUS || f->valueKind == VALUE_FLAG))
+		return fail(p, "this field can only be compared with == or !=");
+	next(p);
+	if(p->tok != TOK_WORD) return fail(p, "expected a value");
+	err = parseValue(f, p->word, &node->value);
+	if(err) return fail(p, err);
+	next(p);
+	return n;
+}
+
+static int parseOr(struct parser *p);
+
+static int parseNot(struct parser *p) {
+	int n;
+	if(p->tok == TOK_NOT) {
+		next(p);
+		return addNode(p, QUERY_NOT, parseNot(p), -1);
+	}
+	if(p->tok == TOK_OPEN) {
+		next(p);
+		n = parseOr(p);
+		if(n < 0) return -1;
+		if(p->tok != TOK_CLOSE) return fail(p, "expected )");
+		next(p);
+		return n;
+	}
+	return parseCompare(p);
+}
+
+static int parseAnd(struct parser *p) {
+	int n = parseNot(p);
+	while(n >= 0 && p->tok == TOK_AND) {
+		next(p);
+		n = addNode(p, QUERY_AND, n, parseNot(p));
+	}
+	return n;
+}
+
+static int parseOr(struct parser *p) {
+	int n = parseAnd(p);
+	while(n >= 0 && p->tok == TOK_OR) {
+		next(p);
+		n = addNode(p, QUERY_OR, n, parseAnd(p));
+	}
+	return n;
+}
+
+const char* queryParse(struct query *q, const char *text, int *errPos) {
+	struct parser p;
+
+	memset(&p, 0, sizeof(p));
+	q->nNodes = 0;
+	p.q = q;
+	p.text = p.pos = text;
+	next(&p);
+	q->root = parseOr(&p);
+	if(!p.err && p.tok != TOK_END)
+		p.err = "expected and, or or the end of the query";
+	*errPos = p.tokStart - text;
+	return p.err;
+}
+
+//one comparison over a block of a column -- these are the loops the compiler can vectorize
+#define COMPARE_LOOP(type) do { \
+		const type *col = (const type*)cat->cols[node->column] + start; \
+		const type mask = node->mask; \
+		const u64 v = node->value; \
+		switch(node->op) { \
+			case OP_EQ: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) == v; break; \
+			case OP_NE: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) != v; break; \
+			case OP_LT: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) < v; break; \
+			case OP_LE: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) <= v; break; \
+			case OP_GT: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) > v; break; \
+			case OP_GE: for(i=0; i<len; i++) out[i] = (u64)(col[i] & mask) >= v; break; \
+		} \
+	} while(0)
+
+static void evalNode(const struct query *q, int n, const struct catalog *cat, u32 start, u32 len, u8 *out) {
+	const struct queryNode *node = &q->nodes[n];
+	u8 other[QUERY_BLOCK];
+	u32 i, any;
+
+	switch(node->kind) {
+		case QUERY_COMPARE:
+			switch(catalogColumnSize[node->column]) {
+				case 1: COMPARE_LOOP(u8); break;
+				case 2: COMPARE_LOOP(u16); break;
+				case 4: COMPARE_LOOP(u32); break;
+				default: COMPARE_LOOP(u64); break;
+			}
+			if(node->configOnly) {
+				const u8 *status = (const u8*)cat->cols[CATALOG_STATUS] + start;
+				for(i=0; i<len; i++)
+					out[i] &= status[i] == CATALOG_OK;
+			}
+			break;
+		case QUERY_AND:
+		case QUERY_OR:
+			evalNode(q, node->left, cat, start, len, out);
+			//skip the other side when this one already decides the whole block
+			for(i=0, any=0; i<len; i++)
+				any |= out[i];
+			if(node->kind == QUERY_AND ? !any : (any && memchr(out, 0, len) == NULL))
+				break;
+			evalNode(q, node->right, cat, start, len, other);
+			if(node->kind == QUERY_AND)
+				for(i=0; i<len; i++) out[i] &= other[i];
+			else
+				for(i=0; i<len; i++) out[i] |= other[i];
+			break;
+		case QUERY_NOT:
+			evalNode(q, node->left, cat, start, len, out);
+			for(i=0; i<len; i++)
+				out[i] ^= 1;
+			break;
+	}
+}
+
+u32 queryRun(const struct query *q, const struct catalog *cat, u8 *match) {
+	u32 start, len, i, nMatched = 0;
+
+	for(start=0; start<cat->n; start+=len) {
+		len = cat->n - start < QUERY_BLOCK ? cat->n - start : QUERY_BLOCK;
+		evalNode(q, q->root, cat, start, len, match + start);
+		for(i=0; i<len; i++)
+			nMatched += match[start + i];
+	}
+	return nMatched;
+}
@@ -0,0 +1,50 @@
+#ifndef __QUERY_H__
+#define __QUERY_H__
+
+/* Queries over a catalog index
+ * A query is comparisons of catalog fields against values, joined with
+ * and / or / not and brackets, e.g.
+ *  saveType == FLASM_1M_MACRONIX_RTC and (lcdGhosting < 0xff or sleepButtons == none)
+ * Fields: titleId, fileSize, romSize, saveType, sleepButtons, lcdGhosting,
+ * lut, status, compressed, manual. Compare with == != < <= > >= (lut, status
+ * and the flags only ==, !=). The config fields (romSize, saveType,
+ * sleepButtons, lcdGhosting, lut) never match a title whose config couldn't
+ * be read. compressed and manual can also stand alone as true/false.
+ * Values are numbers (decimal or 0x hex), or by field:
+ *  saveType: the names in enum saveType
+ *  sleepButtons: buttons like L+R+Select, or none
+ *  lut: linear, gamma (what the video parameter editor starts from), darken-N
+ *       (a linear LUT with dark filter N, like Nintendo's VCs use), or a
+ *       fingerprint (see catalogLutHash) as a number
+ *  status: ok, unreadable, encrypted, no_config
+ * The query runs a column at a time over blocks of titles: each comparison
+ * is a tight loop over one column, and and / or / not combine the results.
+ */
+
+#include "gbacia.h"
+#include "catalog.h"
+
+#define QUERY_MAX_NODES 64
+
+struct queryNode {
+	int kind;	//QUERY_COMPARE, QUERY_AND, QUERY_OR, QUERY_NOT
+	int column;	//enum catalogColumn, for a comparison
+	int op;
+	u64 mask;	//the bits of the column compared
+	u64 value;
+	int configOnly;	//only matches titles whose config was read
+	int left, right;	//child nodes
+};
+
+struct query {
+	struct queryNode nodes[QUERY_MAX_NODES];
+	int nNodes;
+	int root;
+};
+
+//returns a string on failure, NULL on success; *errPos is where in text the problem is
+const char* queryParse(struct query *q, const char *text, int *errPos);
+//match gets a 1 or 0 for each title in cat; returns how many matched
+u32 queryRun(const struct query *q, const struct catalog *cat, u8 *match);
+
+#endif /* __QUERY_H__ */
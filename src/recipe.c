@@ -0,0 +1,250 @@
+/* agb_edit job recipe reader for headless mode */
+
+#include <math.h>
+#include "recipe.h"
+#include "videolut.h"
+#include "savetype.h"
+#include "patch.h"
+
+//strip leading and trailing whitespace in place
+static char* trim(char *s) {
+	char *end;
+	while(isspace((unsigned char)*s)) s++;
+	end = s + strlen(s);
+	while(end > s && isspace((unsigned char)end[-1])) end--;
+	*end = '\0';
+	return s;
+}
+
+//parse a whole integer in decimal or 0xHEX, inclusive range
+static int getInt(const char *value, int minimum, int maximum, int *out) {
+	char *end;
+	long n = strtol(value, &end, 0);
+	if(end == value || *end != '\0' || n < minimum || n > maximum) return 0;
+	*out = n;
+	return 1;
+}
+
+//parse a real number, inclusive range
+static int getReal(const char *value, double minimum, double maximum, double *out) {
+	char *end;
+	double n = strtod(value, &end);
+	if(end == value || *end != '\0' || isnan(n) || n < minimum || n > maximum) return 0;
+	*out = n;
+	return 1;
+}
+
+static const char* loadLutFile(const char *fname, u8 lut[3*256]) {
+	FILE *fp = fopen(fname, "rb");
+	size_t nread;
+	int extra;
+	if(!fp) return "can't open lut_file";
+	nread = fread(lut, 1, 3*256, fp);
+	extra = fgetc(fp);
+	fclose(fp);
+	if(nread != 3*256 || extra != EOF) return "lut_file must be exactly 768 bytes";
+	return NULL;
+}
+
+//same as the preset quick fix in the questionnaire
+static void setPreset(struct editSettings *settings) {
+	settings->setSleepButtons = 1;
+	settings->sleepButtons = BTN_L | BTN_R | BTN_SELECT;
+	settings->setLcdGhosting = 1;
+	settings->lcdGhosting = 0xff;
+	settings->setVideoLUT = 1;
+	lutResetParams(1);
+	settings->fixSaveType = 1;
+}
+
+//apply one key -- returns a string on failure, NULL on success
+static const char* applyKey(struct editSettings *settings, const char *key, const char *value, int *op, int *lutParams, int *lutFile) {
+	static const char *channels[4] = {"red", "green", "blue", "all"};
+	double real, red, green, blue;
+	char extra;
+	int n, i;
+
+	if(0 == strcasecmp(key, "operation")) {
+		if(*op) return "operation is set twice";
+		if(0 == strcasecmp(value, "analyze")) {
+			settings->onlyInfo = 1;
+			*op = 'a';
+		} else if(0 == strcasecmp(value, "extract")) {
+			settings->onlyInfo = 1;
+			settings->extractAll = 1;
+			*op = 'x';
+		} else if(0 == strcasecmp(value, "dump")) {
+			settings->onlyInfo = 1;
+			settings->dumpRom = 1;
+			*op = 'd';
+		} else if(0 == strcasecmp(value, "preset")) {
+			setPreset(settings);
+			*op = 'p';
+		} else if(0 == strcasecmp(value, "edit")) {
+			*op = 'e';
+		} else {
+			return "operation must be analyze, preset, edit, extract or dump";
+		}
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "sleep_buttons")) {
+		settings->setSleepButtons = 1;
+		if(0 == strcasecmp(value, "none"))
+			settings->sleepButtons = 0;
+		else if((settings->sleepButtons = encodeButtons(value)) == 0xffff)
+			return "bad sleep_buttons";
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "ghosting")) {
+		if(!getInt(value, 1, 255, &n)) return "ghosting must be 1 to 255";
+		settings->setLcdGhosting = 1;
+		settings->lcdGhosting = n;
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "save_type")) {
+		if(getInt(value, 0, 0xf, &n))
+			settings->saveType = n;
+		else if((settings->saveType = encodeSaveType(value)) == 0xffffffff)
+			return "save_type must be a name from enum saveType, like SRAM_256K, or 0 to 0xf";
+		settings->setSaveType = 1;
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "save_timing")) {
+		if(!(settings->saveTiming = saveTimingFromString(value)))
+			return "save_timing must be stock, fast or fastest";
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "fix_save_type")) {
+		if(0 == strcasecmp(value, "yes")) settings->fixSaveType = 1;
+		else if(0 == strcasecmp(value, "no")) settings->fixSaveType = 0;
+		else return "fix_save_type must be yes or no";
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "rom_patch")) {
+		struct romPatch patch;
+		if(strlen(value) >= sizeof(settings->romPatch)) return "rom_patch path is too long";
+		if(patchOpen(&patch, value)) return "rom_patch must be an IPS, UPS or BPS patch file";	//find out now, not halfway through a batch
+		patchClose(&patch);
+		strcpy(settings->romPatch, value);
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "rom_file")) {
+		FILE *fp;
+		if(strlen(value) >= sizeof(settings->romFile)) return "rom_file path is too long";
+		if(!(fp = fopen(value, "rb"))) return "can't open rom_file";
+		fclose(fp);
+		strcpy(settings->romFile, value);
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "trim_rom")) {
+		if(0 == strcasecmp(value, "yes")) settings->trimRom = 1;
+		else if(0 == strcasecmp(value, "no")) settings->trimRom = 0;
+		else return "trim_rom must be yes or no";
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "name")) {
+		if(*value == '\0' || strlen(value) >= sizeof(settings->name) || strpbrk(value, "\\/:*?\"<>|()"))
+			return "name must be up to 63 characters that can go in a file name";
+		strcpy(settings->name, value);
+		return NULL;
+
+	} else if(0 == strcasecmp(key, "lut_file")) {
+		*lutFile = 1;
+		settings->setVideoLUT = 1;
+		return loadLutFile(value, settings->videoLUT);
+	}
+
+	//everything else is a video parameter
+	*lutParams = 1;
+	settings->setVideoLUT = 1;
+	if(0 == strcasecmp(key, "reset")) {
+		if(0 == strcasecmp(value, "gamma")) lutResetParams(1);
+		else if(0 == strcasecmp(value, "linear")) lutResetParams(0);
+		else return "reset must be gamma or linear";
+	} else if(0 == strcasecmp(key, "channel")) {
+		for(i=0; i<4 && 0 != strcasecmp(value, channels[i]); i++);
+		if(i == 4) return "channel must be red, green, blue or all";
+		lutSetActiveChannel(i);
+	} else if(0 == strcasecmp(key, "brightness")) {
+		if(!getReal(value, -1.0, 1.0, &real)) return "brightness must be -1 to 1";
+		lutSetBrightness(real);
+	} else if(0 == strcasecmp(key, "contrast")) {
+		if(!getReal(value, 0.0, 10.0, &real) || real == 0.0) return "contrast must be more than 0, up to 10";
+		lutSetContrast(real);
+	} else if(0 == strcasecmp(key, "dark_filter")) {
+		if(!getInt(value, 0, 255, &n)) return "dark_filter must be 0 to 255";
+		lutSetContrast(1.0 - n / 255.0);
+	} else if(0 == strcasecmp(key, "gamma_in") || 0 == strcasecmp(key, "gamma_out")) {
+		if(!getReal(value, 0.0, 5.0, &real) || real == 0.0) return "gamma must be more than 0, up to 5";
+		if(tolower((unsigned char)key[6]) == 'i') lutSetGammaIn(real);
+		else lutSetGammaOut(real);
+	} else if(0 == strcasecmp(key, "invert")) {
+		if(!getReal(value, -1.0, 1.0, &real)) return "invert must be -1 to 1";
+		lutSetInvert(real);
+	} else if(0 == strcasecmp(key, "solarize")) {
+		if(!getReal(value, 0.0, 1.0, &real)) return "solarize must be 0 to 1";
+		lutSetSolarize(real);
+	} else if(0 == strcasecmp(key, "white_point")) {
+		if(3 != sscanf(value, "%lf , %lf , %lf %c", &red, &green, &blue, &extra)
+				|| red < 0 || red > 1 || green < 0 || green > 1 || blue < 0 || blue > 1)
+			return "white_point must be 3 numbers from 0 to 1, separated by commas";
+		lutSetWhitePointColor(red, green, blue);
+	} else if(0 == strcasecmp(key, "color_temp")) {
+		if(!getInt(value, 1000, 25000, &n)) return "color_temp must be 1000 to 25000";
+		lutSetColorTemp(n);
+	} else if(0 == strcasecmp(key, "ceiling")) {
+		if(!getInt(value, 0, 255, &n)) return "ceiling must be 0 to 255";
+		lutSetCeiling(n);
+	} else if(0 == strcasecmp(key, "floor")) {
+		if(!getInt(value, 0, 255, &n)) return "floor must be 0 to 255";
+		lutSetFloor(n);
+	} else {
+		return "unknown key";
+	}
+	return NULL;
+}
+
+const char* recipeLoad(const char *fname, struct editSettings *settings, int *line) {
+	char buf[4096], *key, *value, *eq;
+	const char *result = NULL;
+	int op = 0, lutParams = 0, lutFile = 0;
+	FILE *fp;
+
+	*line = 0;
+	memset(settings, 0, sizeof(struct editSettings));
+	lutResetParams(1);
+	fp = fopen(fname, "r");
+	if(!fp) return "can't open recipe";
+
+	while(!result && fgets(buf, sizeof(buf), fp)) {
+		++*line;
+		key = trim(buf);
+		if(*key == '\0' || *key == ';' || *key == '#' || *key == '[')
+			continue;
+		eq = strchr(key, '=');
+		if(!eq) { result = "expected key = value"; break; }
+		*eq = '\0';
+		key = trim(key);
+		value = trim(eq + 1);
+		result = applyKey(settings, key, value, &op, &lutParams, &lutFile);
+	}
+	if(!result && ferror(fp)) result = "can't read recipe";
+	fclose(fp);
+	if(result) return result;
+
+	*line = 0;
+	if(!op) return "recipe has no operation";
+	if(lutParams && lutFile) return "use either lut_file or video parameters, not both";
+	if(settings->setVideoLUT && !lutFile)
+		makeVideoLUT(settings->videoLUT);
+	if(settings->romPatch[0] && settings->romFile[0]) return "use either rom_file or rom_patch, not both";
+	if(op == 'e' && !settings->setSleepButtons && !settings->setLcdGhosting && !settings->setVideoLUT
+			&& !settings->setSaveType && !settings->fixSaveType && !settings->saveTiming
+			&& !settings->romPatch[0] && !settings->romFile[0] && !settings->trimRom)
+		return "edit recipe makes no changes";
+	if(settings->onlyInfo && (settings->setSleepButtons || settings->setLcdGhosting || settings->setVideoLUT
+			|| settings->setSaveType || settings->fixSaveType || settings->saveTiming
+			|| settings->romPatch[0] || settings->romFile[0] || settings->trimRom))
+		return "edits only go with operation = edit or preset";
+	return NULL;
+}
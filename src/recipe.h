@@ -0,0 +1,36 @@
+#ifndef __RECIPE_H__
+#define __RECIPE_H__
+
+/* Job recipes for running headless
+ * A recipe is an INI style text file that says what to do to every cia, in
+ * place of answering the questionnaire. Lines are "key = value"; blank lines
+ * and lines starting with ; or # are ignored, and so are [section] headers.
+ *  operation = analyze | preset | edit | extract | dump
+ *  sleep_buttons = L+R+Select (same names as the questionnaire; "none" clears them)
+ *  ghosting = 1..255
+ *  lut_file = raw 768 byte LUT to use as-is
+ *  save_type = SRAM_256K | FLASH_512K_SST | ... (names from enum saveType) | 0..0xf (force the config's save type)
+ *  fix_save_type = yes | no (fix a save type that doesn't match the ROM's save library)
+ *  save_timing = stock | fast | fastest (save chip timing profile, set by chip)
+ *  rom_patch = IPS, UPS or BPS patch to apply to the ROM
+ *  rom_file = GBA ROM to put in place of the one in the cia
+ *  trim_rom = yes | no (cut the padding off the end of the ROM)
+ *  name = what to call this variant in the output's name when fanning out
+ * and the video parameters, applied in order like the video parameter editor
+ * (starting from the gamma corrected defaults):
+ *  reset = gamma | linear
+ *  channel = red | green | blue | all
+ *  brightness, contrast, gamma_in, gamma_out, invert, solarize = real number
+ *  dark_filter, ceiling, floor = 0..255
+ *  white_point = red, green, blue (0..1 each)
+ *  color_temp = 1000..25000
+ * preset sets everything preset mode does; keys after it override that.
+ */
+
+#include "gbacia.h"
+
+//fills in settings from the recipe -- returns a string on failure, NULL on success
+//*line is set to the line the error is on, or 0 if it isn't about a particular line
+const char* recipeLoad(const char *fname, struct editSettings *settings, int *line);
+
+#endif /* __RECIPE_H__ */
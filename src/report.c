@@ -0,0 +1,170 @@
+/* agb_edit NDJSON analysis report */
+
+#include "report.h"
+#include "console_ui.h"
+
+const char* reportOpen(struct report *report, const char *fname, int lutFormat, int graph) {
+	report->lutFormat = lutFormat;
+	report->graph = graph;
+	return jsonOpen(&report->json, fname);
+}
+
+const char* reportClose(struct report *report) {
+	return jsonClose(&report->json);
+}
+
+static void keyU64(struct jsonWriter *w, const char *key, u64 n) {
+	jsonKey(w, key);
+	jsonU64(w, n);
+}
+
+static void keyString(struct jsonWriter *w, const char *key, const char *s) {
+	jsonKey(w, key);
+	jsonString(w, s);
+}
+
+static void writeConfig(struct report *report, const struct titleInfo *info) {
+	struct jsonWriter *w = &report->json;
+	const struct config *cfg = &info->config;
+	char buttons[512], *name;
+
+	jsonKey(w, "config");
+	jsonBeginObject(w);
+	keyU64(w, "offset", info->cfgOffset);
+	keyU64(w, "romSize", cfg->romSize);
+	keyU64(w, "saveType", cfg->saveType);
+	keyString(w, "saveTypeName", saveTypeToString(cfg->saveType));
+	keyU64(w, "sleepButtons", cfg->sleepButtons);
+
+	//decodeButtons gives them space separated, in display order
+	jsonKey(w, "sleepButtonNames");
+	jsonBeginArray(w);
+	if(cfg->sleepButtons) {
+		strncpy(buttons, decodeButtons(cfg->sleepButtons), sizeof(buttons) - 1);
+		buttons[sizeof(buttons) - 1] = '\0';
+		for(name = strtok(buttons, " "); name; name = strtok(NULL, " "))
+			jsonString(w, name);
+	}
+	jsonEndArray(w);
+
+	jsonKey(w, "saveConfig");
+	jsonBeginObject(w);
+	keyU64(w, "flashChipEraseCycles", cfg->saveConfig.flashChipEraseCycles);
+	keyU64(w, "flashSectorEraseCycles", cfg->saveConfig.flashSectorEraseCycles);
+	keyU64(w, "flashProgramCycles", cfg->saveConfig.flashProgramCycles);
+	keyU64(w, "eepromWriteCycles", cfg->saveConfig.eepromWriteCycles);
+	jsonEndObject(w);
+	keyU64(w, "lcdGhosting", cfg->lcdGhosting);
+
+	jsonKey(w, "videoLUT");
+	if(report->lutFormat == REPORT_LUT_ARRAY) {
+		jsonBeginArray(w);
+		for(int i=0; i<3*256; i++)
+			jsonU64(w, cfg->videoLUT[i]);
+		jsonEndArray(w);
+	} else {
+		jsonBase64(w, cfg->videoLUT, sizeof(cfg->videoLUT));
+	}
+	if(report->graph) {
+		char graph[LUT_H][LUT_W+1];
+		drawVideoLUT(cfg->videoLUT, graph);
+		jsonKey(w, "videoLUTGraph");
+		jsonBeginArray(w);
+		for(int i=0; i<LUT_H; i++)
+			jsonString(w, graph[i]);
+		jsonEndArray(w);
+	}
+	jsonEndObject(w);
+}
+
+void reportTitle(struct report *report, const struct job *job) {
+	struct jsonWriter *w = &report->json;
+	const struct titleInfo *info = job->info;
+	char titleId[17];
+	int i;
+
+	jsonBeginObject(w);
+	keyString(w, "file", job->fname);
+	keyString(w, "status", job->status ? job->status : "not run");
+	if(info->titleId) {
+		snprintf(titleId, sizeof(titleId), "%016llx", info->titleId);
+		keyString(w, "titleId", titleId);
+	}
+
+	if(info->haveFooter) {
+		jsonKey(w, "footer");
+		jsonBeginObject(w);
+		keyU64(w, "offset", info->footer.offset);
+		keyU64(w, "nDesc", info->footer.nDesc >> 4);
+		jsonEndObject(w);
+
+		jsonKey(w, "sections");
+		jsonBeginArray(w);
+		for(i=0; i<info->nSections && i<REPORT_MAX_SECTIONS; i++) {
+			const struct sectionDescriptor *sec = &info->sections[i];
+			jsonBeginObject(w);
+			keyU64(w, "type", sec->type);
+			keyString(w, "typeName", sectionTypeToString(sec->type));
+			keyU64(w, "offset", sec->offset);
+			keyU64(w, "size", sec->size);
+			keyU64(w, "padding", sec->padding);
+			jsonEndObject(w);
+		}
+		jsonEndArray(w);
+		keyU64(w, "nConfigs", info->nConfigs);
+		if(info->nConfigs == 1)
+			writeConfig(report, info);
+	}
+
+	if(info->saveChecked) {
+		static const char *results[] = {"unknown", "match", "wrong"};
+		jsonKey(w, "saveCheck");
+		jsonBeginObject(w);
+		keyString(w, "result", results[info->saveCheck]);
+		jsonKey(w, "libraries");
+		jsonBeginArray(w);
+		for(i=0; i<info->saveScan.nLibs; i++)
+			jsonString(w, info->saveScan.libs[i]);
+		jsonEndArray(w);
+		keyString(w, "kind", saveKindToString(info->saveScan.kinds));
+		jsonKey(w, "rtc");
+		jsonBool(w, info->saveScan.kinds & SAVE_KIND_RTC);
+		if(info->saveCheck == SAVE_CHECK_WRONG && info->fixedSaveType != SAVE_TYPE_UNFIXABLE) {
+			keyU64(w, "fixedSaveType", info->fixedSaveType);
+			keyString(w, "fixedSaveTypeName", saveTypeToString(info->fixedSaveType));
+		}
+		jsonEndObject(w);
+	}
+
+	if(info->trimChecked) {
+		jsonKey(w, "trim");
+		jsonBeginObject(w);
+		keyU64(w, "dataEnd", info->trim.dataEnd);
+		keyU64(w, "fill", info->trim.fill);
+		keyU64(w, "trimmedSize", info->trim.trimmedSize);
+		keyU64(w, "savings", info->trimRomSize - info->trim.trimmedSize);
+		if(info->trim.unsafe)
+			keyString(w, "unsafe", info->trim.unsafe);
+		jsonEndObject(w);
+	}
+
+	if(info->dumped) {
+		char crc[9];
+		jsonKey(w, "rom");
+		jsonBeginObject(w);
+		keyU64(w, "size", info->romSize);
+		snprintf(crc, sizeof(crc), "%08x", info->hashes.crc32);
+		keyString(w, "crc32", crc);
+		jsonKey(w, "md5");
+		jsonHex(w, info->hashes.md5, sizeof(info->hashes.md5));
+		jsonKey(w, "sha1");
+		jsonHex(w, info->hashes.sha1, sizeof(info->hashes.sha1));
+		jsonKey(w, "sha256");
+		jsonHex(w, info->hashes.sha256, sizeof(info->hashes.sha256));
+		if(job->datStatus[0] != '\0')
+			keyString(w, "dat", job->datStatus);
+		jsonEndObject(w);
+	}
+	jsonEndObject(w);
+	jsonEndLine(w);
+}
@@ -0,0 +1,60 @@
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+/* Machine-readable analysis output
+ * Instead of the usual text, every title gets one JSON object on its own line
+ * (NDJSON): the footer, section descriptors, config with its buttons decoded,
+ * the video LUT, the save type check, how much padding could be trimmed off
+ * the ROM, and the ROM hashes and DAT verdict if it
+ * was dumped.
+ * processCodeBin fills in a titleInfo for each job, and the batch writes them
+ * out in input order through one buffered writer.
+ */
+
+#include "gbacia.h"
+#include "json.h"
+#include "romhash.h"
+#include "savetype.h"
+#include "romedit.h"
+
+#define REPORT_MAX_SECTIONS 16	//any more than this are counted but not listed
+
+enum reportLutFormat {
+	REPORT_LUT_BASE64,	//the 0x300 bytes as one base64 string
+	REPORT_LUT_ARRAY	//768 numbers, RGB triplets in order
+};
+
+//what processCodeBin found in one title
+struct titleInfo {
+	u64 titleId;
+	int haveFooter;	//the footer was there and good
+	struct footer footer;
+	int nSections;
+	struct sectionDescriptor sections[REPORT_MAX_SECTIONS];
+	int nConfigs;
+	u32 cfgOffset;
+	struct config config;	//the config as it is in the cia, if nConfigs is 1
+	int saveChecked;	//the ROM was scanned for its save library
+	int saveCheck;	//enum saveCheckResult
+	struct saveScan saveScan;
+	u32 fixedSaveType;	//what saveCheck says the save type should be
+	int trimChecked;	//the ROM was scanned for padding
+	u32 trimRomSize;
+	struct romTrim trim;
+	int dumped;	//the ROM was dumped and hashed
+	u32 romSize;
+	struct romHashes hashes;
+};
+
+struct report {
+	struct jsonWriter json;
+	int lutFormat;	//enum reportLutFormat
+	int graph;	//also draw the LUT graph, as lines of text
+};
+
+//both return a string on failure, NULL on success
+const char* reportOpen(struct report *report, const char *fname, int lutFormat, int graph);
+const char* reportClose(struct report *report);
+void reportTitle(struct report *report, const struct job *job);	//job must have finished
+
+#endif /* __REPORT_H__ */
@@ -0,0 +1,348 @@
+/* agb_edit ROM edits inside code.bin */
+
+#include "romedit.h"
+#include "patch.h"
+#include "savetype.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//where the ROM ends and the sections after it start
+struct romLayout {
+	u32 romSize;
+	u32 tailStart;	//first byte after the ROM that anything points at
+	u32 align;	//what tailStart is aligned to, which the moved tail keeps
+};
+
+//puts the new ROM into a code.bin -- rom is newRomSize bytes, already in the new code.bin
+typedef const char* (*romFill)(void *ctx, u8 *rom, u32 newRomSize);
+
+//work out the layout, making sure nothing but the ROM lives below the end of it
+static const char* readLayout(const u8 *code, u32 codeSize, struct romLayout *l) {
+	struct footer ftr;
+	struct sectionDescriptor sec;
+	u32 i, nDesc, haveRom = 0;
+
+	if(codeSize < sizeof(struct footer)) return "code.bin too small for footer";
+	memcpy(&ftr, code + codeSize - sizeof(struct footer), sizeof(struct footer));
+	nDesc = ftr.nDesc >> 4;
+	if(ftr.offset > codeSize || nDesc > (codeSize - ftr.offset) / sizeof(struct sectionDescriptor))
+		return "section table runs past end of code.bin";
+	for(i=0; i<nDesc; i++) {
+		memcpy(&sec, code + ftr.offset + i * sizeof(struct sectionDescriptor), sizeof(struct sectionDescriptor));
+		if(sec.type == 0 && sec.offset == 0) {
+			if(haveRom && sec.size != l->romSize) return "ROM sections disagree on the ROM's size";
+			l->romSize = sec.size;
+			haveRom = 1;
+		}
+	}
+	if(!haveRom) return "no ROM section";
+	if(l->romSize > codeSize) return "ROM runs past end of code.bin";
+
+	l->tailStart = ftr.offset;
+	for(i=0; i<nDesc; i++) {
+		memcpy(&sec, code + ftr.offset + i * sizeof(struct sectionDescriptor), sizeof(struct sectionDescriptor));
+		if(sec.type == 0 && sec.offset == 0)
+			continue;
+		if(sec.offset == 0xffffffff)	//nowhere, so nothing to move
+			continue;
+		if(sec.offset < l->romSize) return "a section overlaps the ROM";
+		if(sec.offset < l->tailStart)
+			l->tailStart = sec.offset;
+	}
+	if(l->tailStart < l->romSize) return "section descriptors overlap the ROM";
+
+	for(l->align = 0x1000; l->align > 1 && (l->tailStart & (l->align - 1)); l->align >>= 1);
+	return NULL;
+}
+
+//fix up a tail that's been moved by delta to follow a ROM that's now newRomSize: the footer, the descriptors
+//it points to, and the config, which gets cfg with the new size
+static void fixTail(u8 *code, u32 codeSize, s64 delta, u32 newRomSize, const struct config *cfg, u32 newCfgOffset) {
+	struct footer ftr;
+	struct sectionDescriptor sec;
+	struct config newCfg = *cfg;
+	u32 i;
+
+	//footer first, since it says where the descriptors went
+	memcpy(&ftr, code + codeSize - sizeof(struct footer), sizeof(struct footer));
+	ftr.offset += delta;
+	memcpy(code + codeSize - sizeof(struct footer), &ftr, sizeof(struct footer));
+	for(i=0; i<ftr.nDesc>>4; i++) {
+		u8 *p = code + ftr.offset + i * sizeof(struct sectionDescriptor);
+		memcpy(&sec, p, sizeof(struct sectionDescriptor));
+		if(sec.type == 0 && sec.offset == 0)
+			sec.size = newRomSize;
+		else if(sec.offset != 0xffffffff)
+			sec.offset += delta;
+		memcpy(p, &sec, sizeof(struct sectionDescriptor));
+	}
+
+	//EEPROM addressing goes by whether the ROM is over 16 MB, so that has to follow the new size
+	newCfg.romSize = newRomSize;
+	if(newCfg.saveType <= EEPROM_64K_256MROM)
+		newCfg.saveType = (newCfg.saveType & ~1) | (newRomSize > (16 << 20));
+	memcpy(code + newCfgOffset, &newCfg, sizeof(struct config));
+}
+
+//where the tail goes after a ROM of newRomSize
+static u32 tailFor(const struct romLayout *l, u32 newRomSize) {
+	return (newRomSize + l->align - 1) & ~(l->align - 1);
+}
+
+//build code.bin around a new ROM: the tail is moved to follow it, and everything pointing into the tail is fixed up
+static const char* splice(const u8 *code, u32 codeSize, const struct romLayout *l, const struct config *cfg,
+		u32 cfgOffset, u32 newRomSize, romFill fill, void *ctx, u8 **newCode, u32 *newCodeSize, u32 *newCfgOffset) {
+	u32 newTail = tailFor(l, newRomSize);
+	u32 tailSize = codeSize - l->tailStart;
+	s64 delta = (s64)newTail - l->tailStart;
+	u8 *out;
+	u32 size = newTail + tailSize;
+	const char *result;
+
+	out = malloc(size);
+	if(!out) return "can't allocate memory (code.bin)";
+	result = fill(ctx, out, newRomSize);
+	if(result) {
+		free(out);
+		return result;
+	}
+	memset(out + newRomSize, 0, newTail - newRomSize);
+	memcpy(out + newTail, code + l->tailStart, tailSize);
+	fixTail(out, size, delta, newRomSize, cfg, cfgOffset + delta);
+
+	*newCode = out;
+	*newCodeSize = size;
+	*newCfgOffset = cfgOffset + delta;
+	return NULL;
+}
+
+//cut the ROM in a code.bin we own down to newRomSize, moving the tail down after it
+static void shrink(u8 *code, u32 *codeSize, u32 *cfgOffset, u32 newRomSize) {
+	struct romLayout l;
+	struct config cfg;
+	u32 newTail, tailSize;
+
+	readLayout(code, *codeSize, &l);	//it was just built, so it's good
+	newTail = tailFor(&l, newRomSize);
+	tailSize = *codeSize - l.tailStart;
+	memcpy(&cfg, code + *cfgOffset, sizeof(struct config));
+	memmove(code + newTail, code + l.tailStart, tailSize);
+	memset(code + newRomSize, 0, newTail - newRomSize);
+	*cfgOffset -= l.tailStart - newTail;
+	*codeSize = newTail + tailSize;
+	fixTail(code, *codeSize, -(s64)(l.tailStart - newTail), newRomSize, &cfg, *cfgOffset);
+}
+
+//patching: the patch writes the new ROM from the old one
+struct patchFill {
+	const struct romPatch *patch;
+	const u8 *rom;
+	u32 romSize;
+};
+
+static const char* fillPatched(void *ctx, u8 *rom, u32 newRomSize) {
+	const struct patchFill *f = ctx;
+	return patchApply(f->patch, f->rom, f->romSize, rom, newRomSize);
+}
+
+//replacing: the new ROM is read from its file straight into place
+static const char* fillFromFile(void *ctx, u8 *rom, u32 newRomSize) {
+	if(fread(rom, 1, newRomSize, (FILE*)ctx) != newRomSize) return "can't read rom_file";
+	return NULL;
+}
+
+//the size of a replacement ROM, leaving fp at the start
+static const char* romFileSize(FILE *fp, u32 *size) {
+	long n;
+	if(fseek(fp, 0, SEEK_END) != 0 || (n = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) return "can't read rom_file";
+	if(n < 0xc0 || n > (32 << 20)) return "rom_file must be a GBA ROM, up to 32 MB";
+	*size = n;
+	return NULL;
+}
+
+//a new ROM can use a different save library than the old one, so check again
+static void recheckSaveType(FILE *log, const struct editSettings *edit, u8 *code, u32 cfgOffset) {
+	struct config cfg;
+	struct saveScan scan;
+	u32 fixed;
+
+	memcpy(&cfg, code + cfgOffset, sizeof(struct config));
+	saveScanRom(code, cfg.romSize, &scan);
+	if(saveCheck(&scan, cfg.romSize, cfg.saveType, &fixed) != SAVE_CHECK_WRONG)
+		return;
+	if(!edit->setSaveType && edit->fixSaveType && fixed != SAVE_TYPE_UNFIXABLE) {
+		fprintf(log, "==> Edited ROM wants %s, so setting that instead of %s\n", saveTypeToString(fixed), saveTypeToString(cfg.saveType));
+		cfg.saveType = fixed;
+		if(edit->saveTiming)
+			saveTimingApply(edit->saveTiming, cfg.saveType, &cfg.saveConfig);
+		memcpy(code + cfgOffset, &cfg, sizeof(struct config));
+	} else {
+		fprintf(log, "WARNING: save type is %s, but the edited ROM uses %s\n", saveTypeToString(cfg.saveType), saveKindToString(scan.kinds));
+	}
+}
+
+//no change to the ROM itself, just a copy to trim
+static const char* fillCopy(void *ctx, u8 *rom, u32 newRomSize) {
+	memcpy(rom, ctx, newRomSize);
+	return NULL;
+}
+
+//any word in the ROM that's the address of its end (or the end's mirror) -- that's the ROM probing its own size
+//only the first scanSize bytes need looking at, since padding can't be an address
+static int pointsAtEnd(const u8 *rom, u32 scanSize, u32 romSize) {
+	u32 ends[3] = {0x08000000 + romSize, 0x0a000000 + romSize, 0x0c000000 + romSize}, w, i = 0;
+
+#ifdef __SSE2__
+	__m128i e0 = _mm_set1_epi32(ends[0]), e1 = _mm_set1_epi32(ends[1]), e2 = _mm_set1_epi32(ends[2]);
+	for(; i + 16 <= scanSize; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(rom + i));
+		__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(v, e0), _mm_cmpeq_epi32(v, e1)), _mm_cmpeq_epi32(v, e2));
+		if(_mm_movemask_epi8(hit))
+			return 1;
+	}
+#endif
+	for(; i + 4 <= scanSize; i += 4) {
+		memcpy(&w, rom + i, 4);
+		if(w == ends[0] || w == ends[1] || w == ends[2])
+			return 1;
+	}
+	return 0;
+}
+
+void romTrimScan(const u8 *rom, u32 romSize, struct romTrim *trim) {
+	u32 end = romSize;
+
+	memset(trim, 0, sizeof(struct romTrim));
+	trim->trimmedSize = romSize;
+	if(romSize == 0 || (rom[romSize - 1] != 0x00 && rom[romSize - 1] != 0xff))
+		return;
+	trim->fill = rom[romSize - 1];
+
+	//back from the end to the last byte that isn't padding, 64 then 16 bytes at a time
+#ifdef __SSE2__
+	__m128i f = _mm_set1_epi8(trim->fill);
+	while(end >= 64) {
+		const __m128i *p = (const __m128i*)(rom + end - 64);
+		__m128i same = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p), f), _mm_cmpeq_epi8(_mm_loadu_si128(p + 1), f)),
+				_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), f), _mm_cmpeq_epi8(_mm_loadu_si128(p + 3), f)));
+		if(_mm_movemask_epi8(same) != 0xffff)
+			break;
+		end -= 64;
+	}
+	while(end >= 16 && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(rom + end - 16)), f)) == 0xffff)
+		end -= 16;
+#endif
+	while(end > 0 && rom[end - 1] == trim->fill)
+		end--;
+	trim->dataEnd = end;
+
+	//keep a little of the padding, in case the last of the data really does end in bytes like it
+	end = (end + ROM_TRIM_KEEP + ROM_TRIM_ALIGN - 1) & ~(ROM_TRIM_ALIGN - 1);
+	if(end >= romSize)
+		return;
+
+	//the ROM has to look padded, and not be one that reads past its data
+	if(romSize & (romSize - 1))
+		trim->unsafe = "ROM isn't a power of two in size, so that might not be padding";
+	else if(romSize >= 0xb0 && rom[0xac] == 'F')
+		trim->unsafe = "Classic NES Series games check the ROM's mirroring past its end";
+	else if(pointsAtEnd(rom, (trim->dataEnd + 3) & ~3, romSize))
+		trim->unsafe = "ROM has the address of its own end in it, so it probably checks its size";
+	else
+		trim->trimmedSize = end;
+}
+
+//say what a trim scan found
+void romTrimPrint(FILE *log, const struct romTrim *trim, u32 romSize) {
+	if(trim->dataEnd == romSize || romSize == 0)
+		fprintf(log, "ROM padding: none\n");
+	else if(trim->unsafe)
+		fprintf(log, "ROM padding: 0x%x bytes of 0x%02x, but it can't be trimmed: %s\n", romSize - trim->dataEnd, trim->fill, trim->unsafe);
+	else if(trim->trimmedSize < romSize)
+		fprintf(log, "ROM padding: 0x%x bytes of 0x%02x, trimming saves %u KB\n", romSize - trim->dataEnd, trim->fill, (romSize - trim->trimmedSize) >> 10);
+	else
+		fprintf(log, "ROM padding: 0x%x bytes of 0x%02x, too little to trim\n", romSize - trim->dataEnd, trim->fill);
+}
+
+int romTrimmable(const u8 *code, u32 codeSize) {
+	struct romLayout layout;
+	struct romTrim trim;
+	if(readLayout(code, codeSize, &layout))
+		return 0;
+	romTrimScan(code, layout.romSize, &trim);
+	return trim.trimmedSize < layout.romSize;
+}
+
+int romEditWanted(const struct editSettings *edit) {
+	return edit->romPatch[0] != '\0' || edit->romFile[0] != '\0' || edit->trimRom;
+}
+
+const char* romEditBuild(FILE *log, const struct editSettings *edit, const u8 *code, u32 codeSize,
+		const struct config *cfg, u32 cfgOffset, u8 **newCode, u32 *newCodeSize) {
+	struct romLayout layout;
+	struct romPatch patch;
+	struct patchFill fill;
+	struct romTrim trim;
+	u32 newRomSize, newCfgOffset;
+	char oldGame[4], newGame[4];
+	int checkGame = 0;
+	FILE *fp;
+	const char *result;
+
+	result = readLayout(code, codeSize, &layout);
+	if(result) return result;
+
+	if(edit->romFile[0]) {
+		fp = fopen(edit->romFile, "rb");
+		if(!fp) return "can't open rom_file";
+		result = romFileSize(fp, &newRomSize);
+		if(!result && layout.romSize >= 0xb0) {	//the game code in the ROM header, to catch the wrong game being put in
+			memcpy(oldGame, code + 0xac, 4);
+			checkGame = 1;
+			if(fseek(fp, 0xac, SEEK_SET) != 0 || fread(newGame, 1, 4, fp) != 4 || fseek(fp, 0, SEEK_SET) != 0)
+				result = "can't read rom_file";
+		}
+		if(!result) {
+			fprintf(log, "==> Replacing the ROM with %s (0x%x bytes, was 0x%x)\n", edit->romFile, newRomSize, layout.romSize);
+			if(checkGame && memcmp(oldGame, newGame, 4))
+				fprintf(log, "WARNING: new ROM's game code '%.4s' isn't the old one's '%.4s'\n", newGame, oldGame);
+			result = splice(code, codeSize, &layout, cfg, cfgOffset, newRomSize, fillFromFile, fp, newCode, newCodeSize, &newCfgOffset);
+		}
+		fclose(fp);
+	} else if(edit->romPatch[0]) {
+		result = patchOpen(&patch, edit->romPatch);
+		if(result) return result;
+		result = patchTargetSize(&patch, layout.romSize, &newRomSize);
+		if(!result) {
+			fprintf(log, "==> Applying %s patch %s%s%s\n", patchFormatToString(patch.format), edit->romPatch,
+					patch.format == PATCH_IPS ? " (IPS has no checksums, so it can't be checked against the ROM)" : "",
+					newRomSize != layout.romSize ? ", resizing the ROM" : "");
+			fill.patch = &patch;
+			fill.rom = code;
+			fill.romSize = layout.romSize;
+			result = splice(code, codeSize, &layout, cfg, cfgOffset, newRomSize, fillPatched, &fill, newCode, newCodeSize, &newCfgOffset);
+		}
+		patchClose(&patch);
+		if(!result && newRomSize != layout.romSize)
+			fprintf(log, "==> ROM is now 0x%x bytes (was 0x%x)\n", newRomSize, layout.romSize);
+	} else {
+		newRomSize = layout.romSize;
+		result = splice(code, codeSize, &layout, cfg, cfgOffset, newRomSize, fillCopy, (void*)code, newCode, newCodeSize, &newCfgOffset);
+	}
+	if(result) return result;
+
+	//trimming goes last, so it's the new ROM's padding that goes
+	if(edit->trimRom) {
+		romTrimScan(*newCode, newRomSize, &trim);
+		if(trim.trimmedSize < newRomSize) {
+			fprintf(log, "==> Trimming 0x%x bytes of padding off the ROM, leaving 0x%x\n", newRomSize - trim.trimmedSize, trim.trimmedSize);
+			shrink(*newCode, newCodeSize, &newCfgOffset, trim.trimmedSize);
+		} else {
+			fprintf(log, "==> Not trimming the ROM: %s\n", trim.unsafe ? trim.unsafe : "there's no padding to trim");
+		}
+	}
+
+	recheckSaveType(log, edit, *newCode, newCfgOffset);
+	return NULL;
+}
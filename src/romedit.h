@@ -0,0 +1,46 @@
+#ifndef __ROMEDIT_H__
+#define __ROMEDIT_H__
+
+/* Edits to the ROM itself, rather than the config
+ * The ROM is the first section of code.bin, and everything after it (the
+ * config, the section descriptors and the footer) is found by offset. So a
+ * ROM that changes size means building a new code.bin: the new ROM is
+ * written straight into it, the rest is moved up or down to follow, and
+ * every offset and size that pointed past the ROM gets fixed to match. The
+ * config's romSize goes along with it.
+ * The new ROM (from a patch, or a whole replacement ROM file) is written
+ * straight into the new code.bin, so there's only ever the one copy of it.
+ * These can't be done by the fast path, which only ever rewrites the config.
+ *
+ * Trimming cuts off the 0xff or 0x00 bytes a ROM was padded out with to a
+ * power of two size, which is dead weight in every cia. It's refused for ROMs
+ * that look like they read past their data: ones with the address of their
+ * own end in them, which is how size and mirroring checks are usually done,
+ * and the Classic NES Series, which do that in ways a scan won't find.
+ */
+
+#include "gbacia.h"
+
+#define ROM_TRIM_KEEP 0x100	//padding left after the data
+#define ROM_TRIM_ALIGN 0x100	//what a trimmed ROM's size is rounded up to
+
+//what a trim scan found
+struct romTrim {
+	u32 dataEnd;	//just past the last byte that isn't padding
+	u32 trimmedSize;	//what the ROM can be cut to; its size if it can't be
+	u8 fill;	//what it's padded with
+	const char *unsafe;	//why it mustn't be trimmed even though it's padded, or NULL
+};
+
+void romTrimScan(const u8 *rom, u32 romSize, struct romTrim *trim);
+void romTrimPrint(FILE *log, const struct romTrim *trim, u32 romSize);
+//whether trim_rom would cut anything off the ROM in a code.bin, without printing anything -- 0 if it can't tell
+int romTrimmable(const u8 *code, u32 codeSize);
+
+int romEditWanted(const struct editSettings *edit);
+//builds a new code.bin with edit's ROM changes and cfg (the edited config) in it; *newCode is malloc'd
+//returns a string on failure, NULL on success
+const char* romEditBuild(FILE *log, const struct editSettings *edit, const u8 *code, u32 codeSize,
+		const struct config *cfg, u32 cfgOffset, u8 **newCode, u32 *newCodeSize);
+
+#endif /* __ROMEDIT_H__ */
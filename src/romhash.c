@@ -0,0 +1,74 @@
+/* agb_edit multi-lane ROM hashing */
+
+#include "romhash.h"
+#include "crc32.h"
+
+static void hashLane(struct romHasher *h, int which) {
+	struct md5 md5;
+	struct sha1 sha1;
+
+	switch(which) {
+		case 0:
+			h->hashes.crc32 = crc32Update(0, h->data, h->size);
+			break;
+		case 1:
+			md5Init(&md5);
+			md5Update(&md5, h->data, h->size);
+			md5Final(&md5, h->hashes.md5);
+			break;
+		case 2:
+			sha1Init(&sha1);
+			sha1Update(&sha1, h->data, h->size);
+			sha1Final(&sha1, h->hashes.sha1);
+			break;
+		case 3:
+			sha256(h->data, h->size, h->hashes.sha256);
+			break;
+	}
+}
+
+static void* laneThread(void *arg) {
+	struct romHashLane *lane = arg;
+	hashLane(lane->hasher, lane->which);
+	return NULL;
+}
+
+void romHashStart(struct romHasher *hasher, const u8 *data, u64 size) {
+	int i;
+	hasher->data = data;
+	hasher->size = size;
+	for(i=0; i<ROMHASH_LANES; i++) {
+		hasher->lanes[i].hasher = hasher;
+		hasher->lanes[i].which = i;
+		//a lane that can't get a thread just runs in romHashFinish instead
+		hasher->lanes[i].started = size >= ROMHASH_LANE_MIN
+			&& 0 == pthread_create(&hasher->lanes[i].thread, NULL, laneThread, &hasher->lanes[i]);
+	}
+}
+
+void romHashFinish(struct romHasher *hasher, struct romHashes *out) {
+	int i;
+	for(i=0; i<ROMHASH_LANES; i++) {
+		if(hasher->lanes[i].started)
+			pthread_join(hasher->lanes[i].thread, NULL);
+		else
+			hashLane(hasher, i);
+	}
+	*out = hasher->hashes;
+}
+
+static void printHex(FILE *out, const u8 *p, int n) {
+	for(int i=0; i<n; i++)
+		fprintf(out, "%02x", p[i]);
+	fputc('\n', out);
+}
+
+void romHashPrint(FILE *out, const struct romHashes *hashes, const char *indent) {
+	fprintf(out, "%sCRC32: %08x\n", indent, hashes->crc32);
+	fprintf(out, "%sMD5: ", indent);
+	printHex(out, hashes->md5, MD5_SIZE);
+	fprintf(out, "%sSHA-1: ", indent);
+	printHex(out, hashes->sha1, SHA1_SIZE);
+	fprintf(out, "%sSHA-256: ", indent);
+	printHex(out, hashes->sha256, SHA256_SIZE);
+}
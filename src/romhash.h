@@ -0,0 +1,48 @@
+#ifndef __ROMHASH_H__
+#define __ROMHASH_H__
+
+/* Hashing a dumped ROM for DAT checks
+ * CRC-32, MD5, SHA-1 and SHA-256 each run on their own thread over the same
+ * buffer, so they take about as long as the slowest one, and they run while
+ * the ROM is being written out rather than in a second pass over the .gba.
+ * ROMs smaller than ROMHASH_LANE_MIN aren't worth the threads and get hashed
+ * one after another in romHashFinish.
+ */
+
+#include <pthread.h>
+#include "gbacia.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+
+#define ROMHASH_LANES 4
+#define ROMHASH_LANE_MIN (1 << 20)
+
+struct romHashes {
+	u32 crc32;
+	u8 md5[MD5_SIZE];
+	u8 sha1[SHA1_SIZE];
+	u8 sha256[SHA256_SIZE];
+};
+
+struct romHasher;
+struct romHashLane {
+	struct romHasher *hasher;
+	int which;
+	int started;
+	pthread_t thread;
+};
+
+struct romHasher {
+	const u8 *data;
+	u64 size;
+	struct romHashes hashes;
+	struct romHashLane lanes[ROMHASH_LANES];
+};
+
+//data must stay valid and unchanged until romHashFinish
+void romHashStart(struct romHasher *hasher, const u8 *data, u64 size);
+void romHashFinish(struct romHasher *hasher, struct romHashes *out);	//waits for the lanes
+void romHashPrint(FILE *out, const struct romHashes *hashes, const char *indent);
+
+#endif /* __ROMHASH_H__ */
@@ -0,0 +1,185 @@
+/* agb_edit save type detection from the ROM's save library IDs, and save chip timings */
+
+#include "savetype.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//the library IDs, all followed by a 3 digit version
+static const struct {
+	const char *id;
+	u32 kind;
+} saveLibs[] = {
+	{"EEPROM_V", SAVE_KIND_EEPROM},
+	{"SRAM_V", SAVE_KIND_SRAM},
+	{"SRAM_F_V", SAVE_KIND_SRAM},
+	{"FLASH_V", SAVE_KIND_FLASH512},	//older 512 Kbit flash library
+	{"FLASH512_V", SAVE_KIND_FLASH512},
+	{"FLASH1M_V", SAVE_KIND_FLASH1M},
+	{"SIIRTC_V", SAVE_KIND_RTC}
+};
+#define N_SAVE_LIBS (sizeof(saveLibs)/sizeof(saveLibs[0]))
+
+//GBA bus cycles in a microsecond
+#define CYCLES_PER_US 16.777216
+
+//save chip timings for each profile, in microseconds
+struct timingProfile {
+	u32 chipErase, sectorErase, program;	//flash
+	u32 eepromWrite;
+};
+
+static const char *timingNames[] = {"none", "stock", "fast", "fastest"};
+
+//[profile-1][family]: EEPROM, 512 Kbit flash, 1 Mbit flash
+static const struct timingProfile timings[3][3] = {
+	{	//stock
+		{0, 0, 0, 6500},	//EEPROM writes take about 6.5 ms
+		{20000, 20000, 5000, 0},
+		{100000, 60000, 5000, 0}	//bigger sectors, slower erase
+	}, {	//fast
+		{0, 0, 0, 1625},
+		{5000, 5000, 1250, 0},
+		{25000, 15000, 1250, 0}
+	}, {	//fastest
+		{0, 0, 0, 250},
+		{1000, 500, 250, 0},
+		{1000, 500, 250, 0}
+	}
+};
+
+//every ID starts with one of these 4 words, which is what the scan looks for
+static const char prefixes[4][5] = {"EEPR", "SRAM", "FLAS", "SIIR"};
+
+//look closer at a word that starts like an ID
+static void checkWord(const u8 *rom, u32 size, u32 offset, struct saveScan *scan) {
+	u32 len, end;
+	int i, j;
+
+	for(i=0; i<N_SAVE_LIBS; i++) {
+		len = strlen(saveLibs[i].id);
+		if(offset + len > size || 0 != memcmp(rom + offset, saveLibs[i].id, len))
+			continue;
+		//take the 3 digit version along with it
+		for(end = offset + len; end < size && end < offset + len + 3 && isdigit(rom[end]); end++);
+		scan->kinds |= saveLibs[i].kind;
+		for(j=0; j<scan->nLibs; j++)
+			if(strlen(scan->libs[j]) == end - offset && 0 == memcmp(scan->libs[j], rom + offset, end - offset))
+				break;
+		if(j == scan->nLibs && scan->nLibs < SAVE_MAX_LIBS) {
+			memcpy(scan->libs[scan->nLibs], rom + offset, end - offset);
+			scan->libs[scan->nLibs++][end - offset] = '\0';
+		}
+		return;
+	}
+}
+
+void saveScanRom(const u8 *rom, u32 size, struct saveScan *scan) {
+	u32 words[4], w, i = 0;
+	int j;
+
+	memset(scan, 0, sizeof(struct saveScan));
+	for(j=0; j<4; j++)
+		memcpy(&words[j], prefixes[j], 4);
+
+#ifdef __SSE2__
+	//4 words at a time against each prefix -- almost every block has no hit at all
+	__m128i p0 = _mm_set1_epi32(words[0]), p1 = _mm_set1_epi32(words[1]);
+	__m128i p2 = _mm_set1_epi32(words[2]), p3 = _mm_set1_epi32(words[3]);
+	for(; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(rom + i));
+		__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi32(v, p0), _mm_cmpeq_epi32(v, p1)),
+				_mm_or_si128(_mm_cmpeq_epi32(v, p2), _mm_cmpeq_epi32(v, p3)));
+		int mask = _mm_movemask_epi8(hit);
+		if(mask) {
+			for(j=0; j<4; j++)
+				if(mask & (1 << (j*4)))
+					checkWord(rom, size, i + j*4, scan);
+		}
+	}
+#endif
+	//whatever's left, or all of it without SSE2
+	for(; i + 4 <= size; i += 4) {
+		memcpy(&w, rom + i, 4);
+		if(w == words[0] || w == words[1] || w == words[2] || w == words[3])
+			checkWord(rom, size, i, scan);
+	}
+}
+
+int saveCheck(const struct saveScan *scan, u32 romSize, u32 saveType, u32 *fixed) {
+	u32 kind = scan->kinds & ~SAVE_KIND_RTC;
+	int rtc = (scan->kinds & SAVE_KIND_RTC) != 0;
+
+	*fixed = SAVE_TYPE_UNFIXABLE;
+	if(kind == 0 || (kind & (kind - 1)))	//none, or more than one
+		return SAVE_CHECK_UNKNOWN;
+
+	switch(kind) {
+		case SAVE_KIND_EEPROM:
+			//the size has to come from the config -- only the ROM size half of the type can be worked out
+			if(saveType <= EEPROM_64K_256MROM)
+				*fixed = (saveType & 2) | (romSize > 0x1000000 ? 1 : 0);
+			break;
+		case SAVE_KIND_SRAM:
+			*fixed = SRAM_256K;	//AGB_FIRM has no RTC with SRAM
+			break;
+		case SAVE_KIND_FLASH512:
+			//keep the chip maker if it's already a 512 Kbit flash, otherwise Panasonic like most emulators
+			if(saveType >= FLASH_512K_ATMEL_RTC && saveType <= FLASH_512K_PANASONIC)
+				*fixed = (saveType | 1) - rtc;
+			else
+				*fixed = FLASH_512K_PANASONIC - rtc;
+			break;
+		case SAVE_KIND_FLASH1M:
+			if(saveType >= FLASM_1M_MACRONIX_RTC && saveType <= FLASM_1M_SANYO)
+				*fixed = (saveType | 1) - rtc;
+			else
+				*fixed = FLASM_1M_SANYO - rtc;
+			break;
+	}
+	return *fixed == saveType ? SAVE_CHECK_MATCH : SAVE_CHECK_WRONG;
+}
+
+const char* saveKindToString(u32 kinds) {
+	switch(kinds & ~SAVE_KIND_RTC) {
+		case SAVE_KIND_EEPROM: return "EEPROM";
+		case SAVE_KIND_SRAM: return "SRAM";
+		case SAVE_KIND_FLASH512: return "Flash 512k";
+		case SAVE_KIND_FLASH1M: return "Flash 1M";
+		case 0: return "no save library";
+		default: return "more than one save library";
+	}
+}
+
+const char* saveTimingApply(int profile, u32 saveType, struct saveConfig *saveConfig) {
+	const struct timingProfile *t;
+
+	if(profile < SAVE_TIMING_STOCK || profile > SAVE_TIMING_FASTEST) return "no such timing profile";
+	if(saveType <= EEPROM_64K_256MROM) {
+		t = &timings[profile-1][0];
+		saveConfig->eepromWriteCycles = t->eepromWrite * CYCLES_PER_US;
+		return NULL;
+	}
+	if(saveType <= FLASH_512K_PANASONIC)
+		t = &timings[profile-1][1];
+	else if(saveType <= FLASM_1M_SANYO)
+		t = &timings[profile-1][2];
+	else
+		return "the save type has no chip timings";	//SRAM, no save, or nonsense
+	saveConfig->flashChipEraseCycles = t->chipErase * CYCLES_PER_US;
+	saveConfig->flashSectorEraseCycles = t->sectorErase * CYCLES_PER_US;
+	saveConfig->flashProgramCycles = t->program * CYCLES_PER_US;
+	return NULL;
+}
+
+const char* saveTimingToString(int profile) {
+	if(profile < SAVE_TIMING_NONE || profile > SAVE_TIMING_FASTEST) return "unknown";
+	return timingNames[profile];
+}
+
+int saveTimingFromString(const char *name) {
+	for(int i=SAVE_TIMING_STOCK; i<=SAVE_TIMING_FASTEST; i++)
+		if(0 == strcasecmp(name, timingNames[i]))
+			return i;
+	return SAVE_TIMING_NONE;
+}
@@ -0,0 +1,70 @@
+#ifndef __SAVETYPE_H__
+#define __SAVETYPE_H__
+
+/* Save type detection from the ROM itself, and save chip timing profiles
+ * Games built with Nintendo's save libraries carry the library's ID string,
+ * like "FLASH1M_V103", and ones with a real time clock carry "SIIRTC_V".
+ * Finding these tells us what the game expects the save chip to be, so a
+ * wrong save type in the config (a very common cause of broken saves) can be
+ * caught and fixed. The IDs always sit on a 4 byte boundary, so the scan only
+ * has to check one word in four bytes: with SSE2 that's a 16 byte load and
+ * four compares against the first word of each ID.
+ * What the ROM can't tell us: an EEPROM's size, and which maker's flash chip
+ * it had (the libraries work with any of them).
+ *
+ * The config's saveConfig says how many bus cycles AGB_FIRM's fake save chip
+ * takes to erase and program, which is how long a game stalls while saving.
+ * Timing profiles set these by chip family: stock is about what a real cart's
+ * chip takes, fast is a quarter of that, and fastest is the shortest we
+ * consider safe: long enough that the save library's busy polling still sees
+ * the chip busy, which some games' save code counts on.
+ */
+
+#include "gbacia.h"
+
+#define SAVE_MAX_LIBS 4
+#define SAVE_LIB_SIZE 16
+
+//kinds of save library, and the RTC library -- OR'd together in saveScan.kinds
+enum saveKind {
+	SAVE_KIND_EEPROM   = 1<<0,
+	SAVE_KIND_SRAM     = 1<<1,	//includes FRAM, which acts the same
+	SAVE_KIND_FLASH512 = 1<<2,
+	SAVE_KIND_FLASH1M  = 1<<3,
+	SAVE_KIND_RTC      = 1<<4
+};
+
+//what saveCheck made of it
+enum saveCheckResult {
+	SAVE_CHECK_UNKNOWN,	//no save library found, or more than one kind -- can't say
+	SAVE_CHECK_MATCH,	//the config's save type fits the ROM
+	SAVE_CHECK_WRONG	//it doesn't
+};
+
+enum saveTiming {
+	SAVE_TIMING_NONE = 0,	//leave the timings alone
+	SAVE_TIMING_STOCK,
+	SAVE_TIMING_FAST,
+	SAVE_TIMING_FASTEST
+};
+
+#define SAVE_TYPE_UNFIXABLE 0xffffffff	//wrong, but the ROM doesn't say enough to pick the right one
+
+struct saveScan {
+	u32 kinds;	//enum saveKind bits found
+	int nLibs;
+	char libs[SAVE_MAX_LIBS][SAVE_LIB_SIZE];	//the IDs found with their versions, like "FLASH1M_V103"
+};
+
+void saveScanRom(const u8 *rom, u32 size, struct saveScan *scan);
+//check a config's save type against the scan -- *fixed gets what it should be, or SAVE_TYPE_UNFIXABLE
+//romSize decides between the EEPROM types for small and 256 Mbit ROMs
+int saveCheck(const struct saveScan *scan, u32 romSize, u32 saveType, u32 *fixed);
+const char* saveKindToString(u32 kinds);	//the save library kind in kinds, ignoring RTC
+//set the timings for saveType's chip -- returns a string if there's nothing to set (SRAM, no save), NULL on success
+//only the fields that chip uses change
+const char* saveTimingApply(int profile, u32 saveType, struct saveConfig *saveConfig);
+const char* saveTimingToString(int profile);
+int saveTimingFromString(const char *name);	//SAVE_TIMING_NONE if it isn't one
+
+#endif /* __SAVETYPE_H__ */
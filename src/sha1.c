@@ -0,0 +1,95 @@
+/* agb_edit SHA-1 implementation (FIPS 180-4) */
+
+#include "sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+//compress one or more whole 64 byte blocks
+static void sha1Blocks(u32 state[5], const u8 *p, size_t nBlocks) {
+	u32 w[80], a, b, c, d, e, f, k, tmp;
+	int i;
+
+	while(nBlocks--) {
+		for(i=0; i<16; i++)
+			w[i] = ((u32)p[i*4]<<24) | ((u32)p[i*4+1]<<16) | ((u32)p[i*4+2]<<8) | p[i*4+3];
+		for(; i<80; i++)
+			w[i] = ROL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+		for(i=0; i<80; i++) {
+			if(i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if(i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if(i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+			tmp = ROL(a, 5) + f + e + k + w[i];
+			e = d; d = c; c = ROL(b, 30); b = a; a = tmp;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+		p += 64;
+	}
+}
+
+void sha1Init(struct sha1 *ctx) {
+	static const u32 init[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+	memcpy(ctx->state, init, sizeof(init));
+	ctx->length = 0;
+	ctx->bufLen = 0;
+}
+
+void sha1Update(struct sha1 *ctx, const void *data, size_t len) {
+	const u8 *p = data;
+	size_t n;
+
+	ctx->length += len;
+	//top up a partial block first
+	if(ctx->bufLen) {
+		n = 64 - ctx->bufLen;
+		if(n > len) n = len;
+		memcpy(ctx->buf + ctx->bufLen, p, n);
+		ctx->bufLen += n;
+		p += n;
+		len -= n;
+		if(ctx->bufLen < 64) return;
+		sha1Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	//whole blocks straight from the caller's buffer
+	if(len >= 64) {
+		sha1Blocks(ctx->state, p, len/64);
+		p += len & ~(size_t)63;
+		len &= 63;
+	}
+	memcpy(ctx->buf, p, len);
+	ctx->bufLen = len;
+}
+
+void sha1Final(struct sha1 *ctx, u8 out[SHA1_SIZE]) {
+	u64 bits = ctx->length * 8;
+	int i;
+
+	ctx->buf[ctx->bufLen++] = 0x80;
+	if(ctx->bufLen > 56) {
+		memset(ctx->buf + ctx->bufLen, 0, 64 - ctx->bufLen);
+		sha1Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	memset(ctx->buf + ctx->bufLen, 0, 56 - ctx->bufLen);
+	for(i=0; i<8; i++)
+		ctx->buf[56+i] = bits >> (56 - i*8);
+	sha1Blocks(ctx->state, ctx->buf, 1);
+	for(i=0; i<5; i++) {
+		out[i*4] = ctx->state[i] >> 24;
+		out[i*4+1] = ctx->state[i] >> 16;
+		out[i*4+2] = ctx->state[i] >> 8;
+		out[i*4+3] = ctx->state[i];
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef __SHA1_H__
+#define __SHA1_H__
+
+/* Plain C SHA-1, for checking dumped ROMs against DAT files */
+
+#include "gbacia.h"
+
+#define SHA1_SIZE 20
+
+struct sha1 {
+	u32 state[5];
+	u64 length;	//total bytes hashed so far
+	u8 buf[64];
+	u32 bufLen;
+};
+
+void sha1Init(struct sha1 *ctx);
+void sha1Update(struct sha1 *ctx, const void *data, size_t len);
+void sha1Final(struct sha1 *ctx, u8 out[SHA1_SIZE]);
+
+#endif /* __SHA1_H__ */
@@ -0,0 +1,105 @@
+/* agb_edit SHA-256 implementation (FIPS 180-4) */
+
+#include "sha256.h"
+
+static const u32 k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+//compress one or more whole 64 byte blocks
+static void sha256Blocks(u32 state[8], const u8 *p, size_t nBlocks) {
+	u32 w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	while(nBlocks--) {
+		for(i=0; i<16; i++)
+			w[i] = ((u32)p[i*4]<<24) | ((u32)p[i*4+1]<<16) | ((u32)p[i*4+2]<<8) | p[i*4+3];
+		for(; i<64; i++)
+			w[i] = (ROR(w[i-2], 17) ^ ROR(w[i-2], 19) ^ (w[i-2] >> 10)) + w[i-7]
+				+ (ROR(w[i-15], 7) ^ ROR(w[i-15], 18) ^ (w[i-15] >> 3)) + w[i-16];
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+		for(i=0; i<64; i++) {
+			t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+			t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		p += 64;
+	}
+}
+
+void sha256Init(struct sha256 *ctx) {
+	static const u32 init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+	memcpy(ctx->state, init, sizeof(init));
+	ctx->length = 0;
+	ctx->bufLen = 0;
+}
+
+void sha256Update(struct sha256 *ctx, const void *data, size_t len) {
+	const u8 *p = data;
+	size_t n;
+
+	ctx->length += len;
+	//top up a partial block first
+	if(ctx->bufLen) {
+		n = 64 - ctx->bufLen;
+		if(n > len) n = len;
+		memcpy(ctx->buf + ctx->bufLen, p, n);
+		ctx->bufLen += n;
+		p += n;
+		len -= n;
+		if(ctx->bufLen < 64) return;
+		sha256Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	//whole blocks straight from the caller's buffer
+	if(len >= 64) {
+		sha256Blocks(ctx->state, p, len/64);
+		p += len & ~(size_t)63;
+		len &= 63;
+	}
+	memcpy(ctx->buf, p, len);
+	ctx->bufLen = len;
+}
+
+void sha256Final(struct sha256 *ctx, u8 out[SHA256_SIZE]) {
+	u64 bits = ctx->length * 8;
+	int i;
+
+	ctx->buf[ctx->bufLen++] = 0x80;
+	if(ctx->bufLen > 56) {
+		memset(ctx->buf + ctx->bufLen, 0, 64 - ctx->bufLen);
+		sha256Blocks(ctx->state, ctx->buf, 1);
+		ctx->bufLen = 0;
+	}
+	memset(ctx->buf + ctx->bufLen, 0, 56 - ctx->bufLen);
+	for(i=0; i<8; i++)
+		ctx->buf[56+i] = bits >> (56 - i*8);
+	sha256Blocks(ctx->state, ctx->buf, 1);
+	for(i=0; i<8; i++) {
+		out[i*4] = ctx->state[i] >> 24;
+		out[i*4+1] = ctx->state[i] >> 16;
+		out[i*4+2] = ctx->state[i] >> 8;
+		out[i*4+3] = ctx->state[i];
+	}
+}
+
+void sha256(const void *data, size_t len, u8 out[SHA256_SIZE]) {
+	struct sha256 ctx;
+	sha256Init(&ctx);
+	sha256Update(&ctx, data, len);
+	sha256Final(&ctx, out);
+}
@@ -0,0 +1,22 @@
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+/* Plain C SHA-256, used for the exefs, NCCH and TMD hash chain */
+
+#include "gbacia.h"
+
+#define SHA256_SIZE 32
+
+struct sha256 {
+	u32 state[8];
+	u64 length;	//total bytes hashed so far
+	u8 buf[64];
+	u32 bufLen;
+};
+
+void sha256Init(struct sha256 *ctx);
+void sha256Update(struct sha256 *ctx, const void *data, size_t len);
+void sha256Final(struct sha256 *ctx, u8 out[SHA256_SIZE]);
+void sha256(const void *data, size_t len, u8 out[SHA256_SIZE]);	//one-shot convenience
+
+#endif /* __SHA256_H__ */
@@ -0,0 +1,45 @@
+/* agb_edit staging of intermediate files in memory or on disk */
+
+#include "stage.h"
+
+void stageInit(struct stage *stage, const char *dir, int inMemory) {
+	stage->dir = dir;
+	stage->inMemory = inMemory;
+}
+
+//clean & make the temp dir -- nothing to do when it's all in memory
+void stageReset(struct stage *stage) {
+	if(stage->inMemory)
+		return;
+	removeTree(stage->dir);	//fine if it wasn't there
+	makeDir(stage->dir);
+}
+
+const char* stageCreate(struct stage *stage, struct stageFile *file, const char *name) {
+	memset(file, 0, sizeof(struct stageFile));
+#ifndef _WIN32
+	file->map.fd = -1;
+#endif
+	if(stage->inMemory) {
+		snprintf(file->name, sizeof(file->name), "%s", name);
+		file->fp = memFile(name);
+		if(!file->fp) return "can't create file in memory";
+	} else {
+		snprintf(file->name, sizeof(file->name), "%s" PATH_SEP "%s", stage->dir, name);
+		file->fp = fopen(file->name, "w+b");
+		if(!file->fp) return "can't create staging file";
+	}
+	return NULL;
+}
+
+const char* stageFinish(struct stageFile *file) {
+	return mapStream(&file->map, file->fp);
+}
+
+void stageClose(struct stageFile *file) {
+	if(file->map.data)
+		unmapFile(&file->map);
+	if(file->fp)
+		fclose(file->fp);
+	file->fp = NULL;
+}
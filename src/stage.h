@@ -0,0 +1,34 @@
+#ifndef __STAGE_H__
+#define __STAGE_H__
+
+/* Staging for the intermediate files of an unpack and rebuild
+ * Files are staged either in a directory on disk, which is what external
+ * tools and extract mode need, or in anonymous memory so small titles never
+ * touch the temp disk at all. Either way a staged file is written through a
+ * FILE* and then mapped so the next step can read it as a buffer.
+ */
+
+#include "gbacia.h"
+#include "platform.h"
+
+#define STAGE_RAM_LIMIT_DEFAULT (64 << 20)	//contents bigger than this get staged on disk
+
+struct stage {
+	const char *dir;	//where files go on disk
+	int inMemory;
+};
+
+struct stageFile {
+	FILE *fp;
+	struct fileMap map;	//valid after stageFinish
+	char name[4096];	//path on disk, or just the name for one in memory
+};
+
+void stageInit(struct stage *stage, const char *dir, int inMemory);
+void stageReset(struct stage *stage);	//start with an empty staging dir
+//both return a string on failure, NULL on success
+const char* stageCreate(struct stage *stage, struct stageFile *file, const char *name);
+const char* stageFinish(struct stageFile *file);	//done writing, map what we wrote
+void stageClose(struct stageFile *file);	//a file in memory is gone after this
+
+#endif /* __STAGE_H__ */
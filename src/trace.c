@@ -0,0 +1,122 @@
+/* agb_edit stage tracing to Chrome trace-event JSON */
+
+#include <pthread.h>
+#include "trace.h"
+#include "platform.h"
+#include "json.h"
+
+struct traceEvent {
+	const char *name;
+	const char *fname;
+	int worker;
+	u64 start, end;
+	u64 bytesRead, bytesWritten;
+	int exitCode;
+};
+
+static FILE *traceFile;
+static struct traceEvent *events;
+static int nEvents, maxEvents, maxWorker;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+const char* traceOpen(const char *fname) {
+	traceFile = fopen(fname, "w");
+	if(!traceFile) return "can't create trace file";
+	return NULL;
+}
+
+void traceBegin(struct traceSpan *span, const char *name) {
+	span->name = name;
+	span->start = traceFile ? timeMicros() : 0;
+}
+
+void traceEnd(struct traceSpan *span, const struct job *job, u64 bytesRead, u64 bytesWritten, int exitCode) {
+	struct traceEvent *e;
+	u64 end;
+
+	if(!traceFile)
+		return;
+	end = timeMicros();
+	pthread_mutex_lock(&traceLock);
+	if(nEvents == maxEvents) {
+		int newMax = maxEvents ? maxEvents*2 : 1024;
+		e = realloc(events, newMax * sizeof(struct traceEvent));
+		if(!e) {	//drop it, the trace is only a diagnostic
+			pthread_mutex_unlock(&traceLock);
+			return;
+		}
+		events = e;
+		maxEvents = newMax;
+	}
+	e = &events[nEvents++];
+	e->name = span->name;
+	e->fname = job ? job->fname : NULL;
+	e->worker = job ? job->worker : 0;
+	e->start = span->start;
+	e->end = end;
+	e->bytesRead = bytesRead;
+	e->bytesWritten = bytesWritten;
+	e->exitCode = exitCode;
+	if(e->worker > maxWorker)
+		maxWorker = e->worker;
+	pthread_mutex_unlock(&traceLock);
+}
+
+//JSON string, escaping whatever needs it -- file names on windows are full of backslashes,
+//and ones that aren't UTF-8 get U+FFFD just like in the -json report
+static void writeString(FILE *fp, const char *s) {
+	int n;
+	fputc('"', fp);
+	for(; *s; s++) {
+		if(*s == '"' || *s == '\\')
+			fprintf(fp, "\\%c", *s);
+		else if((u8)*s < 0x20)
+			fprintf(fp, "\\u%04x", (u8)*s);
+		else if((u8)*s < 0x80)
+			fputc(*s, fp);
+		else if((n = utf8Length((const u8*)s)) != 0) {
+			fwrite(s, 1, n, fp);
+			s += n - 1;
+		} else
+			fputs("\\ufffd", fp);
+	}
+	fputc('"', fp);
+}
+
+const char* traceClose(void) {
+	const char *sep = "";
+	u64 base;
+	int i;
+
+	if(!traceFile)
+		return NULL;
+	base = nEvents ? events[0].start : 0;
+	for(i=1; i<nEvents; i++)
+		if(events[i].start < base)
+			base = events[i].start;
+
+	//one row per worker, then every stage as a complete ("X") event on its worker's row
+	fprintf(traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(i=0; i<=maxWorker; i++, sep=",\n")
+		fprintf(traceFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", sep, i, i);
+	for(i=0; i<nEvents; i++) {
+		const struct traceEvent *e = &events[i];
+		fprintf(traceFile, "%s{\"name\":", sep);
+		writeString(traceFile, e->name);
+		fprintf(traceFile, ",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu,\"args\":{\"file\":",
+				e->worker, e->start - base, e->end - e->start);
+		writeString(traceFile, e->fname ? e->fname : "");
+		fprintf(traceFile, ",\"bytesRead\":%llu,\"bytesWritten\":%llu", e->bytesRead, e->bytesWritten);
+		if(e->exitCode != TRACE_NO_EXIT_CODE)
+			fprintf(traceFile, ",\"exitCode\":%d", e->exitCode);
+		fprintf(traceFile, "}}");
+	}
+	fprintf(traceFile, "\n]}\n");
+
+	free(events);
+	events = NULL;
+	nEvents = maxEvents = maxWorker = 0;
+	i = fclose(traceFile);
+	traceFile = NULL;
+	return i == 0 ? NULL : "can't write trace file";
+}
@@ -0,0 +1,27 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+/* Optional per-stage tracing
+ * Each stage of each job is recorded with its start and end time, bytes read
+ * and written, and the exit code if it ran an external tool. The trace is
+ * written out as Chrome trace-event JSON, which chrome://tracing and
+ * ui.perfetto.dev can show as a timeline with one row per worker.
+ * Everything here is a no-op until traceOpen is called.
+ */
+
+#include "gbacia.h"
+
+#define TRACE_NO_EXIT_CODE (-1000000)	//for stages that don't run a tool
+
+struct traceSpan {
+	const char *name;
+	u64 start;	//microseconds
+};
+
+//returns a string on failure, NULL on success
+const char* traceOpen(const char *fname);
+const char* traceClose(void);	//writes the trace out
+void traceBegin(struct traceSpan *span, const char *name);
+void traceEnd(struct traceSpan *span, const struct job *job, u64 bytesRead, u64 bytesWritten, int exitCode);
+
+#endif /* __TRACE_H__ */
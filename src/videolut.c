@@ -155,14 +155,14 @@ void lutSetColorTemp(int kelvin) {
  * g_out = output gamma
  * f_flip = invert [-1..1]
  * s = solarize (vee) [0..1] */
-void makeVideoLUT(void) {
+void makeVideoLUT(u8 lut[3*256]) {
 	int value;
 	for(int x=0; x<256; x++) {
 		for(int clr=0; clr<3; clr++) {
 			value = (int) (255.0 * whitepoint[clr] * pow(pow(contrast[clr], gammaIn[clr]) * pow(invert[clr] * (solarize[clr] * (1 - fabs(2 * (x / 255.0) - 1)) + (x / 255.0) * (1 - solarize[clr]) - 0.5) + brightness[clr] / contrast[clr] + 0.5, gammaIn[clr]), 1 / gammaOut[clr]) + 0.5);
 			if(value < minval[clr]) value = minval[clr];
 			if(value > maxval[clr]) value = maxval[clr];
-			videoLUT[3*x+clr] = (u8) value;
+			lut[3*x+clr] = (u8) value;
 		}
 	}
 }
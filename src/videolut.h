@@ -42,6 +42,6 @@ void lutSetWhitePoint(double value);
 void lutSetWhitePointColor(double red, double green, double blue);
 void lutSetColorTemp(int kelvin);
 
-void makeVideoLUT(void);	//calculate actual LUT byte array from parameters
+void makeVideoLUT(u8 lut[3*256]);	//calculate actual LUT byte array from parameters
 
 #endif /* __VIDEOLUT_H__ */